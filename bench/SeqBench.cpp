@@ -0,0 +1,1390 @@
+// Headless benchmark of the KSnoopySEQ engine.  Builds without the Rack SDK:
+//   make bench
+// Optional argument: seconds of audio to render per case (default 60).
+// `SeqBench drift [samples]` instead checks the internal clock's edges for
+// drift over a long run (default 10^9 samples), see `make bench-drift`.
+// With `make bench SEQ_TRACE=1` the per-sample cases are traced like the
+// module, to build/headless/SeqBench-trace.bin.
+
+#include "SeqBank.hpp"
+#include "SeqControls.hpp"
+#include "SeqEngine.hpp"
+#include "SeqGates.hpp"
+#include "SeqGlide.hpp"
+#include "SeqLights.hpp"
+#include "SeqLanes.hpp"
+#include "SeqPatternCompiler.hpp"
+#include "SeqQuantizer.hpp"
+#include "SeqRender.hpp"
+#include "SeqState.hpp"
+#include "SeqTrace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#define BENCH_BLOCK_SIZE 64
+#define BENCH_INPUT_LOOP 65536
+
+typedef std::chrono::steady_clock BenchClock;
+
+enum BenchScenario
+{
+    INTERNAL_CLOCK,
+    EXTERNAL_CLOCK,
+    RESET_AND_PATTERN_CV,
+    POLYPHONIC_LANES,
+    LIVE_MASK_OPS,
+    RATCHETS,
+    STEP_CONDITIONS,
+    CONTROLS_POLLED,
+    CONTROLS_SCANNED,
+    EXTERNAL_CLOCK_MODULE,
+    NUM_SCENARIOS
+};
+
+static const char *ScenarioName(int scenario)
+{
+    switch (scenario)
+    {
+        case INTERNAL_CLOCK: return "internal clock";
+        case EXTERNAL_CLOCK: return "external clock";
+        case RESET_AND_PATTERN_CV: return "reset + pattern CV";
+        case POLYPHONIC_LANES: return "16 lanes";
+        case LIVE_MASK_OPS: return "75% skips, rotating";
+        case RATCHETS: return "retrigger + ratchets";
+        case STEP_CONDITIONS: return "conditions + fill";
+        case CONTROLS_POLLED: return "idle knobs, polled";
+        case CONTROLS_SCANNED: return "idle knobs, scanned";
+        case EXTERNAL_CLOCK_MODULE: return "external clock, module path";
+    }
+    return "?";
+}
+
+// Inputs are rendered up front so the timed loop only measures the engine
+static void FillInputs(int scenario, float sampleRate, std::vector<SeqInputs> &inputs)
+{
+    inputs.resize(BENCH_INPUT_LOOP);
+    for (int i = 0; i < BENCH_INPUT_LOOP; i++)
+    {
+        SeqInputs &in = inputs[i];
+        in.clock = 4.f; // 16 Hz
+        in.steps = 10.f;
+        if (scenario == EXTERNAL_CLOCK || scenario == EXTERNAL_CLOCK_MODULE)
+        {
+            // 32 Hz square wave
+            int period = (int)(sampleRate / 32.f);
+            in.extClockConnected = true;
+            in.extClock = (i % period) < period / 2 ? 10.f : 0.f;
+        }
+        else if (scenario == RESET_AND_PATTERN_CV)
+        {
+            // reset every 256 samples, pattern CV sweeping across all patterns
+            in.reset = (i % 256) < 4 ? 10.f : 0.f;
+            in.pattern = 10.f * (float)(i % 4096) / 4096.f;
+            in.steps = 1.f + 9.f * (float)(i % 1000) / 1000.f;
+        }
+    }
+}
+
+static const std::string kUserPatterns[SEQ_MAX_USER_PATTERNS] =
+{
+    "rot(snake, 2)",
+    "euclid(5, 16)",
+    "knight(1, 32)",
+    "walk(1234, 48, 6)",
+    "rep(1-4 8-5, 3)",
+    "rev(circle) 1 16",
+    "pingpong rot(ppsnake, 7)",
+    "euclid(7, 12, 3) euclid(3, 8)"
+};
+
+// A panel's worth of untouched knobs and buttons, read the way the module
+// reads them: either every control every sample (as process() used to), or
+// scanned once per UI block through SeqControls
+template <int W, int H>
+struct BenchPanel
+{
+    typedef SeqControls<W, H> Controls;
+    static const int kButtons = 32;
+    static const int kUiBlock = 32;
+
+    float m_knobs[Controls::NUM_KNOBS] = {0.f, 4.f, 0.f, 10.f, 0.f};
+    float m_buttons[kButtons] = {};
+    float m_pitch[SeqGrid<W, H>::kSteps];
+    SeqSchmittTrigger m_buttonTriggers[kButtons];
+    Controls m_controls;
+    int m_uiCount = 0;
+    int m_pressed = 0;
+    long m_coasted = 0; // samples ScanPatched() didn't send through the step logic
+
+    BenchPanel()
+    {
+        for (int i = 0; i < SeqGrid<W, H>::kSteps; i++)
+        {
+            m_pitch[i] = i / 12.f;
+        }
+    }
+
+    void ScanButtons()
+    {
+        for (int i = 0; i < kButtons; i++)
+        {
+            m_pressed += m_buttonTriggers[i].Process(m_buttons[i]);
+        }
+    }
+
+    SeqInputs Poll(const SeqInputs &cv)
+    {
+        ScanButtons();
+        SeqInputs in = cv;
+        in.run = m_knobs[Controls::RUN];
+        in.clock = m_knobs[Controls::CLOCK] + cv.clock;
+        in.reset = m_knobs[Controls::RESET] + cv.reset;
+        in.steps = m_knobs[Controls::STEPS] + cv.steps;
+        in.pattern = m_knobs[Controls::PATTERN] + cv.pattern;
+        return in;
+    }
+
+    void ScanControls()
+    {
+        ScanButtons();
+        for (int i = 0; i < Controls::NUM_KNOBS; i++)
+        {
+            m_controls.SetKnob((typename Controls::Knob)i, m_knobs[i]);
+        }
+        if (m_controls.m_pitchStep >= 0 && m_controls.m_pitchStep < SeqGrid<W, H>::kSteps)
+        {
+            m_controls.ScanPitch(m_pitch[m_controls.m_pitchStep]);
+        }
+    }
+
+    // The module's path: no CV is patched in these scenarios, so between
+    // scans the engine gets the cached knob inputs and isn't asked to
+    // compare them
+    SeqFrame Scan(SeqEngine<W, H> &engine, float sampleTime)
+    {
+        if (++m_uiCount == kUiBlock)
+        {
+            m_uiCount = 0;
+            ScanControls();
+        }
+        bool changed = m_controls.UpdateKnobInputs();
+        return engine.Process(m_controls.m_knobInputs, sampleTime, changed);
+    }
+
+    // The module's path with CV patched: the scanned knobs plus the CV, which
+    // the engine compares, so it still coasts between clock edges
+    SeqFrame ScanPatched(SeqEngine<W, H> &engine, const SeqInputs &cv, float sampleTime)
+    {
+        if (++m_uiCount == kUiBlock)
+        {
+            m_uiCount = 0;
+            ScanControls();
+        }
+        m_controls.UpdateKnobInputs();
+        SeqInputs in = m_controls.m_knobInputs;
+        in.clock += cv.clock;
+        in.extClockConnected = cv.extClockConnected;
+        in.extClock = cv.extClock;
+        in.reset += cv.reset;
+        in.steps += cv.steps;
+        in.pattern += cv.pattern;
+        m_coasted += engine.CanCoast(in, sampleTime);
+        return engine.Process(in, sampleTime);
+    }
+
+    float Pitch(int step, bool scanned)
+    {
+        step = std::min(step, SeqGrid<W, H>::kSteps - 1);
+        if (!scanned)
+        {
+            return m_pitch[step];
+        }
+        if (m_controls.PitchStale(step))
+        {
+            m_controls.SetPitch(step, m_pitch[step], m_pitch[step]);
+        }
+        return m_controls.m_pitch;
+    }
+};
+
+template <int W, int H>
+static void RunCase(int scenario, float sampleRate, double seconds, bool blockMode)
+{
+    std::vector<SeqInputs> inputs;
+    FillInputs(scenario, sampleRate, inputs);
+
+    SeqEngine<W, H> engine;
+    for (int i = 0; i < SeqGrid<W, H>::kSteps; i++)
+    {
+        engine.m_skip.Set(i, i % 5 == 3);
+    }
+    bool maskOps = (scenario == LIVE_MASK_OPS);
+    if (maskOps)
+    {
+        engine.ApplyMaskOp(SeqMaskOp::SKIPS, SeqMaskOp::RANDOM, 0.75f);
+    }
+
+    if (scenario == RESET_AND_PATTERN_CV)
+    {
+        // pattern CV sweeps over the user patterns as well
+        std::string errors[SEQ_MAX_USER_PATTERNS];
+        int patternOfSlot[SEQ_MAX_USER_PATTERNS];
+        SeqPatternCompiler<W, H>::BuildSet(kUserPatterns, SEQ_MAX_USER_PATTERNS, engine.EditPatterns(), errors, patternOfSlot);
+        engine.PublishPatterns();
+    }
+
+    bool conditions = (scenario == STEP_CONDITIONS);
+    if (conditions)
+    {
+        // a chance, a ratio and a fill step in every four, a 2 loop phrase
+        for (int i = 0; i < SeqGrid<W, H>::kSteps; i++)
+        {
+            SeqCondition condition;
+            condition.type = (i % 4 == 1) ? SeqCondition::RATIO : (i % 4 == 2) ? SeqCondition::FILL : SeqCondition::ALWAYS;
+            condition.a = 1;
+            condition.b = 3;
+            condition.chance = (i % 4 == 0) ? 50 : 100;
+            engine.m_conditions.Set(i, condition);
+        }
+        engine.m_conditions.SetPhrase(2);
+    }
+
+    SeqLanes<W, H> lanes;
+    bool polyphonic = (scenario == POLYPHONIC_LANES);
+    if (polyphonic)
+    {
+        for (int lane = 0; lane < SEQ_MAX_LANES; lane++)
+        {
+            lanes.m_config[lane].pattern = 1 + lane % SEQ_NUM_PATTERNS;
+            lanes.m_config[lane].phaseOffset = lane / (float)SEQ_MAX_LANES;
+            lanes.m_config[lane].skipMode = (SeqLaneConfig::SkipMode)(lane % SeqLaneConfig::NUM_SKIP_MODES);
+        }
+        lanes.SetNumLanes(SEQ_MAX_LANES, engine);
+    }
+
+    SeqGateGenerator<W, H> gates;
+    bool gateModes = (scenario == RATCHETS);
+    if (gateModes)
+    {
+        // every step a different length, every third one ratcheted
+        gates.SetSampleRate(sampleRate);
+        gates.SetMode(SeqGateMode::RETRIGGER, false);
+        for (int i = 0; i < SeqGrid<W, H>::kSteps; i++)
+        {
+            gates.SetLength(i, 1 + i % SEQ_GATE_LENGTHS);
+            gates.SetRatchets(i, (i % 3 == 0) ? 1 + i % SEQ_MAX_RATCHETS : 1);
+        }
+    }
+    float gateLevels[BENCH_BLOCK_SIZE][SEQ_GATE_OUTPUTS];
+
+    // Traced like the module when built with `make bench SEQ_TRACE=1`
+    SeqTrace trace;
+    BenchPanel<W, H> panel;
+    bool polled = (scenario == CONTROLS_POLLED);
+    bool scanned = (scenario == CONTROLS_SCANNED);
+    bool patched = (scenario == EXTERNAL_CLOCK_MODULE);
+    if (polled || scanned || patched)
+    {
+        // the knobs supply the clock and step count, the CV is all zero
+        panel.ScanControls();
+        for (size_t i = 0; i < inputs.size(); i++)
+        {
+            inputs[i].clock = 0.f;
+            inputs[i].steps = 0.f;
+        }
+        panel.m_controls.SetCvPatched(patched);
+    }
+
+    long numBlocks = (long)(seconds * sampleRate) / BENCH_BLOCK_SIZE;
+    std::vector<double> blockNs(numBlocks);
+    float sampleTime = 1.f / sampleRate;
+    SeqFrame frames[BENCH_BLOCK_SIZE];
+    long checksum = 0;
+    int inputIndex = 0;
+
+    BenchClock::time_point start = BenchClock::now();
+    for (long block = 0; block < numBlocks; block++)
+    {
+        BenchClock::time_point blockStart = BenchClock::now();
+        if (maskOps && block % 4 == 0)
+        {
+            // skip mask rotated every 256 samples, as from a trigger input
+            engine.ApplyMaskOp(SeqMaskOp::SKIPS, SeqMaskOp::ROTATE_RIGHT, 0.f);
+        }
+        if (conditions)
+        {
+            // fill on for one block in eight, as from the module's scan
+            engine.SetFill(block % 8 == 0);
+        }
+        if (blockMode)
+        {
+            // inputs sampled once per block
+            engine.ProcessBlock(inputs[inputIndex], sampleTime, BENCH_BLOCK_SIZE, frames);
+            inputIndex = (inputIndex + BENCH_BLOCK_SIZE) & (BENCH_INPUT_LOOP - 1);
+            if (gateModes)
+            {
+                gates.Process(frames, BENCH_BLOCK_SIZE, gateLevels);
+            }
+        }
+        else
+        {
+            for (int i = 0; i < BENCH_BLOCK_SIZE; i++)
+            {
+                if (patched)
+                {
+                    frames[i] = panel.ScanPatched(engine, inputs[inputIndex], sampleTime);
+                }
+                else if (polled || scanned)
+                {
+                    frames[i] = polled ? engine.Process(panel.Poll(inputs[inputIndex]), sampleTime)
+                                       : panel.Scan(engine, sampleTime);
+                    checksum += (long)(12.f * panel.Pitch(frames[i].step, scanned));
+                }
+                else
+                {
+                    frames[i] = engine.Process(inputs[inputIndex], sampleTime);
+                }
+                SEQ_TRACE_TICK(trace);
+                if (frames[i].advanced)
+                {
+                    SEQ_TRACE_EVENT(trace, frames[i].reset ? SeqTraceEvent::RESET : SeqTraceEvent::STEP, frames[i].step, frames[i].edgeOffset);
+                }
+                if (gateModes)
+                {
+                    gates.Process(&frames[i], 1, &gateLevels[i]);
+                }
+                if (polyphonic)
+                {
+                    lanes.Process(engine, frames[i], inputs[inputIndex]);
+                    checksum += lanes.m_step[SEQ_MAX_LANES - 1] + (int)lanes.m_gateXorY[SEQ_MAX_LANES - 1];
+                }
+                inputIndex = (inputIndex + 1) & (BENCH_INPUT_LOOP - 1);
+            }
+        }
+        for (int i = 0; i < BENCH_BLOCK_SIZE; i++)
+        {
+            checksum += frames[i].step + frames[i].gateXorY;
+            if (gateModes)
+            {
+                checksum += (int)gateLevels[i][0] + 2 * (int)gateLevels[i][1];
+            }
+        }
+        blockNs[block] = std::chrono::duration<double, std::nano>(BenchClock::now() - blockStart).count();
+    }
+    double totalNs = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+
+    std::sort(blockNs.begin(), blockNs.end());
+    double p99 = blockNs[(size_t)(0.99 * (numBlocks - 1))];
+    long numSamples = numBlocks * BENCH_BLOCK_SIZE;
+
+    char coasted[32] = "";
+    if (patched)
+    {
+        snprintf(coasted, sizeof(coasted), ", %.1f%% coasted", 100.0 * panel.m_coasted / numSamples);
+    }
+    printf("%2dx%-2d %-20s %-6s %6.0f Hz %10ld samples %8.2f ns/sample %10.0f ns p99/block (checksum %ld%s)\n",
+           W, H, ScenarioName(scenario), blockMode ? "block" : "sample", sampleRate, numSamples, totalNs / numSamples, p99, checksum, coasted);
+}
+
+// Cost of compiling the user patterns and publishing them to an engine, as
+// done on the UI thread when a pattern is edited or a patch is loaded
+template <int W, int H>
+static void RunPatternCompile()
+{
+    const int iterations = 20000;
+    SeqEngine<W, H> engine;
+    std::string errors[SEQ_MAX_USER_PATTERNS];
+    int patternOfSlot[SEQ_MAX_USER_PATTERNS];
+
+    BenchClock::time_point start = BenchClock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        SeqPatternCompiler<W, H>::BuildSet(kUserPatterns, SEQ_MAX_USER_PATTERNS, engine.EditPatterns(), errors, patternOfSlot);
+        engine.PublishPatterns();
+    }
+    double ns = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+
+    for (int i = 0; i < SEQ_MAX_USER_PATTERNS; i++)
+    {
+        if (!errors[i].empty())
+        {
+            printf("user pattern %d: %s\n", i + 1, errors[i].c_str());
+        }
+    }
+
+    // Patterns that come out empty are errors, and the slots after them
+    // keep their pattern numbers
+    std::string broken[SEQ_MAX_USER_PATTERNS];
+    std::copy(kUserPatterns, kUserPatterns + SEQ_MAX_USER_PATTERNS, broken);
+    broken[1] = "rep(1, 0)";
+    broken[2] = "rev(rep(1-4, 0))";
+    SeqPatternCompiler<W, H>::BuildSet(broken, SEQ_MAX_USER_PATTERNS, engine.EditPatterns(), errors, patternOfSlot);
+    bool stable = (errors[1] == "empty pattern" && errors[2] == "empty pattern");
+    for (int i = 0; i < SEQ_MAX_USER_PATTERNS; i++)
+    {
+        stable = stable && patternOfSlot[i] == SEQ_NUM_PATTERNS + 1 + i;
+    }
+    printf("%2dx%-2d %-20s %d user patterns %10.2f us/compile+publish (%s)\n", W, H, "pattern compile", SEQ_MAX_USER_PATTERNS, ns / iterations / 1000.0,
+           stable ? "empty patterns rejected, slots kept" : "SLOTS MOVED");
+}
+
+// Cost of mapping a large pattern bank, as on patch load, and of recalling a
+// slot into the engine, as the module does at a step boundary
+template <int W, int H>
+static void RunBankRecall()
+{
+    typedef SeqBankSlot<W, H> Slot;
+    const int numSlots = 512;
+    const int loads = 200;
+    const int recalls = 1000000;
+    const std::string path = "build/headless/SeqBench" SEQ_BANK_EXTENSION;
+
+    std::vector<Slot> slots(numSlots);
+    for (int i = 0; i < numSlots; i++)
+    {
+        SeqStepMask<W * H> pitchOn;
+        SeqStepMask<W * H> skip;
+        for (int step = 0; step < W * H; step++)
+        {
+            slots[i].pitches[step] = (float)((i + step) % 120) / 12.f;
+            pitchOn.Set(step, (i + step) % 3 != 0);
+            skip.Set(step, (i * step) % 7 == 1);
+        }
+        Slot::FromMask(pitchOn, slots[i].pitchOn);
+        Slot::FromMask(skip, slots[i].skip);
+        slots[i].pattern = (float)(i % 10);
+        slots[i].steps = 10.f;
+    }
+    if (!SeqBank<W, H>::Write(path, slots))
+    {
+        printf("could not write %s\n", path.c_str());
+        return;
+    }
+
+    BenchClock::time_point start = BenchClock::now();
+    for (int i = 0; i < loads; i++)
+    {
+        SeqBank<W, H> bank;
+        bank.Load(path);
+    }
+    double loadNs = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / loads;
+
+    SeqBank<W, H> bank;
+    if (!bank.Load(path) || bank.NumSlots() != numSlots)
+    {
+        printf("could not load %s\n", path.c_str());
+        return;
+    }
+    SeqEngine<W, H> engine;
+    float pitches[W * H];
+    double checksum = 0.0;
+    start = BenchClock::now();
+    for (int i = 0; i < recalls; i++)
+    {
+        const Slot &slot = bank.GetSlot((i * 37) % numSlots);
+        std::copy(slot.pitches, slot.pitches + W * H, pitches);
+        engine.SetPitchOnMask(Slot::ToMask(slot.pitchOn));
+        engine.SetSkipMask(Slot::ToMask(slot.skip));
+        checksum += pitches[i % (W * H)] + engine.m_pitchOn.Count() + engine.m_skip.Count();
+    }
+    double recallNs = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / recalls;
+
+    printf("%2dx%-2d %-20s %d slots %10.2f us/map %8.1f ns/recall (checksum %.0f)\n", W, H, "pattern bank", numSlots, loadNs / 1000.0, recallNs, checksum);
+}
+
+// Stand-in for the jansson tree dataToJson used to build for the per-step
+// state: one heap value per step and lane field, arrays grown by appending,
+// then dumped to text and freed, the way an autosave goes
+struct BenchJsonValue
+{
+    int64_t value;
+};
+
+static void BenchJsonArray(std::vector<std::vector<BenchJsonValue *> > &tree, const int *values, int count)
+{
+    tree.push_back(std::vector<BenchJsonValue *>());
+    for (int i = 0; i < count; i++)
+    {
+        BenchJsonValue *value = (BenchJsonValue *)malloc(sizeof(BenchJsonValue));
+        value->value = values[i];
+        tree.back().push_back(value);
+    }
+}
+
+// Save and load of the per-step and per-lane state: the per-step arrays as
+// patches stored them before, against the compact SeqState string
+template <int W, int H>
+static void RunStateSave()
+{
+    const int iterations = 20000;
+    const int kSteps = W * H;
+    SeqState<W, H> state;
+    int gates[kSteps], skips[kSteps], lengths[kSteps], ratchets[kSteps], lanes[4 * SEQ_MAX_LANES];
+    for (int i = 0; i < kSteps; i++)
+    {
+        gates[i] = (i % 3) != 0;
+        skips[i] = (i % 7) == 1;
+        lengths[i] = 1 + i % SEQ_GATE_LENGTHS;
+        ratchets[i] = 1 + i % SEQ_MAX_RATCHETS;
+        state.pitchOn.Set(i, gates[i]);
+        state.skip.Set(i, skips[i]);
+        state.gateLengths[i] = lengths[i];
+        state.ratchets[i] = ratchets[i];
+        state.glide.Set(i, i % 4 == 2);
+    }
+    for (int i = 0; i < SEQ_MAX_LANES; i++)
+    {
+        lanes[4 * i] = state.lanes[i].pattern = i % SEQ_NUM_PATTERNS;
+        lanes[4 * i + 1] = state.lanes[i].steps = i;
+        lanes[4 * i + 2] = state.lanes[i].skipMode = SeqLaneConfig::SKIP_GRID;
+        lanes[4 * i + 3] = 0;
+    }
+
+    // per-step arrays
+    std::string text;
+    BenchClock::time_point start = BenchClock::now();
+    for (int n = 0; n < iterations; n++)
+    {
+        std::vector<std::vector<BenchJsonValue *> > tree;
+        BenchJsonArray(tree, gates, kSteps);
+        BenchJsonArray(tree, skips, kSteps);
+        BenchJsonArray(tree, lengths, kSteps);
+        BenchJsonArray(tree, ratchets, kSteps);
+        BenchJsonArray(tree, lanes, 4 * SEQ_MAX_LANES);
+        text.clear();
+        char number[24];
+        for (size_t a = 0; a < tree.size(); a++)
+        {
+            text += "[";
+            for (size_t i = 0; i < tree[a].size(); i++)
+            {
+                snprintf(number, sizeof(number), i ? ", %lld" : "%lld", (long long)tree[a][i]->value);
+                text += number;
+                free(tree[a][i]);
+            }
+            text += "]";
+        }
+    }
+    double arraySaveNs = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / iterations;
+
+    long checksum = 0;
+    start = BenchClock::now();
+    for (int n = 0; n < iterations; n++)
+    {
+        const char *c = text.c_str();
+        while (*c)
+        {
+            char *end;
+            long value = strtol(c, &end, 10);
+            if (end == c)
+            {
+                c++;
+                continue;
+            }
+            checksum += value;
+            c = end;
+        }
+    }
+    double arrayLoadNs = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / iterations;
+    printf("%2dx%-2d %-20s %6zu bytes %8.2f us/save %8.2f us/load (checksum %ld)\n", W, H, "state, arrays", text.size(), arraySaveNs / 1000.0, arrayLoadNs / 1000.0, checksum / iterations);
+
+    // compact string, copied once as json_string() would
+    char stateText[SeqState<W, H>::kTextSize];
+    start = BenchClock::now();
+    for (int n = 0; n < iterations; n++)
+    {
+        state.Encode(stateText);
+        char *copy = strdup(stateText);
+        checksum += copy[n % (SeqState<W, H>::kTextSize - 1)];
+        free(copy);
+    }
+    double compactSaveNs = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / iterations;
+
+    SeqState<W, H> loaded;
+    bool ok = true;
+    start = BenchClock::now();
+    for (int n = 0; n < iterations; n++)
+    {
+        ok = loaded.Decode(stateText) && ok;
+    }
+    double compactLoadNs = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / iterations;
+    for (int i = 0; i < kSteps; i++)
+    {
+        ok = ok && loaded.pitchOn.Test(i) == (bool)gates[i] && loaded.skip.Test(i) == (bool)skips[i] &&
+             loaded.gateLengths[i] == lengths[i] && loaded.ratchets[i] == ratchets[i];
+    }
+    ok = ok && loaded.glide == state.glide;
+    printf("%2dx%-2d %-20s %6d bytes %8.2f us/save %8.2f us/load (%s)\n", W, H, "state, compact", SeqState<W, H>::kTextSize - 1, compactSaveNs / 1000.0, compactLoadNs / 1000.0, ok ? "round trip ok" : "ROUND TRIP FAILED");
+}
+
+// A random fill of the whole grid, drawing one value at a time against the
+// batched draws Mask::Random uses, and a check that a seed replays exactly
+template <int W, int H>
+static void RunRandomFill()
+{
+    typedef typename SeqGrid<W, H>::Mask Mask;
+    const int iterations = 200000;
+
+    SeqRandom random;
+    random.Seed(1234);
+    uint64_t threshold = SeqRandom::Threshold(0.4f);
+    long checksum = 0;
+    BenchClock::time_point start = BenchClock::now();
+    for (int n = 0; n < iterations; n++)
+    {
+        Mask mask;
+        for (int i = 0; i < W * H; i++)
+        {
+            mask.Set(i, random.Next() < threshold);
+        }
+        checksum += mask.Count();
+    }
+    double scalarNs = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / iterations;
+
+    random.Seed(1234);
+    long batchChecksum = 0;
+    start = BenchClock::now();
+    for (int n = 0; n < iterations; n++)
+    {
+        batchChecksum += Mask::Random(0.4f, random).Count();
+    }
+    double batchNs = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / iterations;
+
+    // A generator saved mid-batch and restored draws on exactly as the
+    // original does
+    SeqRandom saved;
+    saved.Seed(99);
+    saved.Next();
+    char text[SeqRandom::kTextSize];
+    saved.Encode(text);
+    SeqRandom restored;
+    bool replays = restored.Decode(text);
+    for (int n = 0; n < 100; n++)
+    {
+        replays = replays && Mask::Random(0.5f, saved) == Mask::Random(0.5f, restored) && saved.Next() == restored.Next();
+    }
+    printf("%2dx%-2d %-20s %8.1f ns/fill one at a time, %8.1f ns/fill batched (%s)\n", W, H, "random fill", scalarNs, batchNs,
+           (checksum == batchChecksum && replays) ? "replays exactly" : "MISMATCH");
+}
+
+// Nearest note of the scale by searching the notes around it, as a
+// quantizer module patched after the sequencer does every sample
+static float QuantizeBySearch(float volts, uint16_t notes, int root)
+{
+    float semitones = volts * 12.f;
+    int base = (int)std::floor(semitones);
+    float best = 0.f;
+    float bestDistance = 1e9f;
+    for (int note = base - 12; note <= base + 12; note++)
+    {
+        float distance = std::fabs(note - semitones);
+        if ((notes >> (((note - root) % 12 + 12) % 12) & 1) && distance < bestDistance)
+        {
+            best = (float)note;
+            bestDistance = distance;
+        }
+    }
+    return best / 12.f;
+}
+
+// A pitch per sample for a sequence stepping every 2000 samples: searched
+// every sample, against the table and per-step cache the module uses.  Also
+// checks the table against the search for knob values across the range.
+template <int W, int H>
+static void RunQuantize()
+{
+    const int numSamples = 20000000;
+    const int samplesPerStep = 2000;
+    SeqQuantizer<W, H> quantizer;
+    quantizer.Set(SeqScale::HARMONIC_MINOR, 9);
+    uint16_t notes = SeqScale::Notes(SeqScale::HARMONIC_MINOR);
+
+    float knobs[W * H];
+    SeqRandom random;
+    for (int i = 0; i < W * H; i++)
+    {
+        knobs[i] = 10.f * random.Uniform();
+    }
+
+    double searchSum = 0.0;
+    BenchClock::time_point start = BenchClock::now();
+    for (int n = 0; n < numSamples; n++)
+    {
+        searchSum += QuantizeBySearch(knobs[(n / samplesPerStep) % (W * H)], notes, 9);
+    }
+    double searchNs = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / numSamples;
+
+    double tableSum = 0.0;
+    start = BenchClock::now();
+    for (int n = 0; n < numSamples; n++)
+    {
+        int step = (n / samplesPerStep) % (W * H);
+        tableSum += quantizer.Pitch(step, knobs[step]);
+    }
+    double tableNs = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / numSamples;
+
+    // Off the half-semitone edges, where the two can round either way
+    int mismatches = 0;
+    for (int i = 0; i < 1000000; i++)
+    {
+        float volts = 10.f * random.Uniform();
+        float halfSemitones = volts * 24.f;
+        if (std::fabs(halfSemitones - std::round(halfSemitones)) > 1e-3f &&
+            quantizer.Quantize(volts) != QuantizeBySearch(volts, notes, 9))
+        {
+            mismatches++;
+        }
+    }
+    printf("%2dx%-2d %-20s %8.2f ns/sample searched, %8.2f ns/sample table (%s)\n", W, H, "quantize", searchNs, tableNs,
+           (mismatches == 0 && searchSum == tableSum) ? "same pitches" : "MISMATCH");
+}
+
+// 16 lanes of pitch stepping every 2000 samples at 48 kHz, every other step
+// gliding for 50 ms: a slew limiter per lane working out its coefficient
+// and slewing every sample, as separate slew modules do, against SeqGlide
+// with its coefficient per settings change and lanes skipped when settled.
+// Also checks a linear glide lands on time and an exponential one is within
+// 1% at the glide time.
+static void RunGlide()
+{
+    const int numSamples = 4000000;
+    const int samplesPerStep = 2000;
+    const float sampleRate = 48000.f;
+    const float time = 0.05f;
+
+    float lanePitch[SEQ_MAX_LANES];
+    double checksum = 0.0;
+    float out[SEQ_MAX_LANES] = {};
+    BenchClock::time_point start = BenchClock::now();
+    for (int n = 0; n < numSamples; n++)
+    {
+        int step = n / samplesPerStep;
+        bool glide = step % 2;
+        for (int i = 0; i < SEQ_MAX_LANES; i++)
+        {
+            lanePitch[i] = ((step + i) % 12) / 12.f;
+            float coefficient = glide ? 1.f - std::exp(-std::log(100.f) / (time * sampleRate)) : 1.f;
+            out[i] += (lanePitch[i] - out[i]) * coefficient;
+        }
+        checksum += out[n % SEQ_MAX_LANES];
+    }
+    double perLaneNs = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / numSamples;
+
+    double glideChecksum = 0.0;
+    SeqGlide slew;
+    slew.Configure(SeqGlide::EXPONENTIAL, time, sampleRate);
+    start = BenchClock::now();
+    for (int n = 0; n < numSamples; n++)
+    {
+        int step = n / samplesPerStep;
+        if (n % samplesPerStep == 0)
+        {
+            for (int i = 0; i < SEQ_MAX_LANES; i++)
+            {
+                float pitch = ((step + i) % 12) / 12.f;
+                if (step % 2)
+                {
+                    slew.GlideTo(i, pitch);
+                }
+                else
+                {
+                    slew.Jump(i, pitch);
+                }
+            }
+        }
+        slew.Process();
+        glideChecksum += slew.m_out[n % SEQ_MAX_LANES];
+    }
+    double glideNs = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / numSamples;
+
+    // Glides from 0 to 1V
+    int glideSamples = (int)(time * sampleRate);
+    SeqGlide linear;
+    linear.Configure(SeqGlide::LINEAR, time, sampleRate);
+    linear.GlideTo(0, 1.f);
+    SeqGlide exponential;
+    exponential.Configure(SeqGlide::EXPONENTIAL, time, sampleRate);
+    exponential.GlideTo(0, 1.f);
+    bool onTime = true;
+    for (int n = 1; n <= glideSamples; n++)
+    {
+        linear.Process();
+        exponential.Process();
+        onTime = onTime && (n < glideSamples) == (linear.m_out[0] < 1.f);
+    }
+    onTime = onTime && !linear.m_active && std::fabs(exponential.m_out[0] - 0.99f) < 1e-3f;
+
+    printf("16 lanes %-17s %8.2f ns/sample slew per lane, %8.2f ns/sample glide stage (%s, %s)\n", "glide", perLaneNs, glideNs,
+           std::fabs(checksum - glideChecksum) < 1e-3 * numSamples ? "same output" : "OUTPUT DIFFERS", onTime ? "on time" : "TIMING WRONG");
+}
+
+// Retrigger gates at 1 kHz, a full length step then one of 4 half length
+// ratchets, in turn.  Checks the first ratchet is pulled low for a sample
+// after the full gate instead of merging into it, and that a step after a
+// ratchet that has already closed starts at once.
+static void RunRetrigger()
+{
+    const int numSamples = 4000000;
+    const int samplesPerStep = 100;
+    const int block = 64;
+
+    SeqGateGenerator<4, 4> gates;
+    gates.SetSampleRate(1000.f);
+    gates.SetMode(SeqGateMode::RETRIGGER, false);
+    gates.SetLength(0, SEQ_GATE_LENGTHS);
+    gates.SetLength(1, SEQ_GATE_LENGTHS / 2);
+    gates.SetRatchets(1, 4);
+
+    SeqFrame frames[block];
+    float out[block][SEQ_GATE_OUTPUTS];
+    float last = 0.f;
+    long gaps = 0;
+    long steps = 0;
+    bool ok = true;
+    double checksum = 0.0;
+    BenchClock::time_point start = BenchClock::now();
+    for (int n = 0; n < numSamples; n += block)
+    {
+        for (int i = 0; i < block; i++)
+        {
+            frames[i].running = true;
+            frames[i].advanced = ((n + i) % samplesPerStep == 0);
+            frames[i].reset = (n + i == 0);
+            frames[i].step = (n + i) / samplesPerStep % 2;
+            frames[i].xActive = true;
+        }
+        gates.Process(frames, block, out);
+        for (int i = 0; i < block; i++)
+        {
+            if (frames[i].advanced && n + i > samplesPerStep)
+            {
+                // after step 0 the gate is still high, after step 1 it isn't
+                bool gap = (out[i][0] == 0.f);
+                ok = ok && gap == (frames[i].step == 1) && (last != 0.f) == gap;
+                gaps += gap;
+                steps++;
+            }
+            last = out[i][0];
+            checksum += last;
+        }
+    }
+    double ns = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / numSamples;
+
+    printf("4x4 %-21s %8.2f ns/sample, %ld of %ld steps pulled low first (%s, checksum %.0f)\n", "retrigger gates", ns, gaps, steps,
+           ok ? "no merged gates" : "GATES MERGE", checksum);
+}
+
+// Flashes a few of 256 lights every 16 updates of 256 samples at 48 kHz and
+// checks each flash is written at full brightness before it fades.
+static void RunLights()
+{
+    const int numUpdates = 1000000;
+    const int divider = 256;
+
+    SeqLightBank<256> lights;
+    lights.SetDeltaTime(divider / 48000.f);
+
+    long flashes = 0;
+    long full = 0;
+    long writes = 0;
+    double checksum = 0.0;
+    float first[256] = {};
+    BenchClock::time_point start = BenchClock::now();
+    for (int n = 0; n < numUpdates; n++)
+    {
+        if (n % 16 == 0)
+        {
+            for (int i = n / 16 % 7; i < 256; i += 37)
+            {
+                lights.Flash(i);
+                first[i] = -1.f;
+                flashes++;
+            }
+        }
+        lights.Update([&](int i, float value)
+        {
+            if (first[i] < 0.f)
+            {
+                first[i] = value;
+                full += (value == 1.f);
+            }
+            writes++;
+            checksum += value;
+        });
+    }
+    double ns = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / numUpdates;
+
+    printf("256 %-21s %8.2f ns/update, %ld writes, %ld of %ld flashes written at full brightness (%s, checksum %.0f)\n", "light flashes", ns, writes,
+           full, flashes, (full == flashes) ? "no flash lost" : "FLASHES DECAY FIRST", checksum);
+}
+
+// Four polyphonic lanes on an external clock, the first following the
+// knobs like the mono outputs do, in every gate mode with uneven lengths
+// and ratchets.  Checks the first lane's gates match the mono ones sample
+// for sample, so the lanes get the gate mode and step gates too.
+static void RunLaneGates()
+{
+    const int numSamples = 480000;
+    const float sampleRate = 48000.f;
+    const int period = 1500; // 32 Hz
+    static const SeqGateMode::Mode modes[] = {SeqGateMode::TRIGGER, SeqGateMode::RETRIGGER, SeqGateMode::CONTINUOUS, SeqGateMode::CLOCK};
+
+    long mismatches = 0;
+    long gates = 0;
+    double ns = 0.0;
+    for (SeqGateMode::Mode mode : modes)
+    {
+        SeqEngine<4, 4> engine;
+        for (int i = 0; i < 16; i++)
+        {
+            engine.m_skip.Set(i, i % 5 == 3);
+        }
+        SeqGateGenerator<4, 4> mono;
+        mono.SetSampleRate(sampleRate);
+        mono.SetMode(mode, true);
+        for (int i = 0; i < 16; i++)
+        {
+            mono.SetLength(i, 1 + i % SEQ_GATE_LENGTHS);
+            mono.SetRatchets(i, 1 + i % SEQ_MAX_RATCHETS);
+        }
+        SeqLanes<4, 4> lanes;
+        for (int lane = 1; lane < 4; lane++)
+        {
+            lanes.m_config[lane].pattern = 1 + lane;
+            lanes.m_config[lane].skipMode = SeqLaneConfig::SKIP_INVERTED;
+        }
+        lanes.SetNumLanes(4, engine);
+        lanes.SetGates(mono);
+        lanes.SetSampleRate(sampleRate);
+
+        SeqInputs in;
+        in.extClockConnected = true;
+        float out[1][SEQ_GATE_OUTPUTS];
+        BenchClock::time_point start = BenchClock::now();
+        for (int n = 0; n < numSamples; n++)
+        {
+            in.extClock = (n % period) < period / 2 ? 10.f : 0.f;
+            in.reset = (n % (7 * period * 16) == 100) ? 10.f : 0.f;
+            SeqFrame frame = engine.Process(in, 1.f / sampleRate);
+            mono.Process(&frame, 1, out);
+            lanes.Process(engine, frame, in);
+            for (int o = 0; o < SEQ_GATE_OUTPUTS; o++)
+            {
+                const float *lane = (o == 0) ? lanes.m_gateX : (o == 1) ? lanes.m_gateY : lanes.m_gateXorY;
+                mismatches += (lane[0] != 10.f * out[0][o]);
+                gates += (out[0][o] > 0.f);
+            }
+        }
+        ns += std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / numSamples;
+    }
+
+    printf("4x4 %-21s %8.2f ns/sample with 4 lanes, %ld gate samples, %ld differ from the mono outputs (%s)\n", "lane gates",
+           ns / 4, gates, mismatches, mismatches ? "LANES IGNORE THE GATE MODE" : "every gate mode on every lane");
+}
+
+// Every step a 50% chance, with reseed on reset, and resets 2 to 5 loops
+// apart so the draws have moved on by a different amount each time.
+// Checks every reset rolls the same first loop, and that without the
+// reseed they don't.
+static void RunReseed()
+{
+    const int numResets = 100;
+    const int loopSamples = 48000; // 16 steps at 16 Hz
+    const float sampleTime = 1.f / 48000.f;
+
+    double ns = 0.0;
+    int same[2] = {};
+    for (int reseed = 0; reseed < 2; reseed++)
+    {
+        SeqEngine<4, 4> engine;
+        SeqCondition condition;
+        condition.chance = 50;
+        engine.m_conditions.Set(-1, condition);
+        engine.m_reseedOnReset = reseed;
+
+        SeqInputs in;
+        in.clock = 4.f; // 16 Hz
+        SeqGrid<4, 4>::Mask first;
+        int resets = 0;
+        long samples = 0;
+        BenchClock::time_point start = BenchClock::now();
+        for (long next = loopSamples; resets < numResets; samples++)
+        {
+            in.reset = (samples == next) ? 10.f : 0.f;
+            next += (samples == next) ? (2 + resets % 4) * loopSamples : 0;
+            SeqFrame frame = engine.Process(in, sampleTime);
+            if (frame.reset)
+            {
+                const SeqGrid<4, 4>::Mask &play = engine.m_conditions.m_play[0];
+                first = (resets++ == 0) ? play : first;
+                same[reseed] += (play == first);
+            }
+        }
+        ns += std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / samples / 2.0;
+    }
+
+    printf("4x4 %-21s %8.2f ns/sample, %d of %d resets roll the first loop again, %d without reseed (%s)\n", "reseed on reset", ns, same[1],
+           numResets, same[0], (same[1] == numResets && same[0] < numResets) ? "replays exactly" : "FIRST LOOPS DIFFER");
+}
+
+// An external clock at a period that isn't a whole number of samples,
+// straight and then multiplied by 4 with swing.  Checks every predicted
+// tick lands within two samples of where the real clock puts it: the edge
+// is only seen on the sample after it (up to one late), and the period is
+// measured in whole samples (up to one more by the group's last tick).
+static void RunClock()
+{
+    const long numSamples = 20000000;
+    const float sampleTime = 1.f / 48000.f;
+    const double extPeriod = 1000.3;
+    const int multiply = 4;
+    const float swing = 0.6f;
+
+    double ns[2];
+    long ticks[2];
+    double maxError = 0.0;
+    for (int swung = 0; swung < 2; swung++)
+    {
+        SeqEngine<4, 4> engine;
+        if (swung)
+        {
+            engine.SetClock(multiply, swing);
+        }
+        SeqInputs in;
+        in.extClockConnected = true;
+        long first = -1;
+        ticks[swung] = 0;
+        BenchClock::time_point start = BenchClock::now();
+        for (long n = 1; n <= numSamples; n++)
+        {
+            in.extClock = (std::fmod((double)n, extPeriod) < extPeriod / 2) ? 10.f : 0.f;
+            SeqFrame frame = engine.Process(in, sampleTime);
+            if (!frame.advanced)
+            {
+                continue;
+            }
+            ticks[swung]++;
+
+            // From the third edge on, once a period was measured
+            if (swung && n >= 2 * extPeriod)
+            {
+                first = (first < 0) ? ticks[swung] : first;
+                long tick = ticks[swung] - first;
+                double pair = 2.0 * extPeriod / multiply;
+                double offset = (tick % multiply / 2) * pair + ((tick % 2) ? pair * swing : 0.0);
+                double ideal = (2 + tick / multiply) * extPeriod + offset;
+                maxError = std::max(maxError, std::fabs((n - frame.edgeOffset) - ideal));
+            }
+        }
+        ns[swung] = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / numSamples;
+    }
+
+    printf("4x4 %-21s %8.2f ns/sample straight, %8.2f ns/sample x%d swing %.0f%% (%s, ticks at most %.1f samples off)\n", "external clock", ns[0], ns[1], multiply, 100.f * swing,
+           (ticks[1] >= multiply * (ticks[0] - 2) && maxError <= 2.0) ? "on time" : "TIMING WRONG", maxError);
+}
+
+// Three engines side by side, passing chain messages the way Rack's
+// expanders do: what one writes this sample the other reads the next.
+// Checks the chain ticks on exactly the samples one engine on its own does
+// (or, from an external clock, how late the others are), and that each
+// module plays whole loops of its own pattern in turn.
+static void RunChain(bool external)
+{
+    const int numModules = 3;
+    const long numSamples = 4800000;
+    const float sampleTime = 1.f / 48000.f;
+    const double extPeriod = 1000.3;
+
+    SeqEngine<4, 4> alone;
+    SeqEngine<4, 4> engines[numModules];
+    SeqInputs in[numModules];
+    in[0].clock = 4.3f; // not a whole number of samples per step
+    in[0].extClockConnected = external;
+    in[1].steps = 5.f;
+    SeqGrid<4, 4>::Mask skips;
+    skips.Set(3, true);
+    skips.Set(9, true);
+    engines[2].SetSkipMask(skips);
+    if (external)
+    {
+        alone.SetClock(2, 0.5f);
+        engines[0].SetClock(2, 0.5f);
+    }
+
+    // Double buffered like the expanders: each module reads from its left
+    // and right in one buffer and writes for the next sample into the other
+    SeqChainMessage messages[2][numModules];
+    SeqChainReply replies[2][numModules];
+    int current = 0;
+
+    // Three on their own, each with its own clock, to compare with
+    std::vector<long> aloneTicks;
+    SeqEngine<4, 4> others[numModules - 1];
+    BenchClock::time_point start = BenchClock::now();
+    for (long n = 1; n <= numSamples; n++)
+    {
+        in[0].extClock = (std::fmod((double)n, extPeriod) < extPeriod / 2) ? 10.f : 0.f;
+        if (alone.Process(in[0], sampleTime).advanced)
+        {
+            aloneTicks.push_back(n);
+        }
+        for (int i = 0; i < numModules - 1; i++)
+        {
+            others[i].Process(in[0], sampleTime);
+        }
+    }
+    double aloneNs = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / numSamples;
+
+    std::vector<long> chainTicks;
+    std::vector<int> turns[numModules]; // steps played in each turn
+    int playing = -1;
+    bool oneAtATime = true;
+    start = BenchClock::now();
+    for (long n = 1; n <= numSamples; n++)
+    {
+        in[0].extClock = (std::fmod((double)n, extPeriod) < extPeriod / 2) ? 10.f : 0.f;
+        int advanced = 0;
+        for (int i = 0; i < numModules; i++)
+        {
+            SeqEngine<4, 4> &engine = engines[i];
+            bool following = (i > 0 && messages[current][i].valid);
+            engine.m_chain.m_in = messages[current][i];
+            engine.m_chain.m_reply = replies[current][i];
+            engine.SetChain(following, i < numModules - 1);
+            if (!engine.Process(in[i], sampleTime).advanced)
+            {
+                continue;
+            }
+            advanced++;
+            if (i != playing)
+            {
+                playing = i;
+                turns[i].push_back(0);
+            }
+            turns[i].back()++;
+        }
+        for (int i = 0; i < numModules; i++)
+        {
+            if (i < numModules - 1)
+            {
+                engines[i].WriteChainMessage(messages[!current][i + 1]);
+            }
+            if (i > 0 && engines[i].m_chain.m_following)
+            {
+                replies[!current][i - 1] = engines[i].m_chain.Reply();
+            }
+        }
+        current = !current;
+
+        oneAtATime = oneAtATime && advanced <= 1;
+        if (advanced > 0)
+        {
+            chainTicks.push_back(n);
+        }
+    }
+
+    double ns = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count() / numSamples;
+
+    // Every tick of the chain against the same tick on its own
+    long maxLate = 0;
+    bool sameTicks = (chainTicks.size() == aloneTicks.size());
+    for (size_t i = 0; sameTicks && i < chainTicks.size(); i++)
+    {
+        maxLate = std::max(maxLate, std::labs(chainTicks[i] - aloneTicks[i]));
+    }
+
+    // Each module's turns, the first and last aside, the same length
+    bool wholeLoops = true;
+    std::string lengths;
+    for (int i = 0; i < numModules; i++)
+    {
+        for (size_t t = 1; t + 1 < turns[i].size(); t++)
+        {
+            wholeLoops = wholeLoops && turns[i][t] == turns[i][1];
+        }
+        char length[16];
+        snprintf(length, sizeof(length), i ? "+%d" : "%d", (turns[i].size() > 1) ? turns[i][1] : 0);
+        lengths += length;
+    }
+    char timing[48] = "same samples";
+    if (maxLate > 0)
+    {
+        snprintf(timing, sizeof(timing), "up to %ld samples late", maxLate);
+    }
+
+    printf("3x 4x4 chain %-16s %8.2f ns/sample for the three, %8.2f ns/sample unchained, loops of %s steps (%s, %s, %s)\n",
+           external ? "ext clock x2" : "internal clock", ns, aloneNs, lengths.c_str(), oneAtATime ? "one at a time" : "SEVERAL PLAYING", wholeLoops ? "whole loops" : "LOOPS CUT",
+           sameTicks ? timing : "TICKS MISSING");
+}
+
+// An offline render of the whole grid, ratchets and all, at 120 bpm.
+// Checks it starts on the pattern's first step at sample 0 and is exactly
+// the length of its steps, as the internal clock never drifts.
+template <int W, int H>
+static void RunRender()
+{
+    const int numSteps = 1024;
+    const float sampleRate = 48000.f;
+
+    SeqRenderer<W, H> renderer;
+    for (int i = 0; i < W * H; i++)
+    {
+        renderer.m_pitches[i] = (float)(i % 25) / 12.f;
+        renderer.m_state.ratchets[i] = 1 + i % SEQ_MAX_RATCHETS;
+        renderer.m_state.skip.Set(i, i % 7 == 3);
+    }
+    renderer.m_inputs.clock = 1.f;
+    renderer.m_gateMode = SeqGateMode::RETRIGGER;
+    renderer.m_scale = SeqScale::MINOR;
+
+    SeqTimeline timeline;
+    BenchClock::time_point start = BenchClock::now();
+    renderer.Render(numSteps, sampleRate, timeline);
+    double ms = std::chrono::duration<double, std::milli>(BenchClock::now() - start).count();
+
+    double checksum = 0.0;
+    for (const SeqRenderEvent &event : timeline.m_events)
+    {
+        checksum += (double)event.sample * 1e-3 + event.output + event.step + event.volts;
+    }
+    double seconds = timeline.m_length / sampleRate;
+    bool fromTop = !timeline.m_events.empty() && timeline.m_events[0].sample == 0 && timeline.m_events[0].step == 0;
+    bool exact = (timeline.m_length == (uint64_t)numSteps * (uint64_t)(sampleRate / 2.f));
+    printf("%2dx%-2d %-20s %d steps, %.0f s in %8.2f ms (%.0fx real time, %d events, %s, %s, checksum %.0f)\n", W, H, "offline render", numSteps,
+           seconds, ms, seconds * 1000.0 / ms, (int)timeline.m_events.size(), fromTop ? "from step 1" : "NOT FROM THE TOP", exact ? "exact length" : "LENGTH WRONG", checksum);
+}
+
+// Every scenario on one grid size, so sizes can be compared line by line
+template <int W, int H>
+static void RunGrid(double seconds)
+{
+    static const float sampleRates[] = {44100.f, 96000.f, 192000.f};
+
+    for (int scenario = 0; scenario < NUM_SCENARIOS; scenario++)
+    {
+        // lanes and panel controls are per sample only
+        bool perSampleOnly = (scenario == POLYPHONIC_LANES || scenario == CONTROLS_POLLED || scenario == CONTROLS_SCANNED ||
+                              scenario == EXTERNAL_CLOCK_MODULE);
+        int numModes = perSampleOnly ? 1 : 2;
+        for (int blockMode = 0; blockMode < numModes; blockMode++)
+        {
+            for (float sampleRate : sampleRates)
+            {
+                RunCase<W, H>(scenario, sampleRate, seconds, blockMode);
+            }
+        }
+    }
+    RunPatternCompile<W, H>();
+    RunBankRecall<W, H>();
+    RunStateSave<W, H>();
+    RunRandomFill<W, H>();
+    RunQuantize<W, H>();
+    RunRender<W, H>();
+}
+
+// Runs the internal clock through ProcessBlock() for `numSamples` samples and
+// checks every edge lands on the sample the exact integer phase says it
+// should: edge k is the first sample n with n * inc >= k * period.  The
+// ideal is tracked as a quotient and remainder so it is exact at any length.
+// Also reports where the edges land relative to the real valued clock (within
+// the sample after it), and how far the old float phase, reset to zero on
+// every edge, would have drifted.
+static bool RunDrift(long numSamples)
+{
+    const float sampleRate = 48000.f;
+    const float sampleTime = 1.f / sampleRate;
+    SeqInputs in;
+    in.clock = 4.3f; // 19.7 Hz, not a whole number of samples per step
+
+    SeqEngine<4, 4> engine;
+    SeqFrame frames[BENCH_BLOCK_SIZE];
+    engine.ProcessBlock(in, sampleTime, 1, frames); // picks up the rate
+    const uint64_t period = engine.m_period;
+    const uint64_t inc = engine.m_phaseInc;
+    const double realSamplesPerStep = sampleRate / (double)std::pow(2.f, in.clock);
+
+    uint64_t idealWhole = 0;
+    uint64_t idealRem = 0;
+    long edges = 0;
+    long maxError = 0;
+    double minLate = 1.0;
+    double maxLate = 0.0;
+
+    float oldPhase = 0.f;
+    float oldInc = std::pow(2.f, in.clock) * sampleTime;
+    long oldEdges = 0;
+    double oldError = 0.0;
+
+    BenchClock::time_point start = BenchClock::now();
+    for (long pos = 1; pos < numSamples; pos += BENCH_BLOCK_SIZE)
+    {
+        int frameCount = (int)std::min((long)BENCH_BLOCK_SIZE, numSamples - pos);
+        engine.ProcessBlock(in, sampleTime, frameCount, frames);
+        for (int i = 0; i < frameCount; i++)
+        {
+            long n = pos + i + 1;
+            if (frames[i].advanced)
+            {
+                edges++;
+                idealWhole += period / inc;
+                idealRem += period % inc;
+                if (idealRem >= inc)
+                {
+                    idealRem -= inc;
+                    idealWhole++;
+                }
+                long ideal = (long)idealWhole + (idealRem > 0);
+                maxError = std::max(maxError, std::labs(n - ideal));
+                double late = n - edges * realSamplesPerStep;
+                minLate = std::min(minLate, late);
+                maxLate = std::max(maxLate, late);
+            }
+
+            oldPhase += oldInc;
+            if (oldPhase >= 1.f)
+            {
+                oldPhase = 0.f;
+                oldEdges++;
+                oldError = n - oldEdges * realSamplesPerStep;
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(BenchClock::now() - start).count();
+
+    printf("drift: %ld samples at %.0f Hz, %ld edges in %.1f s\n", numSamples, sampleRate, edges, seconds);
+    printf("  max error vs exact integer phase  %ld samples\n", maxError);
+    printf("  edges after the real clock by     %.4f to %.4f samples\n", minLate, maxLate);
+    printf("  old float phase, final edge error %.0f samples\n", oldError);
+    bool pass = (edges > 0 && maxError == 0 && minLate > -0.01 && maxLate < 1.01);
+    printf("%s\n", pass ? "PASS" : "FAIL");
+    return pass;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "drift") == 0)
+    {
+        return RunDrift((argc > 2) ? atol(argv[2]) : 1000000000L) ? 0 : 1;
+    }
+
+    double seconds = (argc > 1) ? atof(argv[1]) : 60.0;
+    SEQ_TRACE_SET_FILE("build/headless/SeqBench-trace.bin");
+
+    printf("block size %d samples, %.0f s of audio per case\n", BENCH_BLOCK_SIZE, seconds);
+    RunGrid<4, 4>(seconds);
+    RunGrid<16, 16>(seconds);
+    RunRetrigger();
+    RunLaneGates();
+    RunLights();
+    RunReseed();
+    RunGlide();
+    RunClock();
+    RunChain(false);
+    RunChain(true);
+    return 0;
+}
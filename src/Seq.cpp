@@ -1,10 +1,151 @@
 #include "plugin.hpp"
-#include "utils.h"
+#include <osdialog.h>
+#include <deque>
+#include "SeqBank.hpp"
+#include "SeqControls.hpp"
+#include "SeqEngine.hpp"
+#include "SeqGates.hpp"
+#include "SeqGlide.hpp"
+#include "SeqLanes.hpp"
+#include "SeqLights.hpp"
+#include "SeqPatternCompiler.hpp"
+#include "SeqProfiler.hpp"
+#include "SeqQuantizer.hpp"
+#include "SeqRender.hpp"
+#include "SeqSpscQueue.hpp"
+#include "SeqState.hpp"
+#include "SeqTrace.hpp"
+
+#define SEQ_UI_BLOCK_SIZE 32
+#define SEQ_LIGHT_DIVISION 128
+#define SEQ_COMMAND_QUEUE_SIZE 64
+#define SEQ_BANK_MENU_SLOTS 16
+#define SEQ_EXPORT_STEPS 64
+#define SEQ_EXPORT_MAX_STEPS 1024
+
+// The panel shows a 4x4 window of the grid, larger grids page through it
+#define SEQ_PAGE_SIZE 4
+#define SEQ_PAGE_STEPS (SEQ_PAGE_SIZE * SEQ_PAGE_SIZE)
+
+// Edits made from the UI thread (menus, randomize, preset load).  They are
+// queued and applied by process() at the start of a UI block, so the engine
+// never sees a half-written grid.  A preset load is the one LOAD_PATCH.
+template <int W, int H>
+struct SeqCommand
+{
+    enum Type
+    {
+        SET_GRID,
+        SET_RUNNING,
+        SET_GATE_MODE,
+        SET_NUM_LANES,
+        SET_LANE_CONFIG,
+        SET_PAGE,
+        SET_FOLLOW_PAGE,
+        APPLY_MASK_OP,
+        SET_TRIGGER_MASK_OP,
+        SET_BAND_LIMITED_EDGES,
+        SET_GATE_LENGTH,
+        SET_RATCHETS,
+        SET_LIGHT_DIVISION,
+        RESET_TIMING,
+        SET_BANK,
+        SET_BANK_SLOT,
+        RANDOMIZE,
+        SET_RANDOM,
+        SET_RESEED_ON_RESET,
+        SET_CONDITION,
+        SET_PHRASE,
+        SET_FILL,
+        SET_LOOP,
+        SET_SCALE,
+        SET_ROOT,
+        SET_QUANTIZER_CV,
+        SET_GLIDE_STEP,
+        SET_GLIDE_TIME,
+        SET_GLIDE_SHAPE,
+        SET_CLOCK_RATIO,
+        SET_SWING,
+        LOAD_PATCH
+    };
+
+    // What RANDOMIZE re-rolls, as bits of `value`
+    enum RandomizeTargets
+    {
+        RANDOM_PITCH = 1 << 0,
+        RANDOM_GATE = 1 << 1,
+        RANDOM_SKIP = 1 << 2
+    };
 
-#define MAX_STEPS 16
+    Type type = SET_GRID;
+    bool setPitchOn = false;
+    bool setSkip = false;
+    typename SeqGrid<W, H>::Mask pitchOnMask;
+    typename SeqGrid<W, H>::Mask skipMask;
+    bool setStepGates = false; // and conditions and glides
+    uint8_t gateLengths[W * H];
+    uint8_t ratchets[W * H];
+    SeqCondition conditions[W * H];
+    typename SeqGrid<W, H>::Mask glideMask;
+    int step = 0;
+    int value = 0;
+    SeqLaneConfig laneConfig;
+    SeqBank<W, H> *bank = nullptr;
+    SeqMaskOp::Type maskOp = SeqMaskOp::INVERT;
+    float amount = 0.f;
+    SeqRandom random;
+    SeqCondition condition;
+    uint32_t loopSeed = 0;
+
+    // Everything LOAD_PATCH sets besides the grid, as dataFromJson read it
+    struct Patch
+    {
+        bool setRunning = false;
+        bool running = false;
+        int gateMode = SeqGateMode::CLOCK;
+        int numLanes = 1;
+        SeqLaneConfig lanes[SEQ_MAX_LANES];
+        int page = 0;
+        bool followPage = false;
+        int triggerMaskOps[SeqMaskOp::NUM_TARGETS] = {-1, -1}; // -1 leaves it
+        bool bandLimitedEdges = false;
+        int lightDivision = SEQ_LIGHT_DIVISION;
+        bool setRandom = false;
+        SeqRandom random;
+        bool reseedOnReset = false;
+        int phrase = SEQ_DEFAULT_PHRASE;
+        bool fill = false;
+        bool setLoop = false;
+        int loop = 0;
+        uint32_t loopSeed = 0;
+        int scale = SeqScale::OFF;
+        int root = 0;
+        int quantizerCv = 0;
+        float glideTime = SEQ_GLIDE_DEFAULT_TIME;
+        int glideShape = SeqGlide::EXPONENTIAL;
+        int clockRatio = 1;
+        float swing = 0.5f;
+    };
+    Patch patch;
+};
 
+template <int W, int H>
 struct KSnoopySEQ : Module 
 {
+    typedef SeqGrid<W, H> Grid;
+    typedef typename Grid::Mask Mask;
+    typedef SeqCommand<W, H> Command;
+    typedef SeqGateMode::Mode GateMode;
+    typedef SeqControls<W, H> Controls;
+    typedef SeqBank<W, H> Bank;
+    typedef SeqBankSlot<W, H> BankSlot;
+    typedef SeqState<W, H> State;
+    typedef SeqConditions<W, H> Conditions;
+
+    static const int kPagesX = W / SEQ_PAGE_SIZE;
+    static const int kNumPages = kPagesX * (H / SEQ_PAGE_SIZE);
+    static_assert(W % SEQ_PAGE_SIZE == 0 && H % SEQ_PAGE_SIZE == 0, "grid must be whole pages");
+
     enum ParamIds 
     {
         CLOCK_PARAM,
@@ -12,9 +153,9 @@ struct KSnoopySEQ : Module
         RESET_PARAM,
         STEPS_PARAM,
         PATTERN_PARAM,
-        ENUMS(PITCH_PARAM, MAX_STEPS),
-        ENUMS(GATE_ON_PARAM, MAX_STEPS),
-        ENUMS(SKIP_PARAM, MAX_STEPS),
+        ENUMS(PITCH_PARAM, W * H),
+        ENUMS(GATE_ON_PARAM, W * H),
+        ENUMS(SKIP_PARAM, W * H),
         NUM_PARAMS
     };
 
@@ -25,6 +166,14 @@ struct KSnoopySEQ : Module
         RESET_INPUT,
         STEPS_INPUT,
         PATTERN_INPUT,
+        GATE_OP_INPUT,
+        SKIP_OP_INPUT,
+        MASK_AMOUNT_INPUT,
+        BANK_INPUT,
+        RANDOMIZE_INPUT,
+        FILL_INPUT,
+        QUANTIZER_INPUT,
+        TRANSPOSE_INPUT,
         NUM_INPUTS
     };
 
@@ -46,48 +195,122 @@ struct KSnoopySEQ : Module
         GATE_X_LIGHT,
         GATE_Y_LIGHT,
         GATE_X_OR_Y_LIGHT,
-        ENUMS(IS_PITCH_ON_LIGHTS, MAX_STEPS),
-        ENUMS(SKIP_LIGHTS, MAX_STEPS),
-        ENUMS(GATE_PULSE_LIGHTS, MAX_STEPS),
+        ENUMS(IS_PITCH_ON_LIGHTS, SEQ_PAGE_STEPS),
+        ENUMS(SKIP_LIGHTS, SEQ_PAGE_STEPS),
+        ENUMS(GATE_PULSE_LIGHTS, SEQ_PAGE_STEPS),
         NUM_LIGHTS
     };
 
-    enum GateMode
-    {
-        TRIGGER,
-        RETRIGGER,
-        CONTINUOUS,
-    };
-
-    std::vector<std::vector<int>> m_patterns = 
+    SeqEngine<W, H> m_engine;
+    SeqLanes<W, H> m_lanes;
+    SeqGateGenerator<W, H> m_gates;
+    Controls m_controls;
+    SeqTrace m_trace;
+    SeqProfiler m_profiler;
+    int m_outputChannels = 1;
+    alignas(16) float m_lanePitch[SEQ_MAX_LANES] = {};
+    int m_lanePitchStep[SEQ_MAX_LANES]; // step m_lanePitch was read for, -1 to re-read
+
+    // User pattern sources, compiled on the UI thread into the engine's
+    // pattern set.  m_patternNames mirrors that set for the menus.
+    std::string m_userPatterns[SEQ_MAX_USER_PATTERNS];
+    std::string m_userPatternErrors[SEQ_MAX_USER_PATTERNS];
+    int m_userPatternNumbers[SEQ_MAX_USER_PATTERNS] = {};
+    std::vector<std::string> m_patternNames;
+    dsp::SchmittTrigger m_gateTriggers[SEQ_PAGE_STEPS];
+    dsp::SchmittTrigger m_skipTriggers[SEQ_PAGE_STEPS];
+    dsp::ClockDivider m_uiDivider;
+
+    // Lights run on their own, slower divider.  Per sample, process() only
+    // notes which lights to flash and the bank applies them per update.
+    dsp::ClockDivider m_lightDivider;
+    SeqLightBank<NUM_LIGHTS> m_lightBank;
+    uint32_t m_gateFlashes = 0; // X, Y, X or Y
+    uint32_t m_stepFlashes = 0; // panel cells
+    float m_currentPitch = 0.f;
+    GateMode m_gateMode = SeqGateMode::CLOCK;
+    SeqSpscQueue<Command, SEQ_COMMAND_QUEUE_SIZE> m_commands;
+    std::deque<Command> m_pendingCommands; // UI thread, waiting for room in m_commands
+
+    // The last patch dataFromJson loaded, serialized again by dataToJson
+    // until the engine has applied LOAD_PATCH number m_loadSerial
+    json_t *m_loadedJ = nullptr;
+    uint32_t m_loadSerial = 0;
+    std::atomic<uint32_t> m_loadsApplied{0};
+
+    // Page of the grid the panel's buttons and lights are showing.  Only
+    // those are scanned, so the UI cost doesn't grow with the grid.
+    int m_page = 0;
+    bool m_followPage = false;
+
+    // What a trigger at GATE_OP_INPUT / SKIP_OP_INPUT does to its mask
+    SeqMaskOp::Type m_triggerMaskOps[SeqMaskOp::NUM_TARGETS] = {SeqMaskOp::ROTATE_RIGHT, SeqMaskOp::ROTATE_RIGHT};
+    dsp::SchmittTrigger m_maskOpTriggers[SeqMaskOp::NUM_TARGETS];
+
+    // RANDOMIZE_INPUT re-rolls pitches.  With the engine's m_reseedOnReset
+    // every reset restarts its random draws from their seed, so a
+    // performance replays the same way from a saved patch.
+    dsp::SchmittTrigger m_randomizeTrigger;
+
+    // Fill is on from the menu, or while FILL_INPUT is high
+    bool m_fillLatched = false;
+
+    // PITCH_OUTPUT quantizer.  QUANTIZER_INPUT either moves the root from
+    // the menu's (1V/oct) or picks the scale over 0-10V.
+    enum QuantizerCv
     {
-        {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},                                                // forward
-        {15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0},                                                // backward
-        {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1}, // ping pong
-        {0, 1, 2, 3, 7, 6, 5, 4, 8, 9, 10, 11, 15, 14, 13, 12},                                                // snake
-        {3, 2, 1, 0, 4, 5, 6, 7, 11, 10, 9, 8, 12, 13, 14, 15},                                                // opposite snake
-        {15, 14, 13, 12, 8, 9, 10, 11, 7, 6, 5, 4, 0, 1, 2, 3},                                                // backward snake
-        {3, 2, 1, 0, 4, 5, 6, 7, 11, 10, 9, 8, 12, 13, 14, 15, 14, 13, 12, 8, 9, 10, 11, 7, 6, 5, 4, 0, 1, 2}, // ping pong snake
-        {0, 1, 2, 3, 7, 11, 15, 14, 13, 12, 8, 4, 5, 6, 10, 9}                                                 // circle
+        QUANTIZER_CV_ROOT,
+        QUANTIZER_CV_SCALE,
+        NUM_QUANTIZER_CVS
     };
-
-    bool m_running = true;
-    dsp::SchmittTrigger m_clockTrigger;
-    dsp::SchmittTrigger m_runningTrigger;
-    dsp::SchmittTrigger m_resetTrigger;
-    dsp::SchmittTrigger m_gateTriggers[MAX_STEPS];
-    dsp::SchmittTrigger m_skipTriggers[MAX_STEPS];
-    dsp::PulseGenerator m_gatePulse;
-
-    float m_phase = 0.f;
-    int m_currentPattern = 0;
-    int m_currentPatternIndex = 0;
-    int m_currentStepIndex = 0;
-    int m_lastStepIndex = 0;
-    int index = 0;
-    bool m_isPitchOn[MAX_STEPS] = {};
-    bool m_isSkip[MAX_STEPS] = {};
-    GateMode m_gateMode = TRIGGER;
+    SeqQuantizer<W, H> m_quantizer;
+    SeqScale::Scale m_scale = SeqScale::OFF;
+    int m_root = 0;
+    QuantizerCv m_quantizerCv = QUANTIZER_CV_ROOT;
+
+    // Steps in m_glideSteps slide into their pitch, per lane.  After the
+    // glide TRANSPOSE_INPUT (1V/oct, a channel per lane) is added on top.
+    SeqGlide m_glide;
+    Mask m_glideSteps;
+    SeqGlide::Shape m_glideShape = SeqGlide::EXPONENTIAL;
+    float m_glideTime = SEQ_GLIDE_DEFAULT_TIME;
+
+    // Clock multiply (> 0) or divide (< 0) and swing, for the internal and
+    // external clock alike
+    int m_clockRatio = 1;
+    float m_swing = 0.5f;
+
+    // Expander buffers for chaining with the sequencers on either side into
+    // one long sequence, see SeqChain.  Rack swaps each pair between samples.
+    SeqChainMessage m_chainMessages[2];
+    SeqChainReply m_chainReplies[2];
+
+    // In clock gate mode, mono gates ramp over the sample their clock edge
+    // falls in instead of snapping to the next whole sample
+    bool m_bandLimitedEdges = false;
+
+    // Pattern bank.  The engine thread owns m_bank and switches to
+    // m_bankSlotWanted (from BANK_INPUT or the menu) at the next step.  A
+    // bank it replaces goes back through m_retiredBanks to be unmapped on
+    // the UI thread, which only ever looks at m_uiBank, the newest it sent.
+    Bank *m_bank = nullptr;
+    int m_bankSlot = -1;
+    int m_bankSlotWanted = -1;
+    Bank *m_uiBank = nullptr;
+    std::string m_bankPath;
+    SeqSpscQueue<Bank *, SEQ_COMMAND_QUEUE_SIZE> m_retiredBanks;
+
+    // A store waiting to replace the bank file.  Windows can't replace a
+    // file while it is mapped, so the new bank stays in its temporary file
+    // until the engine hands m_storeReleased back to be unmapped.
+    bool m_storePending = false;
+    std::string m_storePath;
+    int m_storeSlot = -1;
+    std::vector<BankSlot> m_storeSlots;
+    Bank *m_storeReleased = nullptr;
+
+    // Clock ticks the menu's export renders, see SeqRender
+    int m_exportSteps = SEQ_EXPORT_STEPS;
 
     KSnoopySEQ() 
     {
@@ -97,476 +320,3227 @@ struct KSnoopySEQ : Module
         configParam(RESET_PARAM, 0.f, 1.f, 0.f);
         configParam(STEPS_PARAM, 1.f, 10.f, 10.f);
         configParam(PATTERN_PARAM, 0.f, 10.0f, 0.f);
-        for (int i = 0; i < MAX_STEPS; i++) 
+        for (int i = 0; i < Grid::kSteps; i++) 
         {
             configParam(PITCH_PARAM + i, 0.f, 10.f, 0.f);
             configParam(GATE_ON_PARAM + i, 0.f, 1.f, 0.f);
             configParam(SKIP_PARAM + i, 0.f, 1.f, 0.f);
         }
+        m_uiDivider.setDivision(SEQ_UI_BLOCK_SIZE);
+        m_lightDivider.setDivision(SEQ_LIGHT_DIVISION);
+        m_profiler.SetRate(SeqProfiler::CLOCK_AND_RESET, SEQ_PROFILE_EVENT_RATE);
+        m_profiler.SetRate(SeqProfiler::ADVANCE_STEP, SEQ_PROFILE_EVENT_RATE);
+        m_profiler.SetRate(SeqProfiler::XY_TRIGGERS, SEQ_PROFILE_EVENT_RATE);
+        m_profiler.SetRate(SeqProfiler::CONTROLS, SEQ_UI_BLOCK_SIZE);
+        m_profiler.SetRate(SeqProfiler::LIGHTS, SEQ_LIGHT_DIVISION);
+        m_engine.m_profiler = &m_profiler;
+        leftExpander.producerMessage = &m_chainMessages[0];
+        leftExpander.consumerMessage = &m_chainMessages[1];
+        rightExpander.producerMessage = &m_chainReplies[0];
+        rightExpander.consumerMessage = &m_chainReplies[1];
+        std::fill(m_lanePitchStep, m_lanePitchStep + SEQ_MAX_LANES, -1);
+        ScanControls();
+        CompileUserPatterns();
 
         onReset();
     }
 
-    void onReset() override 
+    // The engine has stopped calling process() by now
+    ~KSnoopySEQ()
     {
-        for (int i = 0; i < MAX_STEPS; i++)
+        bool store = m_storePending;
+        m_storePending = false;
+        ApplyCommands();
+        for (const Command &command : m_pendingCommands)
+        {
+            ApplyCommand(command);
+            CollectRetiredBanks();
+        }
+        CollectRetiredBanks();
+        delete m_bank;
+        if (store && !Bank::Replace(m_storePath))
+        {
+            WARN("KSnoopySEQ could not write pattern bank %s", m_storePath.c_str());
+        }
+        if (m_loadedJ)
         {
-            m_isPitchOn[i] = 1.0f;
-            m_isSkip[i] = false;
+            json_decref(m_loadedJ);
         }
     }
 
-    void RandomizeHelper(bool randomPitch, bool randomGate, bool randomSkip)
+    // Rack holds the engine lock around onReset, so this can write directly
+    void onReset() override 
+    {
+        m_engine.Reset();
+        m_lanes.Sync(m_engine);
+        m_gates.SetLength(-1, SEQ_GATE_LENGTHS / 2);
+        m_gates.SetRatchets(-1, 1);
+        m_lanes.SetGates(m_gates);
+    }
+
+    // Grid step shown by panel cell `cell` on `page`
+    static int PageStep(int page, int cell)
     {
-        if (randomPitch)
+        int x = (page % kPagesX) * SEQ_PAGE_SIZE + cell % SEQ_PAGE_SIZE;
+        int y = (page / kPagesX) * SEQ_PAGE_SIZE + cell / SEQ_PAGE_SIZE;
+        return y * W + x;
+    }
+
+    static int PageOf(int step)
+    {
+        return (Grid::Y(step) / SEQ_PAGE_SIZE) * kPagesX + Grid::X(step) / SEQ_PAGE_SIZE;
+    }
+
+    // Panel cell showing `step`, or -1 when it isn't on the current page
+    int PageCell(int step) const
+    {
+        if (step >= Grid::kSteps || PageOf(step) != m_page)
         {
-            float dx = rescale(random::uniform(), 0.0, 1.0, 1.0f, 3.0f);
-            for (int i = 0; i < MAX_STEPS; i++)
-            {
-                params[PITCH_PARAM + i].setValue(rescale(random::uniform(), 0.0, 1.0, 0.0f, 2.0f) + dx);
-            }
+            return -1;
         }
+        return (Grid::Y(step) % SEQ_PAGE_SIZE) * SEQ_PAGE_SIZE + Grid::X(step) % SEQ_PAGE_SIZE;
+    }
+
+    void CompileUserPatterns()
+    {
+        SeqPatternCompiler<W, H>::BuildSet(m_userPatterns, SEQ_MAX_USER_PATTERNS, m_engine.EditPatterns(), m_userPatternErrors, m_userPatternNumbers);
+        m_engine.PublishPatterns();
 
-        if (randomGate)
+        m_patternNames.clear();
+        for (int i = 1; i <= SEQ_NUM_PATTERNS; i++)
         {
-            for (int i = 0; i < MAX_STEPS; i++)
-            {
-                m_isPitchOn[i] = (random::uniform() > 0.5);
-            }
+            m_patternNames.push_back(SeqPatternName(i));
         }
-
-        if (randomSkip)
+        for (int i = 0; i < SEQ_MAX_USER_PATTERNS; i++)
         {
-            for (int i = 0; i < MAX_STEPS; i++)
+            if (m_userPatternNumbers[i])
             {
-                m_isSkip[i] = (random::uniform() > 0.5);
+                m_patternNames.push_back(string::f("User %d", i + 1));
             }
         }
     }
 
-    void onRandomize() override 
+    void SetUserPattern(int slot, const std::string &source)
     {
-        RandomizeHelper(true, false, false);
+        m_userPatterns[slot] = source;
+        CompileUserPatterns();
     }
 
-    json_t *dataToJson() override 
+    // UI thread.  A command the queue has no room for waits its turn in
+    // m_pendingCommands; it is never applied here, where it would race
+    // process() and jump ahead of the commands already queued.
+    void PushCommand(const Command &command)
     {
-        json_t *rootJ = json_object();
-
-        // running
-        json_object_set_new(rootJ, "running", json_boolean(m_running));
-
-        // gates
-        json_t *gatesJ = json_array();
-        for (int i = 0; i < MAX_STEPS; i++)
+        FlushCommands();
+        if (!m_pendingCommands.empty() || !m_commands.Push(command))
         {
-            json_t *gateJ = json_integer((int)m_isPitchOn[i]);
-            json_array_append_new(gatesJ, gateJ);
+            m_pendingCommands.push_back(command);
         }
-        json_object_set_new(rootJ, "gates", gatesJ);
+    }
 
-        // skip
-        json_t *gatesS = json_array();
-        for (int i = 0; i < MAX_STEPS; i++)
+    // UI thread, from PushCommand() and every frame from the widget
+    void FlushCommands()
+    {
+        CollectRetiredBanks();
+        while (!m_pendingCommands.empty() && m_commands.Push(m_pendingCommands.front()))
         {
-            json_t *gateS = json_integer((int)m_isSkip[i]);
-            json_array_append_new(gatesS, gateS);
+            m_pendingCommands.pop_front();
         }
-        json_object_set_new(rootJ, "skips", gatesS);
-
-        // gateMode
-        json_t *gateModeJ = json_integer((int)m_gateMode);
-        json_object_set_new(rootJ, "gateMode", gateModeJ);
-
-        return rootJ;
     }
 
-    void dataFromJson(json_t *rootJ) override 
+    // Engine thread
+    void ApplyGrid(const Command &command)
     {
-        // running
-        json_t *runningJ = json_object_get(rootJ, "running");
-        if (runningJ)
+        if (command.setPitchOn)
         {
-            m_running = json_is_true(runningJ);
+            m_engine.SetPitchOnMask(command.pitchOnMask);
         }
-
-        // gates
-        json_t *gatesJ = json_object_get(rootJ, "gates");
-        if (gatesJ)
+        if (command.setSkip)
         {
-            for (int i = 0; i < MAX_STEPS; i++)
-            {
-                json_t *gateJ = json_array_get(gatesJ, i);
-                if (gateJ)
-                {
-                    m_isPitchOn[i] = !!json_integer_value(gateJ);
-                }
-            }
+            m_engine.SetSkipMask(command.skipMask);
         }
-
-        // skips
-        json_t *gatesS = json_object_get(rootJ, "skips");
-        if (gatesS)
+        if (command.setStepGates)
         {
-            for (int i = 0; i < MAX_STEPS; i++)
+            for (int i = 0; i < Grid::kSteps; i++)
             {
-                json_t *gateS = json_array_get(gatesS, i);
-                if (gateS)
-                {
-                    m_isSkip[i] = !!json_integer_value(gateS);
-                }
+                m_gates.SetLength(i, command.gateLengths[i]);
+                m_gates.SetRatchets(i, command.ratchets[i]);
             }
+            m_lanes.SetGates(m_gates);
+            m_engine.m_conditions.SetAll(command.conditions);
+            m_glideSteps = command.glideMask;
+            m_engine.BreakRun();
         }
+    }
 
-        // gateMode
-        json_t *gateModeJ = json_object_get(rootJ, "gateMode");
-        if (gateModeJ)
+    // Engine thread
+    void ApplyCommand(const Command &command)
+    {
+        SEQ_TRACE_EVENT(m_trace, SeqTraceEvent::COMMAND, command.type, command.value);
+        switch (command.type)
         {
-            m_gateMode = (GateMode)json_integer_value(gateModeJ);
+            case Command::SET_GRID:
+                ApplyGrid(command);
+                break;
+            case Command::SET_RUNNING:
+                m_engine.m_running = command.value;
+                m_engine.BreakRun();
+                break;
+            case Command::SET_GATE_MODE:
+                m_gateMode = (GateMode)command.value;
+                m_gates.SetMode(m_gateMode, m_bandLimitedEdges);
+                m_lanes.SetGates(m_gates);
+                break;
+            case Command::SET_NUM_LANES:
+                m_lanes.SetNumLanes(command.value, m_engine);
+                break;
+            case Command::SET_LANE_CONFIG:
+                m_lanes.m_config[command.value] = command.laneConfig;
+                break;
+            case Command::SET_PAGE:
+                m_page = clamp(command.value, 0, kNumPages - 1);
+                m_followPage = false;
+                break;
+            case Command::SET_FOLLOW_PAGE:
+                m_followPage = command.value;
+                break;
+            case Command::APPLY_MASK_OP:
+                m_engine.ApplyMaskOp((SeqMaskOp::Target)command.value, command.maskOp, command.amount);
+                break;
+            case Command::SET_TRIGGER_MASK_OP:
+                m_triggerMaskOps[command.value] = command.maskOp;
+                break;
+            case Command::SET_BAND_LIMITED_EDGES:
+                m_bandLimitedEdges = command.value;
+                m_gates.SetMode(m_gateMode, m_bandLimitedEdges);
+                m_lanes.SetGates(m_gates);
+                break;
+            case Command::SET_GATE_LENGTH:
+                m_gates.SetLength(command.step, command.value);
+                m_lanes.SetGates(m_gates);
+                break;
+            case Command::SET_RATCHETS:
+                m_gates.SetRatchets(command.step, command.value);
+                m_lanes.SetGates(m_gates);
+                break;
+            case Command::SET_LIGHT_DIVISION:
+                m_lightDivider.setDivision(clamp(command.value, SEQ_UI_BLOCK_SIZE, 8 * SEQ_UI_BLOCK_SIZE));
+                m_profiler.SetRate(SeqProfiler::LIGHTS, m_lightDivider.getDivision());
+                break;
+            case Command::RESET_TIMING:
+                m_profiler.Reset();
+                break;
+            case Command::SET_BANK:
+                if (m_bank)
+                {
+                    // can't be full: the UI empties it before it queues a bank
+                    m_retiredBanks.Push(m_bank);
+                }
+                m_bank = command.bank; // null while a store replaces the file
+                m_bankSlot = (m_bank && command.value < m_bank->NumSlots()) ? command.value : -1;
+                m_bankSlotWanted = m_bankSlot;
+                break;
+            case Command::SET_BANK_SLOT:
+                m_bankSlot = -1; // recalled again even if it is the current one
+                m_bankSlotWanted = command.value;
+                break;
+            case Command::RANDOMIZE:
+                RandomizeGrid(command.value, command.amount);
+                break;
+            case Command::SET_RANDOM:
+                m_engine.m_random = command.random;
+                break;
+            case Command::SET_RESEED_ON_RESET:
+                m_engine.m_reseedOnReset = command.value;
+                break;
+            case Command::SET_CONDITION:
+                m_engine.m_conditions.Set(command.step, command.condition, command.value);
+                m_engine.BreakRun();
+                break;
+            case Command::SET_PHRASE:
+                m_engine.m_conditions.SetPhrase(command.value);
+                m_engine.BreakRun();
+                break;
+            case Command::SET_FILL:
+                m_fillLatched = command.value;
+                break;
+            case Command::SET_LOOP:
+                m_engine.m_conditions.m_loop = std::max(0, command.value);
+                m_engine.m_conditions.m_loopSeed = command.loopSeed;
+                m_engine.m_conditions.Evaluate();
+                m_engine.BreakRun();
+                break;
+            case Command::SET_SCALE:
+                m_scale = (SeqScale::Scale)command.value;
+                break;
+            case Command::SET_ROOT:
+                m_root = command.value;
+                break;
+            case Command::SET_QUANTIZER_CV:
+                m_quantizerCv = (QuantizerCv)command.value;
+                break;
+            case Command::SET_GLIDE_STEP:
+                if (command.step < 0)
+                {
+                    command.value ? m_glideSteps.SetAll() : m_glideSteps.Clear();
+                }
+                else
+                {
+                    m_glideSteps.Set(command.step, command.value);
+                }
+                break;
+            case Command::SET_GLIDE_TIME:
+                m_glideTime = command.amount;
+                break;
+            case Command::SET_GLIDE_SHAPE:
+                m_glideShape = (SeqGlide::Shape)command.value;
+                break;
+            case Command::SET_CLOCK_RATIO:
+                m_clockRatio = command.value;
+                m_engine.SetClock(m_clockRatio, m_swing);
+                break;
+            case Command::SET_SWING:
+                m_swing = command.amount;
+                m_engine.SetClock(m_clockRatio, m_swing);
+                break;
+            case Command::LOAD_PATCH:
+                ApplyGrid(command);
+                ApplyPatch(command.patch);
+                m_loadsApplied.store(command.value, std::memory_order_release);
+                break;
         }
     }
 
-    bool ProcessClockAndReset(const ProcessArgs &args, bool& gateIn)
+    // Engine thread: the rest of a preset load, all in the same UI block
+    void ApplyPatch(const typename Command::Patch &patch)
     {
-        bool nextStep = false;
-        if (inputs[EXT_CLOCK_INPUT].isConnected()) 
+        if (patch.setRunning)
         {
-            // External clock
-            if (m_clockTrigger.process(inputs[EXT_CLOCK_INPUT].getVoltage())) 
-            {
-                m_phase = 0.0;
-                nextStep = true;
-            }
-            gateIn = m_clockTrigger.isHigh();
+            m_engine.m_running = patch.running;
         }
-        else 
+        m_gateMode = (GateMode)patch.gateMode;
+        m_bandLimitedEdges = patch.bandLimitedEdges;
+        m_gates.SetMode(m_gateMode, m_bandLimitedEdges);
+        m_lanes.SetGates(m_gates);
+        std::copy(patch.lanes, patch.lanes + SEQ_MAX_LANES, m_lanes.m_config);
+        m_lanes.SetNumLanes(patch.numLanes, m_engine);
+        m_page = clamp(patch.page, 0, kNumPages - 1);
+        m_followPage = patch.followPage;
+        for (int i = 0; i < SeqMaskOp::NUM_TARGETS; i++)
         {
-            // Internal clock
-            float clockTime = std::pow(2.f, params[CLOCK_PARAM].getValue() + inputs[CLOCK_INPUT].getVoltage());
-            m_phase += clockTime * args.sampleTime;
-            if (m_phase >= 1.f) 
+            if (patch.triggerMaskOps[i] >= 0)
             {
-                m_phase = 0.0;
-                nextStep = true;
+                m_triggerMaskOps[i] = (SeqMaskOp::Type)patch.triggerMaskOps[i];
             }
-            gateIn = (m_phase < 0.5f);
         }
+        m_lightDivider.setDivision(clamp(patch.lightDivision, SEQ_UI_BLOCK_SIZE, 8 * SEQ_UI_BLOCK_SIZE));
+        m_profiler.SetRate(SeqProfiler::LIGHTS, m_lightDivider.getDivision());
+        if (patch.setRandom)
+        {
+            m_engine.m_random = patch.random;
+        }
+        m_engine.m_reseedOnReset = patch.reseedOnReset;
+        m_engine.m_conditions.SetPhrase(patch.phrase);
+        m_fillLatched = patch.fill;
+        if (patch.setLoop)
+        {
+            m_engine.m_conditions.m_loop = std::max(0, patch.loop);
+            m_engine.m_conditions.m_loopSeed = patch.loopSeed;
+            m_engine.m_conditions.Evaluate();
+        }
+        m_scale = (SeqScale::Scale)patch.scale;
+        m_root = patch.root;
+        m_quantizerCv = (QuantizerCv)patch.quantizerCv;
+        m_glideTime = patch.glideTime;
+        m_glideShape = (SeqGlide::Shape)patch.glideShape;
+        m_clockRatio = patch.clockRatio;
+        m_swing = patch.swing;
+        m_engine.SetClock(m_clockRatio, m_swing);
+        m_engine.BreakRun();
+    }
 
-        if (m_resetTrigger.process(params[RESET_PARAM].getValue() + inputs[RESET_INPUT].getVoltage())) 
+    void ApplyCommands()
+    {
+        Command command;
+        while (m_commands.Pop(command))
         {
-            m_phase = 0.0;
-            m_currentStepIndex = MAX_STEPS;
-            nextStep = true;
+            ApplyCommand(command);
         }
+    }
 
-        return nextStep;
+    void SetNumLanes(int numLanes)
+    {
+        Command command;
+        command.type = Command::SET_NUM_LANES;
+        command.value = numLanes;
+        PushCommand(command);
     }
 
-    void AdvanceStep()
+    void SetLaneConfig(int lane, const SeqLaneConfig &config)
     {
-        // TODO
+        Command command;
+        command.type = Command::SET_LANE_CONFIG;
+        command.value = lane;
+        command.laneConfig = config;
+        PushCommand(command);
+    }
 
-        float patternScale = clamp(params[PATTERN_PARAM].getValue() + inputs[PATTERN_INPUT].getVoltage(), 0.0f, 10.0f);
-        patternScale /= 10.0f;
-        m_currentPattern = clamp((int)roundf(patternScale * m_patterns.size()), 1, m_patterns.size());
-        //printf("m_currentPattern %d\n", m_currentPattern);
+    void SetGateMode(GateMode gateMode)
+    {
+        Command command;
+        command.type = Command::SET_GATE_MODE;
+        command.value = gateMode;
+        PushCommand(command);
+    }
 
-        m_lastStepIndex = m_currentStepIndex;
-        float stepsScale = clamp(params[STEPS_PARAM].getValue() + inputs[STEPS_INPUT].getVoltage(), 0.0f, 10.0f);
-        stepsScale /= 10.0f;
-        //write_log(10, "stepsScale=%f params[STEPS_PARAM].getValue(): %f inputs[STEPS_INPUT].getVoltage(): %f\n", stepsScale, params[STEPS_PARAM].getValue(), inputs[STEPS_INPUT].getVoltage());
+    void SetLightDivision(int division)
+    {
+        Command command;
+        command.type = Command::SET_LIGHT_DIVISION;
+        command.value = division;
+        PushCommand(command);
+    }
 
-        int maxStepsInPattern = m_patterns[m_currentPattern - 1].size();
-        //printf("maxStepsInPattern %d\n", maxStepsInPattern);
-        int numSteps = clamp((int)roundf(stepsScale * maxStepsInPattern), 1, maxStepsInPattern);
-        //printf("numSteps %d\n", numSteps);
+    // UI thread: unmaps the banks the engine has let go of
+    void CollectRetiredBanks()
+    {
+        Bank *bank;
+        while (m_retiredBanks.Pop(bank))
+        {
+            m_storeReleased = (bank == m_storeReleased) ? nullptr : m_storeReleased;
+            delete bank;
+        }
 
-        for (int skipAttempts = 0; skipAttempts < MAX_STEPS; skipAttempts++)
+        // Nothing maps the file any more, so the store can finish
+        if (m_storePending && !m_storeReleased)
         {
-            m_currentPatternIndex += 1;
-            if (m_currentPatternIndex >= numSteps)
-            {
-                m_currentPatternIndex = 0;
-            }
-            m_currentPatternIndex %= maxStepsInPattern;
-            m_currentStepIndex = m_patterns[m_currentPattern - 1][m_currentPatternIndex];
-            //write_log(1, "stepsScale=%f m_currentStepIndex=%d m_currentPatternIndex=%d maxStepsInPattern=%d numSteps=%d\n", stepsScale, m_currentStepIndex, m_currentPatternIndex, maxStepsInPattern, numSteps);
-            if (!m_isSkip[m_currentStepIndex])
-            {
-                break;
-            }
-            else
+            m_storePending = false;
+            if (!Bank::Replace(m_storePath))
             {
-                numSteps++; // ignore wrt # of steps
+                WARN("KSnoopySEQ could not write pattern bank %s", m_storePath.c_str());
+                return;
             }
+            LoadBank(m_storePath, m_storeSlot);
         }
-
-        // write_log(0, "maxStepsInPattern=%d numSteps=%d m_currentPatternIndex=%d m_currentStepIndex=%d\n",
-        //           maxStepsInPattern,
-        //           numSteps,
-        //           m_currentPatternIndex,
-        //           m_currentStepIndex);
-
-        // TODO
-        lights[GATE_PULSE_LIGHTS + m_currentStepIndex].value = 1.0;
-        m_gatePulse.trigger(1e-3);
     }
 
-    void ProcessXYTriggers(bool gateIn)
+    // Next to the patch, or in the user folder until the patch is saved
+    std::string DefaultBankPath() const
     {
-        //bool pulse = m_gatePulse.process(1.0 / APP->engine->getSampleRate());
+        std::string name = string::f("KSnoopy-bank-%lld" SEQ_BANK_EXTENSION, (long long)id);
+        std::string patchPath = APP->patch->path;
+        if (patchPath.empty())
+        {
+            return asset::user(name);
+        }
+        return string::directory(patchPath) + "/" + string::filenameBase(string::filename(patchPath)) + "-" + name;
+    }
 
-        // Rows
-        int lastX = m_lastStepIndex % 4;
-        int curX = m_currentStepIndex % 4;
-        int lastY = m_lastStepIndex / 4;
-        int curY = m_currentStepIndex / 4;
+    // `slot` is the slot the grid already holds, if any, so it isn't recalled
+    bool LoadBank(const std::string &path, int slot)
+    {
+        CollectRetiredBanks();
+        if (m_storePending)
+        {
+            // The bank loaded last wins over a store still waiting
+            WARN("KSnoopySEQ dropped a store to %s for pattern bank %s", m_storePath.c_str(), path.c_str());
+            std::remove(Bank::TempPath(m_storePath).c_str());
+            m_storePending = false;
+        }
+        Bank *bank = new Bank();
+        if (!bank->Load(path))
+        {
+            WARN("KSnoopySEQ could not load pattern bank %s", path.c_str());
+            delete bank;
+            return false;
+        }
+        m_bankPath = path;
+        m_uiBank = bank;
+
+        Command command;
+        command.type = Command::SET_BANK;
+        command.bank = bank;
+        command.value = slot;
+        PushCommand(command);
+        return true;
+    }
 
-        // X row
-        bool gateXChanged = (m_running && m_isPitchOn[m_currentStepIndex] > 0.0f && lastX != curX);
-        gateXChanged = gateXChanged && gateIn;
-        // if (m_gateMode == TRIGGER)
-        // {
-        //     gateXChanged = gateXChanged && pulse;
-        // }
-        // else if (m_gateMode == RETRIGGER)
-        // {
-        //     gateXChanged = gateXChanged && !pulse;
-        // }
+    // The grid as it is now, read like dataToJson does
+    BankSlot CaptureBankSlot()
+    {
+        BankSlot slot;
+        for (int i = 0; i < Grid::kSteps; i++)
+        {
+            slot.pitches[i] = params[PITCH_PARAM + i].getValue();
+        }
+        BankSlot::FromMask(m_engine.m_pitchOn, slot.pitchOn);
+        BankSlot::FromMask(m_engine.m_skip, slot.skip);
+        slot.pattern = params[PATTERN_PARAM].getValue();
+        slot.steps = params[STEPS_PARAM].getValue();
+        return slot;
+    }
 
-        outputs[GATE_X_OUTPUT].setVoltage(gateXChanged ? 10.0 : 0.0);
-        if (gateXChanged)
+    // The sequence from the top, rendered offline and written to `path` as
+    // a MIDI file or CSV.  The settings are read like dataToJson does.
+    void Export(const std::string &path, bool midi)
+    {
+        SeqRenderer<W, H> renderer;
+        for (int i = 0; i < Grid::kSteps; i++)
+        {
+            renderer.m_pitches[i] = params[PITCH_PARAM + i].getValue();
+        }
+        renderer.m_state.pitchOn = m_engine.m_pitchOn;
+        renderer.m_state.skip = m_engine.m_skip;
+        std::copy(m_gates.m_lengths, m_gates.m_lengths + Grid::kSteps, renderer.m_state.gateLengths);
+        std::copy(m_gates.m_ratchets, m_gates.m_ratchets + Grid::kSteps, renderer.m_state.ratchets);
+        std::copy(m_engine.m_conditions.m_steps, m_engine.m_conditions.m_steps + Grid::kSteps, renderer.m_state.conditions);
+        renderer.m_state.glide = m_glideSteps;
+        std::copy(m_userPatterns, m_userPatterns + SEQ_MAX_USER_PATTERNS, renderer.m_userPatterns);
+        renderer.m_inputs.clock = params[CLOCK_PARAM].getValue();
+        renderer.m_inputs.pattern = params[PATTERN_PARAM].getValue();
+        renderer.m_inputs.steps = params[STEPS_PARAM].getValue();
+        renderer.m_gateMode = m_gateMode;
+        renderer.m_scale = m_scale;
+        renderer.m_root = m_root;
+        renderer.m_clockRatio = m_clockRatio;
+        renderer.m_swing = m_swing;
+        renderer.m_phrase = m_engine.m_conditions.m_phrase;
+        renderer.m_fill = m_fillLatched;
+        renderer.m_seed = m_engine.m_random.m_seed;
+
+        SeqTimeline timeline;
+        renderer.Render(m_exportSteps, APP->engine->getSampleRate(), timeline);
+        if (!(midi ? timeline.WriteMidi(path) : timeline.WriteCsv(path)))
         {
-            lights[GATE_X_LIGHT].value = 1.0;
+            WARN("KSnoopySEQ could not export to %s", path.c_str());
         }
-        //write_log(0, "gateXChanged=%d m_running=%d m_isPitchOn[m_currentStepIndex]=%d lastX=%d curX=%d lastY=%d curY=%d\n", gateXChanged, m_running, m_isPitchOn[m_currentStepIndex], lastX, curX, lastY, curY);
+    }
 
-        // Y row
-        bool gateYChanged = (m_running && m_isPitchOn[m_currentStepIndex] > 0.0f && lastY != curY);
-        gateYChanged = gateYChanged && gateIn;
-        // if (m_gateMode == TRIGGER)
-        // {
-        //     gateYChanged = gateYChanged && pulse;
-        // }
-        // else if (m_gateMode == RETRIGGER)
-        // {
-        //     gateYChanged = gateYChanged && !pulse;
-        // }
-        
-        outputs[GATE_Y_OUTPUT].setVoltage(gateYChanged ? 10.0 : 0.0);
-        if (gateYChanged)
+    // Stores the grid in slot `slot` of the bank, or in a new slot at the
+    // end.  The file is rewritten once the engine has let go of the bank
+    // mapped from it (see CollectRetiredBanks), then mapped again, and the
+    // engine picks the new mapping up from the command queue.
+    void StoreBankSlot(int slot)
+    {
+        // A store made while another waits builds on it
+        std::vector<BankSlot> slots = m_storeSlots;
+        if (!m_storePending)
+        {
+            slots.clear();
+            if (m_uiBank)
+            {
+                slots.assign(m_uiBank->m_slots, m_uiBank->m_slots + m_uiBank->NumSlots());
+            }
+        }
+        if (slot < 0 || slot >= (int)slots.size())
         {
-            lights[GATE_Y_LIGHT].value = 1.0;
+            slot = slots.size();
+            slots.push_back(BankSlot());
         }
+        slots[slot] = CaptureBankSlot();
 
-        outputs[GATE_XORY_OUTPUT].setVoltage((gateXChanged || gateYChanged) ? 10.0 : 0.0);
-        if (gateXChanged || gateYChanged)
+        std::string path = m_storePending ? m_storePath : m_bankPath.empty() ? DefaultBankPath() : m_bankPath;
+        if (!Bank::WriteTemp(path, slots))
+        {
+            WARN("KSnoopySEQ could not write pattern bank %s", path.c_str());
+            return;
+        }
+        m_bankPath = path;
+        m_storePath = path;
+        m_storeSlot = slot;
+        m_storeSlots.swap(slots);
+        if (!m_storePending && m_uiBank)
         {
-            lights[GATE_X_OR_Y_LIGHT].value = 1.0;
+            m_storeReleased = m_uiBank;
+            m_uiBank = nullptr;
+
+            Command command;
+            command.type = Command::SET_BANK;
+            command.bank = nullptr;
+            command.value = -1;
+            PushCommand(command);
         }
+        m_storePending = true;
+        CollectRetiredBanks(); // finishes now if nothing was mapped
+    }
+
+    void RecallBankSlot(int slot)
+    {
+        Command command;
+        command.type = Command::SET_BANK_SLOT;
+        command.value = slot;
+        PushCommand(command);
     }
 
-    void UpdateLights(const ProcessArgs &args)
+    // Engine thread, at a step boundary: copies a slot out of the mapping
+    // into the knobs and masks, then re-evaluates the new step's gates
+    void ApplyBankSlot(int index, SeqFrame &frame)
     {
-        lights[RUNNING_LIGHT].value = (m_running);
-        lights[GATE_X_LIGHT].setSmoothBrightness(0, args.sampleTime);
-        lights[GATE_Y_LIGHT].setSmoothBrightness(0, args.sampleTime);
-        lights[GATE_X_OR_Y_LIGHT].setSmoothBrightness(0, args.sampleTime);
-        lights[RESET_LIGHT].setSmoothBrightness(m_resetTrigger.isHigh(), args.sampleTime);
-        lights[GATES_LIGHT].setSmoothBrightness(0, args.sampleTime);
-        for (int i = 0; i < MAX_STEPS; i++)
+        const BankSlot &slot = m_bank->GetSlot(index);
+        for (int i = 0; i < Grid::kSteps; i++)
         {
-            lights[IS_PITCH_ON_LIGHTS + i].setSmoothBrightness(0, args.sampleTime);
-            lights[SKIP_LIGHTS + i].setSmoothBrightness(0, args.sampleTime);
-            lights[GATE_PULSE_LIGHTS + i].setSmoothBrightness(0, args.sampleTime);
+            params[PITCH_PARAM + i].setValue(slot.pitches[i]);
         }
+        m_engine.SetPitchOnMask(BankSlot::ToMask(slot.pitchOn));
+        m_engine.SetSkipMask(BankSlot::ToMask(slot.skip));
+        m_engine.ProcessXYTriggers(frame.gateIn, frame);
+
+        params[PATTERN_PARAM].setValue(slot.pattern);
+        params[STEPS_PARAM].setValue(slot.steps);
+        m_controls.SetKnob(Controls::PATTERN, slot.pattern);
+        m_controls.SetKnob(Controls::STEPS, slot.steps);
+        ForgetPitches();
+        m_bankSlot = index;
     }
 
-    void process(const ProcessArgs &args) override 
+    // Engine thread, after pitch knobs were set: re-read them for every lane
+    void ForgetPitches()
     {
-        log_increase_step_number();
+        m_controls.m_pitchStep = -1;
+        std::fill(m_lanePitchStep, m_lanePitchStep + SEQ_MAX_LANES, -1);
+    }
 
-        // Run
-        if (m_runningTrigger.process(params[RUN_PARAM].getValue())) 
+    // Per sample, after the engine
+    void ProcessBank(SeqFrame &frame)
+    {
+        if (!m_bank || m_bank->NumSlots() == 0)
         {
-            m_running = !m_running;
+            return;
         }
-
-        bool nextStep = false;
-        bool gateIn = false;
-        if (m_running)
+        if (inputs[BANK_INPUT].isConnected())
         {
-            nextStep = ProcessClockAndReset(args, gateIn);
+            m_bankSlotWanted = m_bank->SlotFromCv(inputs[BANK_INPUT].getVoltage());
         }
-        if (nextStep)
+        // Stopped there is no next step, so the switch is immediate
+        if (m_bankSlotWanted >= 0 && m_bankSlotWanted != m_bankSlot && (frame.advanced || !frame.running))
         {
-            AdvanceStep();
+            ApplyBankSlot(m_bankSlotWanted, frame);
         }
-        ProcessXYTriggers(gateIn);
+    }
 
-        // Pitch output
-        float currentPitch = params[PITCH_PARAM + m_currentStepIndex].getValue();
-        outputs[PITCH_OUTPUT].setVoltage(currentPitch);
-        lights[PITCH_LIGHT].value = currentPitch;
-        UpdateLights(args);
+    void ResetTiming()
+    {
+        Command command;
+        command.type = Command::RESET_TIMING;
+        PushCommand(command);
+    }
 
-        // Gate buttons
-        for (int i = 0; i < MAX_STEPS; i++) 
+    // Timing histograms, for comparing one build of the plugin with another
+    json_t *TimingToJson()
+    {
+        json_t *rootJ = json_object();
+        json_object_set_new(rootJ, "intervalSamples", json_integer(SEQ_PROFILE_INTERVAL));
+        json_object_set_new(rootJ, "clockOverheadNs", json_integer(m_profiler.m_clockNs));
+        for (int i = 0; i < SeqProfiler::NUM_STAGES; i++)
         {
-            if (m_gateTriggers[i].process(params[GATE_ON_PARAM + i].getValue())) 
-            {
-                m_isPitchOn[i] = !m_isPitchOn[i];
-            }
-            lights[IS_PITCH_ON_LIGHTS + i].setSmoothBrightness(m_isPitchOn[i] ? 10.0f : 0.0f, args.sampleTime);
-
-            if (m_skipTriggers[i].process(params[SKIP_PARAM + i].getValue()))
+            const SeqProfileHistogram &stage = m_profiler.m_stages[i];
+            json_t *stageJ = json_object();
+            json_object_set_new(stageJ, "count", json_integer(stage.Count()));
+            json_object_set_new(stageJ, "minNs", json_integer(stage.MinNs()));
+            json_object_set_new(stageJ, "meanNs", json_real(stage.MeanNs()));
+            json_object_set_new(stageJ, "p99Ns", json_integer(stage.PercentileNs(0.99)));
+            json_object_set_new(stageJ, "maxNs", json_integer(stage.MaxNs()));
+
+            // [shortest ns of the bucket, count], empty buckets left out
+            json_t *bucketsJ = json_array();
+            for (int b = 0; b < SEQ_PROFILE_BUCKETS; b++)
             {
-                m_isSkip[i] = !m_isSkip[i];
+                uint32_t count = stage.m_buckets[b].load(std::memory_order_relaxed);
+                if (count)
+                {
+                    json_t *bucketJ = json_array();
+                    json_array_append_new(bucketJ, json_integer(SeqProfileHistogram::BucketNs(b)));
+                    json_array_append_new(bucketJ, json_integer(count));
+                    json_array_append_new(bucketsJ, bucketJ);
+                }
             }
-            lights[SKIP_LIGHTS + i].setSmoothBrightness(m_isSkip[i] ? 10.0f : 0.0f, args.sampleTime);
+            json_object_set_new(stageJ, "buckets", bucketsJ);
+            json_object_set_new(rootJ, SeqProfiler::Name((SeqProfiler::Stage)i), stageJ);
         }
+        return rootJ;
     }
-};
-
 
-struct SEQGateModeItem : MenuItem
-{
-    KSnoopySEQ* module;
-    KSnoopySEQ::GateMode gateMode;
-    void onAction(const event::Action &e) override 
+    void SaveTiming()
     {
-        module->m_gateMode = gateMode;
+        std::string path = asset::user(string::f("KSnoopy-timing-%lld.json", (long long)id));
+        json_t *rootJ = TimingToJson();
+        if (json_dump_file(rootJ, path.c_str(), JSON_INDENT(2)) == 0)
+        {
+            INFO("KSnoopySEQ timing saved to %s", path.c_str());
+        }
+        else
+        {
+            WARN("KSnoopySEQ could not save timing to %s", path.c_str());
+        }
+        json_decref(rootJ);
     }
 
-    void step() override
+    // step < 0 sets every step
+    void SetGateLength(int step, int eighths)
     {
-        rightText = (module->m_gateMode == gateMode) ? "✔" : "";
+        Command command;
+        command.type = Command::SET_GATE_LENGTH;
+        command.step = step;
+        command.value = eighths;
+        PushCommand(command);
     }
-};
 
-struct SEQActionItem : MenuItem
-{
-    KSnoopySEQ* module;
-    bool randomPitch = false;
-    bool randomGate = false;
-    bool randomSkip = false;
-    void onAction(const event::Action &e) override 
+    void SetRatchets(int step, int ratchets)
     {
-        module->RandomizeHelper(randomPitch, randomGate, randomSkip);
+        Command command;
+        command.type = Command::SET_RATCHETS;
+        command.step = step;
+        command.value = ratchets;
+        PushCommand(command);
     }
-};
 
-struct KSnoopySEQWidget : ModuleWidget 
-{
-    KSnoopySEQWidget(KSnoopySEQ *module) 
+    void SetPage(int page)
     {
-        setModule(module);
-        setPanel(APP->window->loadSvg(asset::plugin(pluginInstance, "res/Seq.svg")));
+        Command command;
+        command.type = Command::SET_PAGE;
+        command.value = page;
+        PushCommand(command);
+    }
 
-        addChild(createWidget<ScrewSilver>(Vec(15, 0)));
-        addChild(createWidget<ScrewSilver>(Vec(box.size.x-30, 0)));
-        addChild(createWidget<ScrewSilver>(Vec(15, 365)));
-        addChild(createWidget<ScrewSilver>(Vec(box.size.x-30, 365)));
+    void SetFollowPage(bool followPage)
+    {
+        Command command;
+        command.type = Command::SET_FOLLOW_PAGE;
+        command.value = followPage;
+        PushCommand(command);
+    }
 
-        addParam(createParam<RoundBlackKnob>(Vec(18, 56), module, KSnoopySEQ::CLOCK_PARAM));
-        addParam(createParam<LEDButton>(Vec(60, 61-1), module, KSnoopySEQ::RUN_PARAM));
-        addChild(createLight<MediumLight<GreenLight>>(Vec(64.4f, 64.4f), module, KSnoopySEQ::RUNNING_LIGHT));
-        addParam(createParam<LEDButton>(Vec(99, 61-1), module, KSnoopySEQ::RESET_PARAM));
-        addChild(createLight<MediumLight<GreenLight>>(Vec(103.4f, 64.4f), module, KSnoopySEQ::RESET_LIGHT));
-        addParam(createParam<RoundBlackSnapKnob>(Vec(132, 56), module, KSnoopySEQ::STEPS_PARAM));
-        addChild(createLight<MediumLight<GreenLight>>(Vec(179.4f, 64.4f), module, KSnoopySEQ::GATE_X_OR_Y_LIGHT));
-        addChild(createLight<MediumLight<GreenLight>>(Vec(179.4f + 38.0f*1, 64.4f), module, KSnoopySEQ::GATE_X_LIGHT));
-        addChild(createLight<MediumLight<GreenLight>>(Vec(179.4f + 38.0f*2, 64.4f), module, KSnoopySEQ::GATE_Y_LIGHT));
-        addChild(createLight<MediumLight<GreenLight>>(Vec(179.4f + 38.0f*3, 64.4f), module, KSnoopySEQ::PITCH_LIGHT));
+    void SetBandLimitedEdges(bool bandLimitedEdges)
+    {
+        Command command;
+        command.type = Command::SET_BAND_LIMITED_EDGES;
+        command.value = bandLimitedEdges;
+        PushCommand(command);
+    }
 
-        static const float portX[8] = {20, 58, 96, 135, 173, 212, 250, 289};
-        addInput(createInput<PJ301MPort>(Vec(portX[0]-1, 98), module, KSnoopySEQ::CLOCK_INPUT));
-        addInput(createInput<PJ301MPort>(Vec(portX[1]-1, 98), module, KSnoopySEQ::EXT_CLOCK_INPUT));
-        addInput(createInput<PJ301MPort>(Vec(portX[2]-1, 98), module, KSnoopySEQ::RESET_INPUT));
-        addInput(createInput<PJ301MPort>(Vec(portX[3]-1, 98), module, KSnoopySEQ::STEPS_INPUT));
+    void ApplyMaskOp(SeqMaskOp::Target target, SeqMaskOp::Type maskOp, float amount)
+    {
+        Command command;
+        command.type = Command::APPLY_MASK_OP;
+        command.value = target;
+        command.maskOp = maskOp;
+        command.amount = amount;
+        PushCommand(command);
+    }
 
-        addOutput(createOutput<PJ301MPort>(Vec(portX[4]-1, 98), module, KSnoopySEQ::GATE_XORY_OUTPUT));
-        addOutput(createOutput<PJ301MPort>(Vec(portX[5]-1, 98), module, KSnoopySEQ::GATE_X_OUTPUT));
-        addOutput(createOutput<PJ301MPort>(Vec(portX[6]-1, 98), module, KSnoopySEQ::GATE_Y_OUTPUT));
-        addOutput(createOutput<PJ301MPort>(Vec(portX[7]-1, 98), module, KSnoopySEQ::PITCH_OUTPUT));
+    void SetTriggerMaskOp(SeqMaskOp::Target target, SeqMaskOp::Type maskOp)
+    {
+        Command command;
+        command.type = Command::SET_TRIGGER_MASK_OP;
+        command.value = target;
+        command.maskOp = maskOp;
+        PushCommand(command);
+    }
 
-        addParam(createParam<RoundBlackKnob>(Vec(portX[7]-2, 148), module, KSnoopySEQ::PATTERN_PARAM));
-        addInput(createInput<PJ301MPort>(Vec(portX[7], 188), module, KSnoopySEQ::PATTERN_INPUT));
+    // UI thread.  The draws are made on the engine thread, from the
+    // engine's generator, so they follow its seed.
+    void RandomizeHelper(bool randomPitch, bool randomGate, bool randomSkip)
+    {
+        Command command;
+        command.type = Command::RANDOMIZE;
+        command.value = (randomPitch ? Command::RANDOM_PITCH : 0) | (randomGate ? Command::RANDOM_GATE : 0) |
+                        (randomSkip ? Command::RANDOM_SKIP : 0);
+        command.amount = 1.f;
+        PushCommand(command);
+    }
 
-        const float btn_x[4] = {0+10*0, 38 + 10*1, 76 + 10*2, 115 + 10*3};
-        const float btn_y[4] = {0+10*0, 38 + 10*1, 76 + 10*2, 115 + 10*3};
-        int iZ = 0;
-        for (int iY = 0; iY < 4; iY++)
+    // Engine thread.  Each step of the chosen targets is re-rolled with
+    // probability `probability`: a pitch within 2V above an offset of 1-3V
+    // drawn once per call, gates and skips on a coin flip.
+    void RandomizeGrid(int targets, float probability)
+    {
+        SeqRandom &random = m_engine.m_random;
+        uint64_t threshold = SeqRandom::Threshold(probability);
+        uint32_t draws[2 * Grid::kSteps];
+        if (targets & Command::RANDOM_PITCH)
         {
-            for (int iX = 0; iX < 4; iX++)
+            float dx = 1.f + 2.f * random.Uniform();
+            random.Fill(draws, 2 * Grid::kSteps);
+            for (int i = 0; i < Grid::kSteps; i++)
             {
-                int x = btn_x[iX] + 80;
-                int y = btn_y[iY] + 167;
-                addParam(createParam<RoundBlackKnob>(Vec(x-10, y-10), module, KSnoopySEQ::PITCH_PARAM + iZ));
-                addChild(createLight<MediumLight<GreenLight>>(Vec(x, y), module, KSnoopySEQ::GATE_PULSE_LIGHTS + iZ));
-
-                x -= 9;
-                y -= 3;
-                int radius = 13;
-                int xGateOn = x-radius;
-                int yGateOn = y-radius;
-                addParam(createParam<LEDButton>(Vec(xGateOn, yGateOn), module, KSnoopySEQ::GATE_ON_PARAM + iZ));
-                addChild(createLight<MediumLight<GreenLight>>(Vec(xGateOn+4, yGateOn+4), module, KSnoopySEQ::IS_PITCH_ON_LIGHTS + iZ));
-
-                int xSkip = x-radius;
-                int ySkip = y+radius;
-                addParam(createParam<LEDButton>(Vec(xSkip, ySkip), module, KSnoopySEQ::SKIP_PARAM + iZ));
-                addChild(createLight<MediumLight<GreenLight>>(Vec(xSkip+4, ySkip+4), module, KSnoopySEQ::SKIP_LIGHTS + iZ));
+                if (draws[2 * i] < threshold)
+                {
+                    params[PITCH_PARAM + i].setValue(2.f * SeqRandom::ToUniform(draws[2 * i + 1]) + dx);
+                }
+            }
+            ForgetPitches();
+        }
 
-                iZ++;
+        Mask *masks[2] = {(targets & Command::RANDOM_GATE) ? &m_engine.m_pitchOn : nullptr,
+                          (targets & Command::RANDOM_SKIP) ? &m_engine.m_skip : nullptr};
+        for (Mask *mask : masks)
+        {
+            if (!mask)
+            {
+                continue;
+            }
+            random.Fill(draws, 2 * Grid::kSteps);
+            for (int i = 0; i < Grid::kSteps; i++)
+            {
+                if (draws[2 * i] < threshold)
+                {
+                    mask->Set(i, draws[2 * i + 1] >> 31);
+                }
             }
+            m_engine.BreakRun();
         }
     }
 
-    void appendContextMenu(Menu *menu) override 
+    // UI thread: restarts the engine's draws from `seed`
+    void SetSeed(uint32_t seed)
     {
-        KSnoopySEQ *module = dynamic_cast<KSnoopySEQ*>(this->module);
+        Command command;
+        command.type = Command::SET_RANDOM;
+        command.random.Seed(seed);
+        PushCommand(command);
+    }
 
-        SEQActionItem *triggerItem1 = new SEQActionItem();
-        triggerItem1->text = "Randomize Pitch";
+    // step < 0 sets every step, `fields` says which parts of `condition`
+    void SetCondition(int step, const SeqCondition &condition, int fields)
+    {
+        Command command;
+        command.type = Command::SET_CONDITION;
+        command.step = step;
+        command.condition = condition;
+        command.value = fields;
+        PushCommand(command);
+    }
+
+    void SetPhrase(int phrase)
+    {
+        Command command;
+        command.type = Command::SET_PHRASE;
+        command.value = phrase;
+        PushCommand(command);
+    }
+
+    // step < 0 sets every step
+    void SetGlideStep(int step, bool glide)
+    {
+        Command command;
+        command.type = Command::SET_GLIDE_STEP;
+        command.step = step;
+        command.value = glide;
+        PushCommand(command);
+    }
+
+    void SetGlideTime(float seconds)
+    {
+        Command command;
+        command.type = Command::SET_GLIDE_TIME;
+        command.amount = seconds;
+        PushCommand(command);
+    }
+
+    void SetGlideShape(SeqGlide::Shape shape)
+    {
+        Command command;
+        command.type = Command::SET_GLIDE_SHAPE;
+        command.value = shape;
+        PushCommand(command);
+    }
+
+    // ratio > 0 multiplies the clock, < 0 divides it
+    void SetClockRatio(int ratio)
+    {
+        Command command;
+        command.type = Command::SET_CLOCK_RATIO;
+        command.value = ratio;
+        PushCommand(command);
+    }
+
+    void SetSwing(float swing)
+    {
+        Command command;
+        command.type = Command::SET_SWING;
+        command.amount = swing;
+        PushCommand(command);
+    }
+
+    // Quantizer settings, picked up by the next ScanQuantizer()
+    void SetScale(SeqScale::Scale scale)
+    {
+        Command command;
+        command.type = Command::SET_SCALE;
+        command.value = scale;
+        PushCommand(command);
+    }
+
+    void SetRoot(int root)
+    {
+        Command command;
+        command.type = Command::SET_ROOT;
+        command.value = root;
+        PushCommand(command);
+    }
+
+    void SetQuantizerCv(QuantizerCv quantizerCv)
+    {
+        Command command;
+        command.type = Command::SET_QUANTIZER_CV;
+        command.value = quantizerCv;
+        PushCommand(command);
+    }
+
+    void SetFill(bool fill)
+    {
+        Command command;
+        command.type = Command::SET_FILL;
+        command.value = fill;
+        PushCommand(command);
+    }
+
+    void SetReseedOnReset(bool reseedOnReset)
+    {
+        Command command;
+        command.type = Command::SET_RESEED_ON_RESET;
+        command.value = reseedOnReset;
+        PushCommand(command);
+    }
+
+    void onRandomize() override 
+    {
+        RandomizeHelper(true, false, false);
+    }
+
+    json_t *dataToJson() override 
+    {
+        // Until the engine has the patch dataFromJson loaded, its state is
+        // still the one from before, so the patch is what gets saved
+        if (m_loadedJ && m_loadsApplied.load(std::memory_order_acquire) != m_loadSerial)
+        {
+            return json_deep_copy(m_loadedJ);
+        }
+
+        json_t *rootJ = json_object();
+
+        // running
+        json_object_set_new(rootJ, "running", json_boolean(m_engine.m_running));
+
+        // gates, skips, step gates and lane configs as one compact string,
+        // so an autosave doesn't allocate a JSON value per step
+        State state;
+        state.pitchOn = m_engine.m_pitchOn;
+        state.skip = m_engine.m_skip;
+        std::copy(m_gates.m_lengths, m_gates.m_lengths + Grid::kSteps, state.gateLengths);
+        std::copy(m_gates.m_ratchets, m_gates.m_ratchets + Grid::kSteps, state.ratchets);
+        std::copy(m_lanes.m_config, m_lanes.m_config + SEQ_MAX_LANES, state.lanes);
+        std::copy(m_engine.m_conditions.m_steps, m_engine.m_conditions.m_steps + Grid::kSteps, state.conditions);
+        state.glide = m_glideSteps;
+        char stateText[State::kTextSize];
+        state.Encode(stateText);
+        json_object_set_new(rootJ, "state", json_string(stateText));
+
+        // gateMode
+        json_object_set_new(rootJ, "gateMode", json_integer((int)m_gateMode));
+
+        // polyphonic lanes
+        json_object_set_new(rootJ, "lanes", json_integer(m_lanes.m_numLanes));
+
+        // user patterns
+        json_t *userPatternsJ = json_array();
+        for (int i = 0; i < SEQ_MAX_USER_PATTERNS; i++)
+        {
+            json_array_append_new(userPatternsJ, json_string(m_userPatterns[i].c_str()));
+        }
+        json_object_set_new(rootJ, "userPatterns", userPatternsJ);
+
+        // page
+        json_object_set_new(rootJ, "page", json_integer(m_page));
+        json_object_set_new(rootJ, "followPage", json_boolean(m_followPage));
+
+        // trigger input mask ops
+        json_object_set_new(rootJ, "gateTriggerOp", json_integer((int)m_triggerMaskOps[SeqMaskOp::GATES]));
+        json_object_set_new(rootJ, "skipTriggerOp", json_integer((int)m_triggerMaskOps[SeqMaskOp::SKIPS]));
+
+        json_object_set_new(rootJ, "bandLimitedEdges", json_boolean(m_bandLimitedEdges));
+        json_object_set_new(rootJ, "lightDivision", json_integer(m_lightDivider.getDivision()));
+
+        // random draws: the seed, and where the generator has got to
+        char randomText[SeqRandom::kTextSize];
+        m_engine.m_random.Encode(randomText);
+        json_object_set_new(rootJ, "seed", json_integer(m_engine.m_random.m_seed));
+        json_object_set_new(rootJ, "random", json_string(randomText));
+        json_object_set_new(rootJ, "reseedOnReset", json_boolean(m_engine.m_reseedOnReset));
+
+        // step conditions: the phrase, fill, and the loop being played
+        json_object_set_new(rootJ, "phrase", json_integer(m_engine.m_conditions.m_phrase));
+        json_object_set_new(rootJ, "fill", json_boolean(m_fillLatched));
+        json_object_set_new(rootJ, "loop", json_integer(m_engine.m_conditions.m_loop));
+        json_object_set_new(rootJ, "loopSeed", json_integer(m_engine.m_conditions.m_loopSeed));
+
+        // quantizer
+        json_object_set_new(rootJ, "scale", json_integer((int)m_scale));
+        json_object_set_new(rootJ, "root", json_integer(m_root));
+        json_object_set_new(rootJ, "quantizerCv", json_integer((int)m_quantizerCv));
+
+        // glide
+        json_object_set_new(rootJ, "glideTime", json_real(m_glideTime));
+        json_object_set_new(rootJ, "glideShape", json_integer((int)m_glideShape));
+
+        // clock
+        json_object_set_new(rootJ, "clockRatio", json_integer(m_clockRatio));
+        json_object_set_new(rootJ, "swing", json_real(m_swing));
+
+        // export
+        json_object_set_new(rootJ, "exportSteps", json_integer(m_exportSteps));
+
+        // pattern bank
+        if (!m_bankPath.empty())
+        {
+            json_object_set_new(rootJ, "bankFile", json_string(m_bankPath.c_str()));
+            json_object_set_new(rootJ, "bankSlot", json_integer(m_bankSlot));
+        }
+
+        return rootJ;
+    }
+
+    // The state as older versions saved it, one JSON value per step.
+    // Anything missing keeps its current value, or the default for step gates.
+    void StateFromArrays(json_t *rootJ, State &state)
+    {
+        state.pitchOn = m_engine.m_pitchOn;
+        state.skip = m_engine.m_skip;
+        std::copy(m_lanes.m_config, m_lanes.m_config + SEQ_MAX_LANES, state.lanes);
+        std::fill(state.conditions, state.conditions + Grid::kSteps, SeqCondition());
+        state.glide.Clear();
+
+        // gates
+        json_t *gatesJ = json_object_get(rootJ, "gates");
+        if (gatesJ)
+        {
+            for (int i = 0; i < Grid::kSteps; i++)
+            {
+                json_t *gateJ = json_array_get(gatesJ, i);
+                if (gateJ)
+                {
+                    state.pitchOn.Set(i, json_integer_value(gateJ));
+                }
+            }
+        }
+
+        // skips
+        json_t *gatesS = json_object_get(rootJ, "skips");
+        if (gatesS)
+        {
+            for (int i = 0; i < Grid::kSteps; i++)
+            {
+                json_t *gateS = json_array_get(gatesS, i);
+                if (gateS)
+                {
+                    state.skip.Set(i, json_integer_value(gateS));
+                }
+            }
+        }
+
+        // step gate lengths and ratchets
+        json_t *gateLengthsJ = json_object_get(rootJ, "gateLengths");
+        json_t *ratchetsJ = json_object_get(rootJ, "ratchets");
+        for (int i = 0; i < Grid::kSteps; i++)
+        {
+            json_t *lengthJ = gateLengthsJ ? json_array_get(gateLengthsJ, i) : NULL;
+            json_t *ratchetJ = ratchetsJ ? json_array_get(ratchetsJ, i) : NULL;
+            state.gateLengths[i] = clamp(lengthJ ? (int)json_integer_value(lengthJ) : SEQ_GATE_LENGTHS / 2, 1, SEQ_GATE_LENGTHS);
+            state.ratchets[i] = clamp(ratchetJ ? (int)json_integer_value(ratchetJ) : 1, 1, SEQ_MAX_RATCHETS);
+        }
+
+        // polyphonic lanes
+        json_t *laneConfigJ = json_object_get(rootJ, "laneConfig");
+        if (laneConfigJ)
+        {
+            for (int i = 0; i < SEQ_MAX_LANES; i++)
+            {
+                json_t *laneJ = json_array_get(laneConfigJ, i);
+                if (laneJ)
+                {
+                    SeqLaneConfig &config = state.lanes[i];
+                    config.pattern = json_integer_value(json_object_get(laneJ, "pattern"));
+                    config.steps = json_integer_value(json_object_get(laneJ, "steps"));
+                    config.phaseOffset = json_real_value(json_object_get(laneJ, "phaseOffset"));
+                    config.skipMode = (SeqLaneConfig::SkipMode)clamp((int)json_integer_value(json_object_get(laneJ, "skipMode")), 0, SeqLaneConfig::NUM_SKIP_MODES - 1);
+                }
+            }
+        }
+    }
+
+    // The whole patch goes to the engine as one LOAD_PATCH, applied at
+    // once however many edits are queued ahead of it
+    void dataFromJson(json_t *rootJ) override 
+    {
+        Command command;
+        command.type = Command::LOAD_PATCH;
+        typename Command::Patch &patch = command.patch;
+
+        // running
+        json_t *runningJ = json_object_get(rootJ, "running");
+        patch.setRunning = (runningJ != NULL);
+        patch.running = json_is_true(runningJ);
+
+        // gates, skips, step gates and lane configs, from the compact string
+        // or from the per-step arrays patches were saved with before it
+        State state;
+        json_t *stateJ = json_object_get(rootJ, "state");
+        bool compact = stateJ && json_is_string(stateJ) && state.Decode(json_string_value(stateJ));
+        if (!compact)
+        {
+            StateFromArrays(rootJ, state);
+        }
+        command.setPitchOn = true;
+        command.setSkip = true;
+        command.pitchOnMask = state.pitchOn;
+        command.skipMask = state.skip;
+        command.setStepGates = true;
+        std::copy(state.gateLengths, state.gateLengths + Grid::kSteps, command.gateLengths);
+        std::copy(state.ratchets, state.ratchets + Grid::kSteps, command.ratchets);
+        std::copy(state.conditions, state.conditions + Grid::kSteps, command.conditions);
+        command.glideMask = state.glide;
+
+        // gateMode
+        // Patches from before the gate modes worked saved a mode that did
+        // nothing; they get the clock gates they were made with
+        json_t *gateModeJ = json_object_get(rootJ, "gateMode");
+        if (gateModeJ && (compact || json_object_get(rootJ, "gateLengths")))
+        {
+            patch.gateMode = clamp((int)json_integer_value(gateModeJ), 0, SeqGateMode::NUM_MODES - 1);
+        }
+
+        // polyphonic lanes
+        std::copy(state.lanes, state.lanes + SEQ_MAX_LANES, patch.lanes);
+        json_t *lanesJ = json_object_get(rootJ, "lanes");
+        patch.numLanes = lanesJ ? json_integer_value(lanesJ) : 1;
+
+        // step conditions (set with the grid), and the loop being played
+        json_t *phraseJ = json_object_get(rootJ, "phrase");
+        patch.phrase = phraseJ ? json_integer_value(phraseJ) : SEQ_DEFAULT_PHRASE;
+        json_t *fillJ = json_object_get(rootJ, "fill");
+        patch.fill = fillJ && json_is_true(fillJ);
+        json_t *loopJ = json_object_get(rootJ, "loop");
+        json_t *loopSeedJ = json_object_get(rootJ, "loopSeed");
+        if (loopJ && loopSeedJ)
+        {
+            patch.setLoop = true;
+            patch.loop = json_integer_value(loopJ);
+            patch.loopSeed = (uint32_t)json_integer_value(loopSeedJ);
+        }
+
+        // quantizer, off in patches from before it
+        json_t *scaleJ = json_object_get(rootJ, "scale");
+        patch.scale = clamp(scaleJ ? (int)json_integer_value(scaleJ) : 0, 0, SeqScale::NUM_SCALES - 1);
+        json_t *rootNoteJ = json_object_get(rootJ, "root");
+        patch.root = clamp(rootNoteJ ? (int)json_integer_value(rootNoteJ) : 0, 0, 11);
+        json_t *quantizerCvJ = json_object_get(rootJ, "quantizerCv");
+        patch.quantizerCv = clamp(quantizerCvJ ? (int)json_integer_value(quantizerCvJ) : 0, 0, NUM_QUANTIZER_CVS - 1);
+
+        // glide (the steps are set with the grid)
+        json_t *glideTimeJ = json_object_get(rootJ, "glideTime");
+        patch.glideTime = glideTimeJ ? clamp((float)json_number_value(glideTimeJ), SEQ_GLIDE_MIN_TIME, SEQ_GLIDE_MAX_TIME) : SEQ_GLIDE_DEFAULT_TIME;
+        json_t *glideShapeJ = json_object_get(rootJ, "glideShape");
+        patch.glideShape = clamp(glideShapeJ ? (int)json_integer_value(glideShapeJ) : 0, 0, SeqGlide::NUM_SHAPES - 1);
+
+        // clock
+        json_t *clockRatioJ = json_object_get(rootJ, "clockRatio");
+        patch.clockRatio = clamp(clockRatioJ ? (int)json_integer_value(clockRatioJ) : 1, -SEQ_CLOCK_MAX_RATIO, SEQ_CLOCK_MAX_RATIO);
+        json_t *swingJ = json_object_get(rootJ, "swing");
+        patch.swing = swingJ ? clamp((float)json_number_value(swingJ), 0.5f, SEQ_MAX_SWING) : 0.5f;
+
+        // export
+        json_t *exportStepsJ = json_object_get(rootJ, "exportSteps");
+        m_exportSteps = exportStepsJ ? clamp((int)json_integer_value(exportStepsJ), 1, SEQ_EXPORT_MAX_STEPS) : SEQ_EXPORT_STEPS;
+
+        // user patterns
+        json_t *userPatternsJ = json_object_get(rootJ, "userPatterns");
+        for (int i = 0; i < SEQ_MAX_USER_PATTERNS; i++)
+        {
+            json_t *userPatternJ = userPatternsJ ? json_array_get(userPatternsJ, i) : NULL;
+            m_userPatterns[i] = (userPatternJ && json_is_string(userPatternJ)) ? json_string_value(userPatternJ) : "";
+        }
+        CompileUserPatterns();
+
+        // page
+        json_t *pageJ = json_object_get(rootJ, "page");
+        patch.page = pageJ ? json_integer_value(pageJ) : 0;
+        json_t *followPageJ = json_object_get(rootJ, "followPage");
+        patch.followPage = followPageJ && json_is_true(followPageJ);
+
+        // trigger input mask ops
+        static const char *const triggerOpKeys[SeqMaskOp::NUM_TARGETS] = {"gateTriggerOp", "skipTriggerOp"};
+        for (int i = 0; i < SeqMaskOp::NUM_TARGETS; i++)
+        {
+            json_t *triggerOpJ = json_object_get(rootJ, triggerOpKeys[i]);
+            if (triggerOpJ)
+            {
+                patch.triggerMaskOps[i] = clamp((int)json_integer_value(triggerOpJ), 0, SeqMaskOp::NUM_TYPES - 1);
+            }
+        }
+
+        json_t *bandLimitedEdgesJ = json_object_get(rootJ, "bandLimitedEdges");
+        patch.bandLimitedEdges = bandLimitedEdgesJ && json_is_true(bandLimitedEdgesJ);
+        json_t *lightDivisionJ = json_object_get(rootJ, "lightDivision");
+        patch.lightDivision = lightDivisionJ ? json_integer_value(lightDivisionJ) : SEQ_LIGHT_DIVISION;
+
+        // random draws carry on exactly where they were saved
+        json_t *seedJ = json_object_get(rootJ, "seed");
+        json_t *randomJ = json_object_get(rootJ, "random");
+        if (seedJ)
+        {
+            patch.setRandom = true;
+            patch.random.Seed((uint32_t)json_integer_value(seedJ));
+            if (randomJ && json_is_string(randomJ))
+            {
+                patch.random.Decode(json_string_value(randomJ));
+            }
+        }
+        json_t *reseedOnResetJ = json_object_get(rootJ, "reseedOnReset");
+        patch.reseedOnReset = reseedOnResetJ && json_is_true(reseedOnResetJ);
+
+        command.value = ++m_loadSerial;
+        PushCommand(command);
+        if (m_loadedJ)
+        {
+            json_decref(m_loadedJ);
+        }
+        m_loadedJ = json_deep_copy(rootJ);
+
+        // The bank is mapped, not parsed, so even a large one loads at once.
+        // The grid above is the one the patch was saved with, so the slot it
+        // came from is only marked as current, not recalled over it.
+        json_t *bankFileJ = json_object_get(rootJ, "bankFile");
+        if (bankFileJ && json_is_string(bankFileJ))
+        {
+            json_t *bankSlotJ = json_object_get(rootJ, "bankSlot");
+            LoadBank(json_string_value(bankFileJ), bankSlotJ ? json_integer_value(bankSlotJ) : -1);
+        }
+    }
+
+    void ProcessXYLights(const SeqFrame &frame, const float *gates)
+    {
+        if (frame.advanced)
+        {
+            int cell = PageCell(frame.step);
+            if (cell >= 0)
+            {
+                m_stepFlashes |= 1u << cell;
+            }
+        }
+        for (int i = 0; i < SEQ_GATE_OUTPUTS; i++)
+        {
+            m_gateFlashes |= (gates[i] > 0.f) << i;
+        }
+    }
+
+    void UpdateLights(float deltaTime)
+    {
+        static const int gateLights[SEQ_GATE_OUTPUTS] = {GATE_X_LIGHT, GATE_Y_LIGHT, GATE_X_OR_Y_LIGHT};
+
+        m_lightBank.SetDeltaTime(deltaTime);
+        m_lightBank.SetValue(RUNNING_LIGHT, m_engine.m_running);
+        m_lightBank.SetValue(PITCH_LIGHT, m_currentPitch);
+        m_lightBank.SetTarget(RESET_LIGHT, m_engine.m_resetTrigger.IsHigh());
+        for (int i = 0; i < SEQ_GATE_OUTPUTS; i++)
+        {
+            if (m_gateFlashes & (1u << i))
+            {
+                m_lightBank.Flash(gateLights[i]);
+            }
+        }
+        for (int i = 0; i < SEQ_PAGE_STEPS; i++)
+        {
+            int step = PageStep(m_page, i);
+            m_lightBank.SetTarget(IS_PITCH_ON_LIGHTS + i, m_engine.m_pitchOn.Test(step) ? 10.0f : 0.0f);
+            m_lightBank.SetTarget(SKIP_LIGHTS + i, m_engine.m_skip.Test(step) ? 10.0f : 0.0f);
+            if (m_stepFlashes & (1u << i))
+            {
+                m_lightBank.Flash(GATE_PULSE_LIGHTS + i);
+            }
+        }
+        m_gateFlashes = 0;
+        m_stepFlashes = 0;
+
+        m_lightBank.Update([this](int i, float value)
+        {
+            lights[i].value = value;
+        });
+    }
+
+    void FollowPage()
+    {
+        if (m_followPage && m_engine.m_currentStepIndex < Grid::kSteps)
+        {
+            m_page = PageOf(m_engine.m_currentStepIndex);
+        }
+    }
+
+    // Knobs and patched jacks, once per UI block
+    void ScanControls()
+    {
+        m_controls.SetKnob(Controls::RUN, params[RUN_PARAM].getValue());
+        m_controls.SetKnob(Controls::CLOCK, params[CLOCK_PARAM].getValue());
+        m_controls.SetKnob(Controls::RESET, params[RESET_PARAM].getValue());
+        m_controls.SetKnob(Controls::STEPS, params[STEPS_PARAM].getValue());
+        m_controls.SetKnob(Controls::PATTERN, params[PATTERN_PARAM].getValue());
+        if (m_controls.m_pitchStep >= 0 && m_controls.m_pitchStep < Grid::kSteps)
+        {
+            m_controls.ScanPitch(params[PITCH_PARAM + m_controls.m_pitchStep].getValue());
+        }
+        m_engine.SetFill(m_fillLatched || inputs[FILL_INPUT].getVoltage() >= 1.f);
+        ScanQuantizer();
+        m_controls.SetCvPatched(inputs[CLOCK_INPUT].isConnected() || inputs[EXT_CLOCK_INPUT].isConnected() ||
+                                inputs[RESET_INPUT].isConnected() || inputs[STEPS_INPUT].isConnected() ||
+                                inputs[PATTERN_INPUT].isConnected());
+        for (int i = 0; i < m_lanes.m_numLanes; i++)
+        {
+            if (m_lanePitchStep[i] >= 0 && params[PITCH_PARAM + m_lanePitchStep[i]].getValue() != m_quantizer.m_knobs[m_lanePitchStep[i]])
+            {
+                m_lanePitchStep[i] = -1;
+            }
+        }
+    }
+
+    // The scale and root from the menu and QUANTIZER_INPUT.  The table is
+    // only rebuilt, and the pitches re-read, when they come out different.
+    void ScanQuantizer()
+    {
+        SeqScale::Scale scale = m_scale;
+        int root = m_root;
+        Input &input = inputs[QUANTIZER_INPUT];
+        if (input.isConnected())
+        {
+            float voltage = input.getVoltage();
+            if (m_quantizerCv == QUANTIZER_CV_ROOT)
+            {
+                root += (int)std::round(voltage * 12.f);
+            }
+            else
+            {
+                int numScales = SeqScale::NUM_SCALES - 1; // all but off
+                scale = (SeqScale::Scale)(1 + clamp((int)(voltage / 10.f * numScales), 0, numScales - 1));
+            }
+        }
+        if (m_quantizer.Set(scale, root))
+        {
+            ForgetPitches();
+        }
+    }
+
+    // Only the buttons of the page on the panel can be pressed
+    void ProcessButtons()
+    {
+        // Gate buttons
+        for (int i = 0; i < SEQ_PAGE_STEPS; i++) 
+        {
+            int step = PageStep(m_page, i);
+            if (m_gateTriggers[i].process(params[GATE_ON_PARAM + step].getValue())) 
+            {
+                m_engine.m_pitchOn.Flip(step);
+                m_engine.BreakRun();
+            }
+
+            if (m_skipTriggers[i].process(params[SKIP_PARAM + step].getValue()))
+            {
+                m_engine.m_skip.Flip(step);
+                m_engine.BreakRun();
+            }
+        }
+    }
+
+    // A trigger runs the selected mask op, MASK_AMOUNT_INPUT (0-10V) is the
+    // density of the Euclidean and random fills
+    void ProcessMaskTriggers()
+    {
+        for (int target = 0; target < SeqMaskOp::NUM_TARGETS; target++)
+        {
+            Input &input = inputs[GATE_OP_INPUT + target];
+            if (input.isConnected() && m_maskOpTriggers[target].process(input.getVoltage()))
+            {
+                float amount = inputs[MASK_AMOUNT_INPUT].isConnected() ? inputs[MASK_AMOUNT_INPUT].getVoltage() / 10.f : 0.5f;
+                m_engine.ApplyMaskOp((SeqMaskOp::Target)target, m_triggerMaskOps[target], amount);
+            }
+        }
+    }
+
+    // A trigger re-rolls each step's pitch with the probability set by
+    // MASK_AMOUNT_INPUT (0-10V)
+    void ProcessRandomizeTrigger()
+    {
+        Input &input = inputs[RANDOMIZE_INPUT];
+        if (input.isConnected() && m_randomizeTrigger.process(input.getVoltage()))
+        {
+            float amount = inputs[MASK_AMOUNT_INPUT].isConnected() ? inputs[MASK_AMOUNT_INPUT].getVoltage() / 10.f : 0.5f;
+            RandomizeGrid(Command::RANDOM_PITCH, amount);
+        }
+    }
+
+    void SetOutputChannels(int channels)
+    {
+        if (channels != m_outputChannels)
+        {
+            m_outputChannels = channels;
+            for (int i = 0; i < NUM_OUTPUTS; i++)
+            {
+                outputs[i].setChannels(channels);
+            }
+        }
+    }
+
+    // A new pitch for `lane`, slid into when `step` glides
+    void SetGlideTarget(int lane, int step, float pitch)
+    {
+        if (pitch == m_glide.m_target[lane])
+        {
+            return;
+        }
+        if (m_glideSteps.Test(step))
+        {
+            m_glide.GlideTo(lane, pitch);
+        }
+        else
+        {
+            m_glide.Jump(lane, pitch);
+        }
+    }
+
+    void ProcessPolyOutputs()
+    {
+        int numLanes = m_lanes.m_numLanes;
+        SetOutputChannels(numLanes);
+
+        for (int i = 0; i < numLanes; i++)
+        {
+            int step = std::min(m_lanes.m_step[i], Grid::kSteps - 1);
+            if (step != m_lanePitchStep[i])
+            {
+                m_lanePitchStep[i] = step;
+                m_lanePitch[i] = m_quantizer.Pitch(step, params[PITCH_PARAM + step].getValue());
+                SetGlideTarget(i, step, m_lanePitch[i]);
+            }
+        }
+        m_glide.Process();
+
+        for (int c = 0; c < numLanes; c += SEQ_LANE_WIDTH)
+        {
+            simd::float_4 pitch = simd::float_4::load(&m_glide.m_out[c]) + inputs[TRANSPOSE_INPUT].template getPolyVoltageSimd<simd::float_4>(c);
+            outputs[PITCH_OUTPUT].setVoltageSimd(pitch, c);
+            outputs[GATE_X_OUTPUT].setVoltageSimd(simd::float_4::load(&m_lanes.m_gateX[c]), c);
+            outputs[GATE_Y_OUTPUT].setVoltageSimd(simd::float_4::load(&m_lanes.m_gateY[c]), c);
+            outputs[GATE_XORY_OUTPUT].setVoltageSimd(simd::float_4::load(&m_lanes.m_gateXorY[c]), c);
+        }
+    }
+
+    // Any size of the sequencer chains with any other
+    static bool Chainable(Module *module)
+    {
+        return module && (module->model == modelSeq || module->model == modelSeq8x8 || module->model == modelSeq16x16);
+    }
+
+    // What the neighbours sent last sample
+    void ReadChain()
+    {
+        const SeqChainMessage *message = (const SeqChainMessage *)leftExpander.consumerMessage;
+        bool following = Chainable(leftExpander.module) && message->valid;
+        bool hasNext = Chainable(rightExpander.module);
+        if (following)
+        {
+            m_engine.m_chain.m_in = *message;
+        }
+        if (hasNext)
+        {
+            m_engine.m_chain.m_reply = *(const SeqChainReply *)rightExpander.consumerMessage;
+        }
+        m_engine.SetChain(following, hasNext);
+    }
+
+    // And what they get from this one for the next
+    void WriteChain()
+    {
+        if (m_engine.m_chain.m_hasNext)
+        {
+            Module *next = rightExpander.module;
+            m_engine.WriteChainMessage(*(SeqChainMessage *)next->leftExpander.producerMessage);
+            next->leftExpander.messageFlipRequested = true;
+        }
+        if (m_engine.m_chain.m_following)
+        {
+            Module *previous = leftExpander.module;
+            *(SeqChainReply *)previous->rightExpander.producerMessage = m_engine.m_chain.Reply();
+            previous->rightExpander.messageFlipRequested = true;
+        }
+    }
+
+    void process(const ProcessArgs &args) override 
+    {
+        SEQ_TRACE_TICK(m_trace);
+        ProcessMaskTriggers();
+        ProcessRandomizeTrigger();
+
+        // Knobs as of the last scan, CV as of this sample.  With nothing
+        // patched and no knob moved the engine can skip looking at them;
+        // with CV patched it compares them, so an external clock still
+        // coasts between its edges.
+        bool inputsChanged = m_controls.UpdateKnobInputs();
+        SeqInputs in = m_controls.m_knobInputs;
+        if (m_controls.m_cvPatched)
+        {
+            in.clock += inputs[CLOCK_INPUT].getVoltage();
+            in.extClockConnected = inputs[EXT_CLOCK_INPUT].isConnected();
+            in.extClock = inputs[EXT_CLOCK_INPUT].getVoltage();
+            in.reset += inputs[RESET_INPUT].getVoltage();
+            in.steps += inputs[STEPS_INPUT].getVoltage();
+            in.pattern += inputs[PATTERN_INPUT].getVoltage();
+        }
+
+        SeqFrame frame;
+        {
+            SeqProfileScope scope(&m_profiler, SeqProfiler::ENGINE);
+            ReadChain();
+            frame = m_controls.m_cvPatched ? m_engine.Process(in, args.sampleTime) : m_engine.Process(in, args.sampleTime, inputsChanged);
+            WriteChain();
+        }
+        ProcessBank(frame);
+        if (frame.advanced)
+        {
+            SEQ_TRACE_EVENT(m_trace, frame.reset ? SeqTraceEvent::RESET : SeqTraceEvent::STEP, frame.step, frame.edgeOffset);
+        }
+        float gates[1][SEQ_GATE_OUTPUTS];
+        {
+            SeqProfileScope scope(&m_profiler, SeqProfiler::GATES);
+            m_gates.SetSampleRate(args.sampleRate);
+            m_gates.Process(&frame, 1, gates);
+            ProcessXYLights(frame, gates[0]);
+        }
+        if (m_controls.PitchStale(frame.step))
+        {
+            float knob = params[PITCH_PARAM + frame.step].getValue();
+            m_controls.SetPitch(frame.step, knob, m_quantizer.Pitch(frame.step, knob));
+        }
+        float currentPitch = m_controls.m_pitch;
+        m_currentPitch = currentPitch;
+
+        {
+            SeqProfileScope scope(&m_profiler, SeqProfiler::OUTPUTS);
+            if (m_lanes.m_numLanes > 1)
+            {
+                m_lanes.SetSampleRate(args.sampleRate);
+                m_lanes.Process(m_engine, frame, in);
+                ProcessPolyOutputs();
+            }
+            else
+            {
+                SetOutputChannels(1);
+                SetGlideTarget(0, frame.step, currentPitch);
+                m_glide.Process();
+                outputs[GATE_X_OUTPUT].setVoltage(10.f * gates[0][0]);
+                outputs[GATE_Y_OUTPUT].setVoltage(10.f * gates[0][1]);
+                outputs[GATE_XORY_OUTPUT].setVoltage(10.f * gates[0][2]);
+                outputs[PITCH_OUTPUT].setVoltage(m_glide.m_out[0] + inputs[TRANSPOSE_INPUT].getVoltage());
+            }
+        }
+
+        // Controls and lights don't need audio rate: knobs, buttons and edits
+        // are scanned once per UI block, lights once per (longer) light block
+        if (m_uiDivider.process())
+        {
+            SeqProfileScope scope(&m_profiler, SeqProfiler::CONTROLS);
+            ApplyCommands();
+            FollowPage();
+            ScanControls();
+            m_glide.Configure(m_glideShape, m_glideTime, args.sampleRate);
+            ProcessButtons();
+        }
+        if (m_lightDivider.process())
+        {
+            SeqProfileScope scope(&m_profiler, SeqProfiler::LIGHTS);
+            UpdateLights(args.sampleTime * m_lightDivider.getDivision());
+        }
+    }
+};
+
+
+template <typename TModule>
+struct SEQGateModeItem : MenuItem
+{
+    TModule* module;
+    typename TModule::GateMode gateMode;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetGateMode(gateMode);
+    }
+
+    void step() override
+    {
+        rightText = (module->m_gateMode == gateMode) ? "✔" : "";
+    }
+};
+
+template <typename TModule>
+struct SEQActionItem : MenuItem
+{
+    TModule* module;
+    bool randomPitch = false;
+    bool randomGate = false;
+    bool randomSkip = false;
+    void onAction(const event::Action &e) override 
+    {
+        module->RandomizeHelper(randomPitch, randomGate, randomSkip);
+    }
+};
+
+template <typename TModule>
+struct SEQSeedField : TextField
+{
+    TModule* module;
+
+    void onSelectKey(const event::SelectKey &e) override
+    {
+        if (e.action == GLFW_PRESS && (e.key == GLFW_KEY_ENTER || e.key == GLFW_KEY_KP_ENTER))
+        {
+            char *end;
+            unsigned long long seed = strtoull(text.c_str(), &end, 10);
+            if (end != text.c_str() && *end == '\0' && seed <= UINT32_MAX)
+            {
+                module->SetSeed((uint32_t)seed);
+            }
+            e.consume(this);
+        }
+        if (!e.getTarget())
+        {
+            TextField::onSelectKey(e);
+        }
+    }
+};
+
+template <typename TModule>
+struct SEQNewSeedItem : MenuItem
+{
+    TModule* module;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetSeed((uint32_t)random::u64());
+    }
+};
+
+template <typename TModule>
+struct SEQReseedOnResetItem : MenuItem
+{
+    TModule* module;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetReseedOnReset(!module->m_engine.m_reseedOnReset);
+    }
+
+    void step() override
+    {
+        rightText = module->m_engine.m_reseedOnReset ? "✔" : "";
+    }
+};
+
+template <typename TModule>
+struct SEQSeedItem : MenuItem
+{
+    TModule* module;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+
+        MenuLabel *seedLabel = new MenuLabel();
+        seedLabel->text = string::f("Seed %u, type a new one and press Enter", (unsigned)module->m_engine.m_random.m_seed);
+        menu->addChild(seedLabel);
+
+        SEQSeedField<TModule> *field = new SEQSeedField<TModule>();
+        field->box.size.x = 150;
+        field->module = module;
+        field->text = string::f("%u", (unsigned)module->m_engine.m_random.m_seed);
+        menu->addChild(field);
+
+        SEQNewSeedItem<TModule> *newSeedItem = new SEQNewSeedItem<TModule>();
+        newSeedItem->text = "New seed";
+        newSeedItem->module = module;
+        menu->addChild(newSeedItem);
+
+        SEQReseedOnResetItem<TModule> *reseedItem = new SEQReseedOnResetItem<TModule>();
+        reseedItem->text = "Restart from seed on reset";
+        reseedItem->module = module;
+        menu->addChild(reseedItem);
+        return menu;
+    }
+};
+
+template <typename TModule>
+struct SEQLanesValueItem : MenuItem
+{
+    TModule* module;
+    int numLanes;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetNumLanes(numLanes);
+    }
+
+    void step() override
+    {
+        rightText = (module->m_lanes.m_numLanes == numLanes) ? "✔" : "";
+    }
+};
+
+template <typename TModule>
+struct SEQLanesItem : MenuItem
+{
+    TModule* module;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+        for (int i = 1; i <= SEQ_MAX_LANES; i++)
+        {
+            SEQLanesValueItem<TModule> *item = new SEQLanesValueItem<TModule>();
+            item->text = (i == 1) ? "1 (mono)" : string::f("%d", i);
+            item->module = module;
+            item->numLanes = i;
+            menu->addChild(item);
+        }
+        return menu;
+    }
+};
+
+template <typename TModule>
+struct SEQLaneFieldValueItem : MenuItem
+{
+    enum Field
+    {
+        PATTERN,
+        STEPS,
+        PHASE_OFFSET,
+        SKIP_MODE
+    };
+
+    TModule* module;
+    int lane;
+    Field field;
+    int value;
+
+    void onAction(const event::Action &e) override 
+    {
+        SeqLaneConfig config = module->m_lanes.m_config[lane];
+        switch (field)
+        {
+            case PATTERN: config.pattern = value; break;
+            case STEPS: config.steps = value; break;
+            case PHASE_OFFSET: config.phaseOffset = value / 8.f; break;
+            case SKIP_MODE: config.skipMode = (SeqLaneConfig::SkipMode)value; break;
+        }
+        module->SetLaneConfig(lane, config);
+    }
+
+    void step() override
+    {
+        const SeqLaneConfig &config = module->m_lanes.m_config[lane];
+        bool selected = false;
+        switch (field)
+        {
+            case PATTERN: selected = (config.pattern == value); break;
+            case STEPS: selected = (config.steps == value); break;
+            case PHASE_OFFSET: selected = (config.phaseOffset == value / 8.f); break;
+            case SKIP_MODE: selected = (config.skipMode == value); break;
+        }
+        rightText = selected ? "✔" : "";
+    }
+};
+
+template <typename TModule>
+struct SEQLaneFieldItem : MenuItem
+{
+    typedef SEQLaneFieldValueItem<TModule> ValueItem;
+
+    TModule* module;
+    int lane;
+    typename ValueItem::Field field;
+
+    void AddValue(Menu *menu, const std::string &text, int value)
+    {
+        ValueItem *item = new ValueItem();
+        item->text = text;
+        item->module = module;
+        item->lane = lane;
+        item->field = field;
+        item->value = value;
+        menu->addChild(item);
+    }
+
+    Menu *createChildMenu() override
+    {
+        static const char *const skipModeNames[SeqLaneConfig::NUM_SKIP_MODES] = {"Grid", "None", "Inverted grid", "Rotated grid"};
+
+        Menu *menu = new Menu();
+        switch (field)
+        {
+            case ValueItem::PATTERN:
+                AddValue(menu, "Follow knob", 0);
+                for (int i = 0; i < (int)module->m_patternNames.size(); i++)
+                {
+                    AddValue(menu, module->m_patternNames[i], i + 1);
+                }
+                break;
+            case ValueItem::STEPS:
+                AddValue(menu, "Follow knob", 0);
+                for (int i = 1; i <= 16; i++)
+                {
+                    int steps = i * TModule::Grid::kSteps / 16;
+                    AddValue(menu, string::f("%d", steps), steps);
+                }
+                break;
+            case ValueItem::PHASE_OFFSET:
+                for (int i = 0; i < 8; i++)
+                {
+                    AddValue(menu, string::f("%d/8", i), i);
+                }
+                break;
+            case ValueItem::SKIP_MODE:
+                for (int i = 0; i < SeqLaneConfig::NUM_SKIP_MODES; i++)
+                {
+                    AddValue(menu, skipModeNames[i], i);
+                }
+                break;
+        }
+        return menu;
+    }
+};
+
+template <typename TModule>
+struct SEQLaneItem : MenuItem
+{
+    TModule* module;
+    int lane;
+    Menu *createChildMenu() override
+    {
+        static const char *const fieldNames[] = {"Pattern", "Steps", "Phase offset", "Skips"};
+
+        Menu *menu = new Menu();
+        for (int i = 0; i < 4; i++)
+        {
+            SEQLaneFieldItem<TModule> *item = new SEQLaneFieldItem<TModule>();
+            item->text = fieldNames[i];
+            item->rightText = RIGHT_ARROW;
+            item->module = module;
+            item->lane = lane;
+            item->field = (typename SEQLaneFieldValueItem<TModule>::Field)i;
+            menu->addChild(item);
+        }
+        return menu;
+    }
+};
+
+template <typename TModule>
+struct SEQUserPatternField : TextField
+{
+    TModule* module;
+    int slot;
+
+    void onSelectKey(const event::SelectKey &e) override
+    {
+        if (e.action == GLFW_PRESS && (e.key == GLFW_KEY_ENTER || e.key == GLFW_KEY_KP_ENTER))
+        {
+            module->SetUserPattern(slot, text);
+            e.consume(this);
+        }
+        if (!e.getTarget())
+        {
+            TextField::onSelectKey(e);
+        }
+    }
+};
+
+template <typename TModule>
+struct SEQUserPatternItem : MenuItem
+{
+    TModule* module;
+    int slot;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+
+        const std::string &error = module->m_userPatternErrors[slot];
+        int pattern = module->m_userPatternNumbers[slot];
+        MenuLabel *statusLabel = new MenuLabel();
+        if (!error.empty())
+        {
+            statusLabel->text = "Error: " + error;
+        }
+        else if (pattern)
+        {
+            statusLabel->text = string::f("Pattern %d, press Enter to apply", pattern);
+        }
+        else
+        {
+            statusLabel->text = "Press Enter to apply";
+        }
+        menu->addChild(statusLabel);
+
+        SEQUserPatternField<TModule> *field = new SEQUserPatternField<TModule>();
+        field->box.size.x = 300;
+        field->module = module;
+        field->slot = slot;
+        field->text = module->m_userPatterns[slot];
+        field->placeholder = "eg. rot(snake, 2) or euclid(5, 16)";
+        menu->addChild(field);
+        return menu;
+    }
+};
+
+template <typename TModule>
+struct SEQUserPatternsItem : MenuItem
+{
+    TModule* module;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+        for (int i = 0; i < SEQ_MAX_USER_PATTERNS; i++)
+        {
+            SEQUserPatternItem<TModule> *item = new SEQUserPatternItem<TModule>();
+            const std::string &source = module->m_userPatterns[i];
+            item->text = string::f("User %d: ", i + 1) + (source.empty() ? std::string("(empty)") : source);
+            item->rightText = RIGHT_ARROW;
+            item->module = module;
+            item->slot = i;
+            menu->addChild(item);
+        }
+        return menu;
+    }
+};
+
+template <typename TModule>
+struct SEQPageValueItem : MenuItem
+{
+    TModule* module;
+    int page;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetPage(page);
+    }
+
+    void step() override
+    {
+        rightText = (!module->m_followPage && module->m_page == page) ? "✔" : "";
+    }
+};
+
+template <typename TModule>
+struct SEQLightDivisionValueItem : MenuItem
+{
+    TModule* module;
+    int division;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetLightDivision(division);
+    }
+
+    void step() override
+    {
+        rightText = ((int)module->m_lightDivider.getDivision() == division) ? "✔" : "";
+    }
+};
+
+template <typename TModule>
+struct SEQLightDivisionItem : MenuItem
+{
+    TModule* module;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+        for (int division = SEQ_UI_BLOCK_SIZE; division <= 8 * SEQ_UI_BLOCK_SIZE; division *= 2)
+        {
+            SEQLightDivisionValueItem<TModule> *item = new SEQLightDivisionValueItem<TModule>();
+            item->text = string::f("Every %d samples", division);
+            item->module = module;
+            item->division = division;
+            menu->addChild(item);
+        }
+        return menu;
+    }
+};
+
+template <typename TModule>
+struct SEQExportStepsItem : MenuItem
+{
+    TModule* module;
+    int steps;
+    void onAction(const event::Action &e) override 
+    {
+        module->m_exportSteps = steps;
+    }
+
+    void step() override
+    {
+        rightText = (module->m_exportSteps == steps) ? "✔" : "";
+    }
+};
+
+template <typename TModule>
+struct SEQExportActionItem : MenuItem
+{
+    TModule* module;
+    bool midi;
+    void onAction(const event::Action &e) override 
+    {
+        std::string patchPath = APP->patch->path;
+        std::string dir = patchPath.empty() ? asset::user("") : string::directory(patchPath);
+        std::string name = (patchPath.empty() ? std::string("KSnoopy") : string::filenameBase(string::filename(patchPath))) + (midi ? ".mid" : ".csv");
+        osdialog_filters *filters = osdialog_filters_parse(midi ? "MIDI file:mid" : "CSV:csv");
+        char *path = osdialog_file(OSDIALOG_SAVE, dir.c_str(), name.c_str(), filters);
+        osdialog_filters_free(filters);
+        if (path)
+        {
+            module->Export(path, midi);
+            free(path);
+        }
+    }
+};
+
+template <typename TModule>
+struct SEQExportItem : MenuItem
+{
+    TModule* module;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+
+        SEQExportActionItem<TModule> *midiItem = new SEQExportActionItem<TModule>();
+        midiItem->text = "MIDI file...";
+        midiItem->module = module;
+        midiItem->midi = true;
+        menu->addChild(midiItem);
+
+        SEQExportActionItem<TModule> *csvItem = new SEQExportActionItem<TModule>();
+        csvItem->text = "CSV...";
+        csvItem->module = module;
+        csvItem->midi = false;
+        menu->addChild(csvItem);
+
+        MenuLabel *label = new MenuLabel();
+        label->text = "Length, from the top";
+        menu->addChild(label);
+
+        for (int steps = 16; steps <= SEQ_EXPORT_MAX_STEPS; steps *= 4)
+        {
+            SEQExportStepsItem<TModule> *item = new SEQExportStepsItem<TModule>();
+            item->text = string::f("%d steps", steps);
+            item->module = module;
+            item->steps = steps;
+            menu->addChild(item);
+        }
+        return menu;
+    }
+};
+
+template <typename TModule>
+struct SEQBankSlotItem : MenuItem
+{
+    TModule* module;
+    int slot;
+    void onAction(const event::Action &e) override 
+    {
+        module->RecallBankSlot(slot);
+    }
+
+    void step() override
+    {
+        rightText = (module->m_bankSlot == slot) ? "✔" : "";
+    }
+};
+
+template <typename TModule>
+struct SEQBankSlotsItem : MenuItem
+{
+    TModule* module;
+    int first;
+    int count;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+        for (int i = first; i < first + count; i++)
+        {
+            SEQBankSlotItem<TModule> *item = new SEQBankSlotItem<TModule>();
+            item->text = string::f("Slot %d", i + 1);
+            item->module = module;
+            item->slot = i;
+            menu->addChild(item);
+        }
+        return menu;
+    }
+};
+
+template <typename TModule>
+struct SEQBankActionItem : MenuItem
+{
+    enum Action
+    {
+        STORE_NEW,
+        STORE_CURRENT,
+        LOAD
+    };
+
+    TModule* module;
+    Action action;
+    void onAction(const event::Action &e) override 
+    {
+        switch (action)
+        {
+            case STORE_NEW:
+                module->StoreBankSlot(-1);
+                break;
+            case STORE_CURRENT:
+                module->StoreBankSlot(module->m_bankSlot);
+                break;
+            case LOAD:
+            {
+                std::string dir = module->m_bankPath.empty() ? asset::user("") : string::directory(module->m_bankPath);
+                osdialog_filters *filters = osdialog_filters_parse("KSnoopy pattern bank:ksbank");
+                char *path = osdialog_file(OSDIALOG_OPEN, dir.c_str(), NULL, filters);
+                osdialog_filters_free(filters);
+                if (path)
+                {
+                    module->LoadBank(path, -1);
+                    free(path);
+                }
+                break;
+            }
+        }
+    }
+};
+
+template <typename TModule>
+struct SEQBankItem : MenuItem
+{
+    TModule* module;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+        typename TModule::Bank *bank = module->m_uiBank;
+        int numSlots = bank ? bank->NumSlots() : 0;
+
+        MenuLabel *label = new MenuLabel();
+        label->text = bank ? string::f("%d slots in %s", numSlots, string::filename(module->m_bankPath).c_str()) : "No bank yet";
+        menu->addChild(label);
+
+        SEQBankActionItem<TModule> *storeNewItem = new SEQBankActionItem<TModule>();
+        storeNewItem->text = "Store grid in a new slot";
+        storeNewItem->module = module;
+        storeNewItem->action = SEQBankActionItem<TModule>::STORE_NEW;
+        menu->addChild(storeNewItem);
+
+        if (module->m_bankSlot >= 0)
+        {
+            SEQBankActionItem<TModule> *storeItem = new SEQBankActionItem<TModule>();
+            storeItem->text = string::f("Store grid in slot %d", module->m_bankSlot + 1);
+            storeItem->module = module;
+            storeItem->action = SEQBankActionItem<TModule>::STORE_CURRENT;
+            menu->addChild(storeItem);
+        }
+
+        SEQBankActionItem<TModule> *loadItem = new SEQBankActionItem<TModule>();
+        loadItem->text = "Load bank file...";
+        loadItem->module = module;
+        loadItem->action = SEQBankActionItem<TModule>::LOAD;
+        menu->addChild(loadItem);
+
+        if (numSlots > 0)
+        {
+            menu->addChild(new MenuEntry);
+            for (int first = 0; first < numSlots; first += SEQ_BANK_MENU_SLOTS)
+            {
+                SEQBankSlotsItem<TModule> *slotsItem = new SEQBankSlotsItem<TModule>();
+                slotsItem->count = std::min(SEQ_BANK_MENU_SLOTS, numSlots - first);
+                slotsItem->text = string::f("Recall slot %d-%d", first + 1, first + slotsItem->count);
+                slotsItem->rightText = RIGHT_ARROW;
+                slotsItem->module = module;
+                slotsItem->first = first;
+                menu->addChild(slotsItem);
+            }
+        }
+        return menu;
+    }
+};
+
+template <typename TModule>
+struct SEQTimingStageItem : MenuItem
+{
+    TModule* module;
+    SeqProfiler::Stage stage;
+
+    void step() override
+    {
+        const SeqProfileHistogram &histogram = module->m_profiler.m_stages[stage];
+        rightText = string::f("%u / %.0f / %u ns", histogram.MinNs(), histogram.MeanNs(), histogram.PercentileNs(0.99));
+        MenuItem::step();
+    }
+};
+
+template <typename TModule>
+struct SEQTimingActionItem : MenuItem
+{
+    TModule* module;
+    bool save = false;
+    void onAction(const event::Action &e) override 
+    {
+        if (save)
+        {
+            module->SaveTiming();
+        }
+        else
+        {
+            module->ResetTiming();
+        }
+    }
+};
+
+template <typename TModule>
+struct SEQTimingItem : MenuItem
+{
+    TModule* module;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+
+        MenuLabel *label = new MenuLabel();
+        label->text = string::f("min / mean / p99, 1 in %d samples", SEQ_PROFILE_INTERVAL);
+        menu->addChild(label);
+
+        for (int i = 0; i < SeqProfiler::NUM_STAGES; i++)
+        {
+            SEQTimingStageItem<TModule> *item = new SEQTimingStageItem<TModule>();
+            item->text = SeqProfiler::Name((SeqProfiler::Stage)i);
+            item->module = module;
+            item->stage = (SeqProfiler::Stage)i;
+            menu->addChild(item);
+        }
+
+        menu->addChild(new MenuEntry);
+
+        SEQTimingActionItem<TModule> *resetItem = new SEQTimingActionItem<TModule>();
+        resetItem->text = "Reset timing";
+        resetItem->module = module;
+        menu->addChild(resetItem);
+
+        SEQTimingActionItem<TModule> *saveItem = new SEQTimingActionItem<TModule>();
+        saveItem->text = "Save timing to user folder (JSON)";
+        saveItem->module = module;
+        saveItem->save = true;
+        menu->addChild(saveItem);
+        return menu;
+    }
+};
+
+template <typename TModule>
+struct SEQFollowPageItem : MenuItem
+{
+    TModule* module;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetFollowPage(!module->m_followPage);
+    }
+
+    void step() override
+    {
+        rightText = module->m_followPage ? "✔" : "";
+    }
+};
+
+template <typename TModule>
+struct SEQBandLimitedItem : MenuItem
+{
+    TModule* module;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetBandLimitedEdges(!module->m_bandLimitedEdges);
+    }
+
+    void step() override
+    {
+        rightText = module->m_bandLimitedEdges ? "✔" : "";
+    }
+};
+
+template <typename TModule>
+struct SEQPageItem : MenuItem
+{
+    TModule* module;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+        SEQFollowPageItem<TModule> *followItem = new SEQFollowPageItem<TModule>();
+        followItem->text = "Follow playing step";
+        followItem->module = module;
+        menu->addChild(followItem);
+
+        for (int i = 0; i < TModule::kNumPages; i++)
+        {
+            int x = (i % TModule::kPagesX) * SEQ_PAGE_SIZE;
+            int y = (i / TModule::kPagesX) * SEQ_PAGE_SIZE;
+            SEQPageValueItem<TModule> *item = new SEQPageValueItem<TModule>();
+            item->text = string::f("Rows %d-%d, columns %d-%d", y + 1, y + SEQ_PAGE_SIZE, x + 1, x + SEQ_PAGE_SIZE);
+            item->module = module;
+            item->page = i;
+            menu->addChild(item);
+        }
+        return menu;
+    }
+};
+
+template <typename TModule>
+struct SEQMaskOpItem : MenuItem
+{
+    TModule* module;
+    SeqMaskOp::Target target;
+    SeqMaskOp::Type maskOp;
+    float amount = 0.f;
+    void onAction(const event::Action &e) override 
+    {
+        module->ApplyMaskOp(target, maskOp, amount);
+    }
+};
+
+template <typename TModule>
+struct SEQMaskDensityItem : MenuItem
+{
+    TModule* module;
+    SeqMaskOp::Target target;
+    SeqMaskOp::Type maskOp;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+        for (int i = 1; i <= 3; i++)
+        {
+            SEQMaskOpItem<TModule> *item = new SEQMaskOpItem<TModule>();
+            item->text = string::f("%d%%", i * 25);
+            item->module = module;
+            item->target = target;
+            item->maskOp = maskOp;
+            item->amount = i * 0.25f;
+            menu->addChild(item);
+        }
+        return menu;
+    }
+};
+
+template <typename TModule>
+struct SEQTriggerMaskOpItem : MenuItem
+{
+    TModule* module;
+    SeqMaskOp::Target target;
+    SeqMaskOp::Type maskOp;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetTriggerMaskOp(target, maskOp);
+    }
+
+    void step() override
+    {
+        rightText = (module->m_triggerMaskOps[target] == maskOp) ? "✔" : "";
+    }
+};
+
+template <typename TModule>
+struct SEQMaskItem : MenuItem
+{
+    TModule* module;
+    SeqMaskOp::Target target;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+        for (int i = 0; i < SeqMaskOp::NUM_TYPES; i++)
+        {
+            SeqMaskOp::Type maskOp = (SeqMaskOp::Type)i;
+            if (maskOp == SeqMaskOp::EUCLID || maskOp == SeqMaskOp::RANDOM)
+            {
+                SEQMaskDensityItem<TModule> *item = new SEQMaskDensityItem<TModule>();
+                item->text = SeqMaskOp::Name(maskOp);
+                item->rightText = RIGHT_ARROW;
+                item->module = module;
+                item->target = target;
+                item->maskOp = maskOp;
+                menu->addChild(item);
+            }
+            else
+            {
+                SEQMaskOpItem<TModule> *item = new SEQMaskOpItem<TModule>();
+                item->text = SeqMaskOp::Name(maskOp);
+                item->module = module;
+                item->target = target;
+                item->maskOp = maskOp;
+                menu->addChild(item);
+            }
+        }
+
+        menu->addChild(new MenuEntry);
+        MenuLabel *triggerLabel = new MenuLabel();
+        triggerLabel->text = (target == SeqMaskOp::GATES) ? "Gate op trigger input" : "Skip op trigger input";
+        menu->addChild(triggerLabel);
+        for (int i = 0; i < SeqMaskOp::NUM_TYPES; i++)
+        {
+            SEQTriggerMaskOpItem<TModule> *item = new SEQTriggerMaskOpItem<TModule>();
+            item->text = SeqMaskOp::Name((SeqMaskOp::Type)i);
+            item->module = module;
+            item->target = target;
+            item->maskOp = (SeqMaskOp::Type)i;
+            menu->addChild(item);
+        }
+        return menu;
+    }
+};
+
+template <typename TModule>
+struct SEQStepGateValueItem : MenuItem
+{
+    TModule* module;
+    int gridStep = -1;
+    bool ratchets = false;
+    int value = 1;
+    void onAction(const event::Action &e) override 
+    {
+        if (ratchets)
+        {
+            module->SetRatchets(gridStep, value);
+        }
+        else
+        {
+            module->SetGateLength(gridStep, value);
+        }
+    }
+
+    void step() override
+    {
+        int current = 0;
+        if (gridStep >= 0)
+        {
+            current = ratchets ? module->m_gates.m_ratchets[gridStep] : module->m_gates.m_lengths[gridStep];
+        }
+        rightText = (current == value) ? "✔" : "";
+    }
+};
+
+// Gate length and ratchets of one step, or of every step when gridStep < 0
+template <typename TModule>
+struct SEQStepGateItem : MenuItem
+{
+    TModule* module;
+    int gridStep = -1;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+        MenuLabel *lengthLabel = new MenuLabel();
+        lengthLabel->text = "Gate length";
+        menu->addChild(lengthLabel);
+        for (int i = 1; i <= SEQ_GATE_LENGTHS; i++)
+        {
+            SEQStepGateValueItem<TModule> *item = new SEQStepGateValueItem<TModule>();
+            item->text = string::f("%g%%", 100.f * i / SEQ_GATE_LENGTHS);
+            item->module = module;
+            item->gridStep = gridStep;
+            item->value = i;
+            menu->addChild(item);
+        }
+
+        menu->addChild(new MenuEntry);
+        MenuLabel *ratchetLabel = new MenuLabel();
+        ratchetLabel->text = "Ratchets";
+        menu->addChild(ratchetLabel);
+        for (int i = 1; i <= SEQ_MAX_RATCHETS; i++)
+        {
+            SEQStepGateValueItem<TModule> *item = new SEQStepGateValueItem<TModule>();
+            item->text = string::f("%d", i);
+            item->module = module;
+            item->gridStep = gridStep;
+            item->ratchets = true;
+            item->value = i;
+            menu->addChild(item);
+        }
+        return menu;
+    }
+};
+
+// The steps on the panel's current page
+template <typename TModule>
+struct SEQStepGatesItem : MenuItem
+{
+    TModule* module;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+        SEQStepGateItem<TModule> *allItem = new SEQStepGateItem<TModule>();
+        allItem->text = "All steps";
+        allItem->rightText = RIGHT_ARROW;
+        allItem->module = module;
+        menu->addChild(allItem);
+
+        for (int cell = 0; cell < SEQ_PAGE_STEPS; cell++)
+        {
+            int step = TModule::PageStep(module->m_page, cell);
+            SEQStepGateItem<TModule> *item = new SEQStepGateItem<TModule>();
+            item->text = string::f("Step %d", step + 1);
+            item->rightText = RIGHT_ARROW;
+            item->module = module;
+            item->gridStep = step;
+            menu->addChild(item);
+        }
+        return menu;
+    }
+};
+
+// One condition or chance for a step, or for every step when gridStep < 0
+template <typename TModule>
+struct SEQStepConditionValueItem : MenuItem
+{
+    typedef typename TModule::Conditions Conditions;
+
+    TModule* module;
+    int gridStep = -1;
+    int fields = Conditions::WHEN;
+    SeqCondition condition;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetCondition(gridStep, condition, fields);
+    }
+
+    void step() override
+    {
+        bool selected = false;
+        if (gridStep >= 0)
+        {
+            const SeqCondition &current = module->m_engine.m_conditions.m_steps[gridStep];
+            if (fields == Conditions::CHANCE)
+            {
+                selected = (current.chance == condition.chance);
+            }
+            else
+            {
+                selected = (current.type == condition.type) &&
+                           (condition.type != SeqCondition::RATIO || (current.a == condition.a && current.b == condition.b));
+            }
+        }
+        rightText = selected ? "✔" : "";
+    }
+};
+
+template <typename TModule>
+struct SEQStepRatioItem : MenuItem
+{
+    TModule* module;
+    int gridStep = -1;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+        for (int b = 2; b <= SEQ_MAX_RATIO; b++)
+        {
+            for (int a = 1; a <= b; a++)
+            {
+                SEQStepConditionValueItem<TModule> *item = new SEQStepConditionValueItem<TModule>();
+                item->text = string::f("%d:%d", a, b);
+                item->module = module;
+                item->gridStep = gridStep;
+                item->condition.type = SeqCondition::RATIO;
+                item->condition.a = a;
+                item->condition.b = b;
+                menu->addChild(item);
+            }
+        }
+        return menu;
+    }
+};
+
+// Condition and chance of one step, or of every step when gridStep < 0
+template <typename TModule>
+struct SEQStepConditionItem : MenuItem
+{
+    typedef typename TModule::Conditions Conditions;
+
+    TModule* module;
+    int gridStep = -1;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+        MenuLabel *conditionLabel = new MenuLabel();
+        conditionLabel->text = "Plays on";
+        menu->addChild(conditionLabel);
+        for (int i = 0; i < SeqCondition::NUM_TYPES; i++)
+        {
+            if (i == SeqCondition::RATIO)
+            {
+                SEQStepRatioItem<TModule> *ratioItem = new SEQStepRatioItem<TModule>();
+                ratioItem->text = SeqCondition::Name(SeqCondition::RATIO);
+                ratioItem->rightText = RIGHT_ARROW;
+                ratioItem->module = module;
+                ratioItem->gridStep = gridStep;
+                menu->addChild(ratioItem);
+                continue;
+            }
+            SEQStepConditionValueItem<TModule> *item = new SEQStepConditionValueItem<TModule>();
+            item->text = SeqCondition::Name((SeqCondition::Type)i);
+            item->module = module;
+            item->gridStep = gridStep;
+            item->condition.type = i;
+            menu->addChild(item);
+        }
+
+        menu->addChild(new MenuEntry);
+        MenuLabel *chanceLabel = new MenuLabel();
+        chanceLabel->text = "Chance";
+        menu->addChild(chanceLabel);
+        static const int chances[] = {100, 90, 75, 50, 25, 10};
+        for (int chance : chances)
+        {
+            SEQStepConditionValueItem<TModule> *item = new SEQStepConditionValueItem<TModule>();
+            item->text = string::f("%d%%", chance);
+            item->module = module;
+            item->gridStep = gridStep;
+            item->fields = Conditions::CHANCE;
+            item->condition.chance = chance;
+            menu->addChild(item);
+        }
+        return menu;
+    }
+};
+
+template <typename TModule>
+struct SEQPhraseValueItem : MenuItem
+{
+    TModule* module;
+    int phrase;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetPhrase(phrase);
+    }
+
+    void step() override
+    {
+        rightText = (module->m_engine.m_conditions.m_phrase == phrase) ? "✔" : "";
+    }
+};
+
+template <typename TModule>
+struct SEQPhraseItem : MenuItem
+{
+    TModule* module;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+        for (int i = 1; i <= SEQ_MAX_PHRASE; i++)
+        {
+            SEQPhraseValueItem<TModule> *item = new SEQPhraseValueItem<TModule>();
+            item->text = (i == 1) ? "1 loop" : string::f("%d loops", i);
+            item->module = module;
+            item->phrase = i;
+            menu->addChild(item);
+        }
+        return menu;
+    }
+};
+
+template <typename TModule>
+struct SEQFillItem : MenuItem
+{
+    TModule* module;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetFill(!module->m_fillLatched);
+    }
+
+    void step() override
+    {
+        rightText = module->m_fillLatched ? "✔" : "";
+    }
+};
+
+// The steps on the panel's current page, plus the phrase and fill
+template <typename TModule>
+struct SEQStepConditionsItem : MenuItem
+{
+    TModule* module;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+        SEQStepConditionItem<TModule> *allItem = new SEQStepConditionItem<TModule>();
+        allItem->text = "All steps";
+        allItem->rightText = RIGHT_ARROW;
+        allItem->module = module;
+        menu->addChild(allItem);
+
+        for (int cell = 0; cell < SEQ_PAGE_STEPS; cell++)
+        {
+            int step = TModule::PageStep(module->m_page, cell);
+            SEQStepConditionItem<TModule> *item = new SEQStepConditionItem<TModule>();
+            item->text = string::f("Step %d", step + 1);
+            item->rightText = RIGHT_ARROW;
+            item->module = module;
+            item->gridStep = step;
+            menu->addChild(item);
+        }
+
+        menu->addChild(new MenuEntry);
+        SEQPhraseItem<TModule> *phraseItem = new SEQPhraseItem<TModule>();
+        phraseItem->text = "Phrase length";
+        phraseItem->rightText = RIGHT_ARROW;
+        phraseItem->module = module;
+        menu->addChild(phraseItem);
+
+        SEQFillItem<TModule> *fillItem = new SEQFillItem<TModule>();
+        fillItem->text = "Fill";
+        fillItem->module = module;
+        menu->addChild(fillItem);
+        return menu;
+    }
+};
+
+template <typename TModule>
+struct SEQScaleValueItem : MenuItem
+{
+    TModule* module;
+    SeqScale::Scale scale;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetScale(scale);
+    }
+
+    void step() override
+    {
+        rightText = (module->m_scale == scale) ? "✔" : "";
+    }
+};
+
+template <typename TModule>
+struct SEQRootValueItem : MenuItem
+{
+    TModule* module;
+    int root;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetRoot(root);
+    }
+
+    void step() override
+    {
+        rightText = (module->m_root == root) ? "✔" : "";
+    }
+};
+
+template <typename TModule>
+struct SEQQuantizerCvValueItem : MenuItem
+{
+    TModule* module;
+    typename TModule::QuantizerCv quantizerCv;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetQuantizerCv(quantizerCv);
+    }
+
+    void step() override
+    {
+        rightText = (module->m_quantizerCv == quantizerCv) ? "✔" : "";
+    }
+};
+
+// Scale, root, and what the quantizer CV input sets
+template <typename TModule>
+struct SEQQuantizerItem : MenuItem
+{
+    TModule* module;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+        MenuLabel *scaleLabel = new MenuLabel();
+        scaleLabel->text = "Scale";
+        menu->addChild(scaleLabel);
+        for (int i = 0; i < SeqScale::NUM_SCALES; i++)
+        {
+            SEQScaleValueItem<TModule> *item = new SEQScaleValueItem<TModule>();
+            item->text = SeqScale::Name((SeqScale::Scale)i);
+            item->module = module;
+            item->scale = (SeqScale::Scale)i;
+            menu->addChild(item);
+        }
+
+        menu->addChild(new MenuEntry);
+        MenuLabel *rootLabel = new MenuLabel();
+        rootLabel->text = "Root";
+        menu->addChild(rootLabel);
+        for (int i = 0; i < 12; i++)
+        {
+            SEQRootValueItem<TModule> *item = new SEQRootValueItem<TModule>();
+            item->text = SeqScale::RootName(i);
+            item->module = module;
+            item->root = i;
+            menu->addChild(item);
+        }
+
+        menu->addChild(new MenuEntry);
+        MenuLabel *cvLabel = new MenuLabel();
+        cvLabel->text = "CV input";
+        menu->addChild(cvLabel);
+        static const char *const cvNames[TModule::NUM_QUANTIZER_CVS] = {"Root (1V/oct)", "Scale (0-10V)"};
+        for (int i = 0; i < TModule::NUM_QUANTIZER_CVS; i++)
+        {
+            SEQQuantizerCvValueItem<TModule> *item = new SEQQuantizerCvValueItem<TModule>();
+            item->text = cvNames[i];
+            item->module = module;
+            item->quantizerCv = (typename TModule::QuantizerCv)i;
+            menu->addChild(item);
+        }
+        return menu;
+    }
+};
+
+// Glide on or off for one step, or for every step when gridStep < 0
+template <typename TModule>
+struct SEQStepGlideItem : MenuItem
+{
+    TModule* module;
+    int gridStep = -1;
+    bool glide = true;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetGlideStep(gridStep, (gridStep < 0) ? glide : !module->m_glideSteps.Test(gridStep));
+    }
+
+    void step() override
+    {
+        if (gridStep >= 0)
+        {
+            rightText = module->m_glideSteps.Test(gridStep) ? "✔" : "";
+        }
+    }
+};
+
+template <typename TModule>
+struct SEQGlideTimeItem : MenuItem
+{
+    TModule* module;
+    float seconds;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetGlideTime(seconds);
+    }
+
+    void step() override
+    {
+        rightText = (module->m_glideTime == seconds) ? "✔" : "";
+    }
+};
+
+template <typename TModule>
+struct SEQGlideShapeItem : MenuItem
+{
+    TModule* module;
+    SeqGlide::Shape shape;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetGlideShape(shape);
+    }
+
+    void step() override
+    {
+        rightText = (module->m_glideShape == shape) ? "✔" : "";
+    }
+};
+
+// The steps on the panel's current page, plus the glide time and shape
+template <typename TModule>
+struct SEQGlideItem : MenuItem
+{
+    TModule* module;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+        static const char *const allNames[2] = {"All steps off", "All steps on"};
+        for (int i = 0; i < 2; i++)
+        {
+            SEQStepGlideItem<TModule> *item = new SEQStepGlideItem<TModule>();
+            item->text = allNames[i];
+            item->module = module;
+            item->glide = i;
+            menu->addChild(item);
+        }
+        for (int cell = 0; cell < SEQ_PAGE_STEPS; cell++)
+        {
+            int step = TModule::PageStep(module->m_page, cell);
+            SEQStepGlideItem<TModule> *item = new SEQStepGlideItem<TModule>();
+            item->text = string::f("Step %d", step + 1);
+            item->module = module;
+            item->gridStep = step;
+            menu->addChild(item);
+        }
+
+        menu->addChild(new MenuEntry);
+        MenuLabel *timeLabel = new MenuLabel();
+        timeLabel->text = "Time";
+        menu->addChild(timeLabel);
+        static const float times[] = {0.01f, 0.02f, 0.05f, 0.1f, 0.2f, 0.5f, 1.f, 2.f};
+        for (float seconds : times)
+        {
+            SEQGlideTimeItem<TModule> *item = new SEQGlideTimeItem<TModule>();
+            item->text = (seconds < 1.f) ? string::f("%g ms", 1000.f * seconds) : string::f("%g s", seconds);
+            item->module = module;
+            item->seconds = seconds;
+            menu->addChild(item);
+        }
+
+        menu->addChild(new MenuEntry);
+        MenuLabel *shapeLabel = new MenuLabel();
+        shapeLabel->text = "Shape";
+        menu->addChild(shapeLabel);
+        for (int i = 0; i < SeqGlide::NUM_SHAPES; i++)
+        {
+            SEQGlideShapeItem<TModule> *item = new SEQGlideShapeItem<TModule>();
+            item->text = SeqGlide::Name((SeqGlide::Shape)i);
+            item->module = module;
+            item->shape = (SeqGlide::Shape)i;
+            menu->addChild(item);
+        }
+        return menu;
+    }
+};
+
+template <typename TModule>
+struct SEQClockRatioItem : MenuItem
+{
+    TModule* module;
+    int ratio;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetClockRatio(ratio);
+    }
+
+    void step() override
+    {
+        rightText = (module->m_clockRatio == ratio) ? "✔" : "";
+    }
+};
+
+template <typename TModule>
+struct SEQSwingItem : MenuItem
+{
+    TModule* module;
+    float swing;
+    void onAction(const event::Action &e) override 
+    {
+        module->SetSwing(swing);
+    }
+
+    void step() override
+    {
+        rightText = (module->m_swing == swing) ? "✔" : "";
+    }
+};
+
+// Clock multiply or divide, then swing
+template <typename TModule>
+struct SEQClockItem : MenuItem
+{
+    TModule* module;
+    Menu *createChildMenu() override
+    {
+        Menu *menu = new Menu();
+        static const int ratios[] = {-16, -12, -8, -6, -4, -3, -2, 1, 2, 3, 4, 6, 8, 12, 16};
+        for (int ratio : ratios)
+        {
+            SEQClockRatioItem<TModule> *item = new SEQClockRatioItem<TModule>();
+            item->text = (ratio < 0) ? string::f("/%d", -ratio) : string::f("x%d", ratio);
+            item->module = module;
+            item->ratio = ratio;
+            menu->addChild(item);
+        }
+
+        menu->addChild(new MenuEntry);
+        MenuLabel *swingLabel = new MenuLabel();
+        swingLabel->text = "Swing";
+        menu->addChild(swingLabel);
+        static const float swings[] = {0.5f, 0.55f, 0.6f, 0.65f, 0.7f, 0.75f};
+        for (float swing : swings)
+        {
+            SEQSwingItem<TModule> *item = new SEQSwingItem<TModule>();
+            item->text = string::f("%g%%", std::round(100.f * swing));
+            item->module = module;
+            item->swing = swing;
+            menu->addChild(item);
+        }
+        return menu;
+    }
+};
+
+template <int W, int H>
+struct KSnoopySEQWidget : ModuleWidget 
+{
+    typedef KSnoopySEQ<W, H> TModule;
+
+    // The grid controls of the panel, rebound when the module changes page
+    ParamWidget *m_pitchKnobs[SEQ_PAGE_STEPS] = {};
+    ParamWidget *m_gateButtons[SEQ_PAGE_STEPS] = {};
+    ParamWidget *m_skipButtons[SEQ_PAGE_STEPS] = {};
+    int m_boundPage = 0;
+
+    KSnoopySEQWidget(TModule *module) 
+    {
+        setModule(module);
+        setPanel(APP->window->loadSvg(asset::plugin(pluginInstance, "res/Seq.svg")));
+
+        addChild(createWidget<ScrewSilver>(Vec(15, 0)));
+        addChild(createWidget<ScrewSilver>(Vec(box.size.x-30, 0)));
+        addChild(createWidget<ScrewSilver>(Vec(15, 365)));
+        addChild(createWidget<ScrewSilver>(Vec(box.size.x-30, 365)));
+
+        addParam(createParam<RoundBlackKnob>(Vec(18, 56), module, TModule::CLOCK_PARAM));
+        addParam(createParam<LEDButton>(Vec(60, 61-1), module, TModule::RUN_PARAM));
+        addChild(createLight<MediumLight<GreenLight>>(Vec(64.4f, 64.4f), module, TModule::RUNNING_LIGHT));
+        addParam(createParam<LEDButton>(Vec(99, 61-1), module, TModule::RESET_PARAM));
+        addChild(createLight<MediumLight<GreenLight>>(Vec(103.4f, 64.4f), module, TModule::RESET_LIGHT));
+        addParam(createParam<RoundBlackSnapKnob>(Vec(132, 56), module, TModule::STEPS_PARAM));
+        addChild(createLight<MediumLight<GreenLight>>(Vec(179.4f, 64.4f), module, TModule::GATE_X_OR_Y_LIGHT));
+        addChild(createLight<MediumLight<GreenLight>>(Vec(179.4f + 38.0f*1, 64.4f), module, TModule::GATE_X_LIGHT));
+        addChild(createLight<MediumLight<GreenLight>>(Vec(179.4f + 38.0f*2, 64.4f), module, TModule::GATE_Y_LIGHT));
+        addChild(createLight<MediumLight<GreenLight>>(Vec(179.4f + 38.0f*3, 64.4f), module, TModule::PITCH_LIGHT));
+
+        static const float portX[8] = {20, 58, 96, 135, 173, 212, 250, 289};
+        addInput(createInput<PJ301MPort>(Vec(portX[0]-1, 98), module, TModule::CLOCK_INPUT));
+        addInput(createInput<PJ301MPort>(Vec(portX[1]-1, 98), module, TModule::EXT_CLOCK_INPUT));
+        addInput(createInput<PJ301MPort>(Vec(portX[2]-1, 98), module, TModule::RESET_INPUT));
+        addInput(createInput<PJ301MPort>(Vec(portX[3]-1, 98), module, TModule::STEPS_INPUT));
+
+        addOutput(createOutput<PJ301MPort>(Vec(portX[4]-1, 98), module, TModule::GATE_XORY_OUTPUT));
+        addOutput(createOutput<PJ301MPort>(Vec(portX[5]-1, 98), module, TModule::GATE_X_OUTPUT));
+        addOutput(createOutput<PJ301MPort>(Vec(portX[6]-1, 98), module, TModule::GATE_Y_OUTPUT));
+        addOutput(createOutput<PJ301MPort>(Vec(portX[7]-1, 98), module, TModule::PITCH_OUTPUT));
+
+        addParam(createParam<RoundBlackKnob>(Vec(portX[7]-2, 148), module, TModule::PATTERN_PARAM));
+        addInput(createInput<PJ301MPort>(Vec(portX[7], 188), module, TModule::PATTERN_INPUT));
+        addInput(createInput<PJ301MPort>(Vec(portX[7], 238), module, TModule::BANK_INPUT));
+        addInput(createInput<PJ301MPort>(Vec(portX[7], 288), module, TModule::RANDOMIZE_INPUT));
+        addInput(createInput<PJ301MPort>(Vec(portX[7], 338), module, TModule::FILL_INPUT));
+
+        addInput(createInput<PJ301MPort>(Vec(portX[0]-1, 148), module, TModule::TRANSPOSE_INPUT));
+        addInput(createInput<PJ301MPort>(Vec(portX[0]-1, 188), module, TModule::GATE_OP_INPUT));
+        addInput(createInput<PJ301MPort>(Vec(portX[0]-1, 238), module, TModule::SKIP_OP_INPUT));
+        addInput(createInput<PJ301MPort>(Vec(portX[0]-1, 288), module, TModule::MASK_AMOUNT_INPUT));
+        addInput(createInput<PJ301MPort>(Vec(portX[0]-1, 338), module, TModule::QUANTIZER_INPUT));
+
+        const float btn_x[4] = {0+10*0, 38 + 10*1, 76 + 10*2, 115 + 10*3};
+        const float btn_y[4] = {0+10*0, 38 + 10*1, 76 + 10*2, 115 + 10*3};
+        int iZ = 0;
+        for (int iY = 0; iY < 4; iY++)
+        {
+            for (int iX = 0; iX < 4; iX++)
+            {
+                int x = btn_x[iX] + 80;
+                int y = btn_y[iY] + 167;
+                m_pitchKnobs[iZ] = createParam<RoundBlackKnob>(Vec(x-10, y-10), module, TModule::PITCH_PARAM + iZ);
+                addParam(m_pitchKnobs[iZ]);
+                addChild(createLight<MediumLight<GreenLight>>(Vec(x, y), module, TModule::GATE_PULSE_LIGHTS + iZ));
+
+                x -= 9;
+                y -= 3;
+                int radius = 13;
+                int xGateOn = x-radius;
+                int yGateOn = y-radius;
+                m_gateButtons[iZ] = createParam<LEDButton>(Vec(xGateOn, yGateOn), module, TModule::GATE_ON_PARAM + iZ);
+                addParam(m_gateButtons[iZ]);
+                addChild(createLight<MediumLight<GreenLight>>(Vec(xGateOn+4, yGateOn+4), module, TModule::IS_PITCH_ON_LIGHTS + iZ));
+
+                int xSkip = x-radius;
+                int ySkip = y+radius;
+                m_skipButtons[iZ] = createParam<LEDButton>(Vec(xSkip, ySkip), module, TModule::SKIP_PARAM + iZ);
+                addParam(m_skipButtons[iZ]);
+                addChild(createLight<MediumLight<GreenLight>>(Vec(xSkip+4, ySkip+4), module, TModule::SKIP_LIGHTS + iZ));
+
+                iZ++;
+            }
+        }
+    }
+
+    void BindPage(int page)
+    {
+        m_boundPage = page;
+        for (int i = 0; i < SEQ_PAGE_STEPS; i++)
+        {
+            int step = TModule::PageStep(page, i);
+            m_pitchKnobs[i]->paramQuantity = module->paramQuantities[TModule::PITCH_PARAM + step];
+            m_gateButtons[i]->paramQuantity = module->paramQuantities[TModule::GATE_ON_PARAM + step];
+            m_skipButtons[i]->paramQuantity = module->paramQuantities[TModule::SKIP_PARAM + step];
+        }
+    }
+
+    void step() override
+    {
+        TModule *module = dynamic_cast<TModule*>(this->module);
+        if (module && module->m_page != m_boundPage)
+        {
+            BindPage(module->m_page);
+        }
+        if (module)
+        {
+            module->FlushCommands();
+        }
+        ModuleWidget::step();
+    }
+
+    void appendContextMenu(Menu *menu) override 
+    {
+        TModule *module = dynamic_cast<TModule*>(this->module);
+
+        SEQActionItem<TModule> *triggerItem1 = new SEQActionItem<TModule>();
+        triggerItem1->text = "Randomize Pitch";
         triggerItem1->module = module;
         triggerItem1->randomPitch = true;
         menu->addChild(triggerItem1);
 
-        SEQActionItem *triggerItem2 = new SEQActionItem();
+        SEQActionItem<TModule> *triggerItem2 = new SEQActionItem<TModule>();
         triggerItem2->text = "Randomize Gate";
         triggerItem2->module = module;
         triggerItem2->randomGate = true;
         menu->addChild(triggerItem2);
 
-        SEQActionItem *triggerItem3 = new SEQActionItem();
+        SEQActionItem<TModule> *triggerItem3 = new SEQActionItem<TModule>();
         triggerItem3->text = "Randomize Skip";
         triggerItem3->module = module;
         triggerItem3->randomSkip = true;
         menu->addChild(triggerItem3);
 
-        // MenuLabel *modeLabel = new MenuLabel();
-        // modeLabel->text = "Gate Mode";
-        // menu->addChild(modeLabel);
+        SEQSeedItem<TModule> *seedItem = new SEQSeedItem<TModule>();
+        seedItem->text = "Random seed";
+        seedItem->rightText = RIGHT_ARROW;
+        seedItem->module = module;
+        menu->addChild(seedItem);
+
+        for (int i = 0; i < SeqMaskOp::NUM_TARGETS; i++)
+        {
+            SEQMaskItem<TModule> *maskItem = new SEQMaskItem<TModule>();
+            maskItem->text = (i == SeqMaskOp::GATES) ? "Gate mask" : "Skip mask";
+            maskItem->rightText = RIGHT_ARROW;
+            maskItem->module = module;
+            maskItem->target = (SeqMaskOp::Target)i;
+            menu->addChild(maskItem);
+        }
+
+        menu->addChild(new MenuEntry);
+
+        SEQUserPatternsItem<TModule> *userPatternsItem = new SEQUserPatternsItem<TModule>();
+        userPatternsItem->text = "User patterns";
+        userPatternsItem->rightText = RIGHT_ARROW;
+        userPatternsItem->module = module;
+        menu->addChild(userPatternsItem);
+
+        SEQBankItem<TModule> *bankItem = new SEQBankItem<TModule>();
+        bankItem->text = "Pattern bank";
+        bankItem->rightText = RIGHT_ARROW;
+        bankItem->module = module;
+        menu->addChild(bankItem);
+
+        SEQExportItem<TModule> *exportItem = new SEQExportItem<TModule>();
+        exportItem->text = "Export";
+        exportItem->rightText = RIGHT_ARROW;
+        exportItem->module = module;
+        menu->addChild(exportItem);
+
+        SEQLanesItem<TModule> *lanesItem = new SEQLanesItem<TModule>();
+        lanesItem->text = "Polyphonic lanes";
+        lanesItem->rightText = RIGHT_ARROW;
+        lanesItem->module = module;
+        menu->addChild(lanesItem);
+
+        if (TModule::kNumPages > 1)
+        {
+            SEQPageItem<TModule> *pageItem = new SEQPageItem<TModule>();
+            pageItem->text = "Grid page";
+            pageItem->rightText = RIGHT_ARROW;
+            pageItem->module = module;
+            menu->addChild(pageItem);
+        }
+
+        if (module->m_lanes.m_numLanes > 1)
+        {
+            for (int i = 0; i < module->m_lanes.m_numLanes; i++)
+            {
+                SEQLaneItem<TModule> *laneItem = new SEQLaneItem<TModule>();
+                laneItem->text = string::f("Lane %d", i + 1);
+                laneItem->rightText = RIGHT_ARROW;
+                laneItem->module = module;
+                laneItem->lane = i;
+                menu->addChild(laneItem);
+            }
+        }
+
+        menu->addChild(new MenuEntry);
+
+        MenuLabel *modeLabel = new MenuLabel();
+        modeLabel->text = "Gate Mode";
+        menu->addChild(modeLabel);
+
+        for (int i = 0; i < SeqGateMode::NUM_MODES; i++)
+        {
+            SEQGateModeItem<TModule> *modeItem = new SEQGateModeItem<TModule>();
+            modeItem->text = SeqGateMode::Name((SeqGateMode::Mode)i);
+            modeItem->module = module;
+            modeItem->gateMode = (SeqGateMode::Mode)i;
+            menu->addChild(modeItem);
+        }
+
+        SEQBandLimitedItem<TModule> *bandLimitedItem = new SEQBandLimitedItem<TModule>();
+        bandLimitedItem->text = "Band-limited gate edges";
+        bandLimitedItem->module = module;
+        menu->addChild(bandLimitedItem);
+
+        SEQStepGatesItem<TModule> *stepGatesItem = new SEQStepGatesItem<TModule>();
+        stepGatesItem->text = "Step gates";
+        stepGatesItem->rightText = RIGHT_ARROW;
+        stepGatesItem->module = module;
+        menu->addChild(stepGatesItem);
+
+        SEQStepConditionsItem<TModule> *stepConditionsItem = new SEQStepConditionsItem<TModule>();
+        stepConditionsItem->text = "Step conditions";
+        stepConditionsItem->rightText = RIGHT_ARROW;
+        stepConditionsItem->module = module;
+        menu->addChild(stepConditionsItem);
+
+        SEQQuantizerItem<TModule> *quantizerItem = new SEQQuantizerItem<TModule>();
+        quantizerItem->text = "Quantizer";
+        quantizerItem->rightText = RIGHT_ARROW;
+        quantizerItem->module = module;
+        menu->addChild(quantizerItem);
+
+        SEQGlideItem<TModule> *glideItem = new SEQGlideItem<TModule>();
+        glideItem->text = "Glide";
+        glideItem->rightText = RIGHT_ARROW;
+        glideItem->module = module;
+        menu->addChild(glideItem);
+
+        SEQClockItem<TModule> *clockItem = new SEQClockItem<TModule>();
+        clockItem->text = "Clock";
+        clockItem->rightText = RIGHT_ARROW;
+        clockItem->module = module;
+        menu->addChild(clockItem);
+
+        const SeqChain &chain = module->m_engine.m_chain;
+        if (chain.Chained())
+        {
+            int position = chain.m_following ? chain.m_in.hops + 2 : 1;
+            MenuLabel *chainLabel = new MenuLabel();
+            chainLabel->text = string::f("Chained, %d of %d%s", position, position - 1 + chain.m_length, chain.m_following ? " (on the leader's clock)" : "");
+            menu->addChild(chainLabel);
+        }
 
-        // SEQGateModeItem *triggerItem = new SEQGateModeItem();
-        // triggerItem->text = "Trigger";
-        // triggerItem->module = module;
-        // triggerItem->gateMode = KSnoopySEQ::TRIGGER;
-        // menu->addChild(triggerItem);
+        menu->addChild(new MenuEntry);
 
-        // SEQGateModeItem *retriggerItem = new SEQGateModeItem();
-        // retriggerItem->text = "Retrigger";
-        // retriggerItem->module = module;
-        // retriggerItem->gateMode = KSnoopySEQ::RETRIGGER;
-        // menu->addChild(retriggerItem);
+        SEQLightDivisionItem<TModule> *lightDivisionItem = new SEQLightDivisionItem<TModule>();
+        lightDivisionItem->text = "Light updates";
+        lightDivisionItem->rightText = RIGHT_ARROW;
+        lightDivisionItem->module = module;
+        menu->addChild(lightDivisionItem);
 
-        // SEQGateModeItem *continuousItem = new SEQGateModeItem();
-        // continuousItem->text = "Continuous";
-        // continuousItem->module = module;
-        // continuousItem->gateMode = KSnoopySEQ::CONTINUOUS;
-        // menu->addChild(continuousItem);
+        SEQTimingItem<TModule> *timingItem = new SEQTimingItem<TModule>();
+        timingItem->text = "Timing";
+        timingItem->rightText = RIGHT_ARROW;
+        timingItem->module = module;
+        menu->addChild(timingItem);
     }
 };
 
-Model* modelSeq = createModel<KSnoopySEQ, KSnoopySEQWidget>("KSnpy2DGridSeq");
\ No newline at end of file
+Model* modelSeq = createModel<KSnoopySEQ<4, 4>, KSnoopySEQWidget<4, 4>>("KSnpy2DGridSeq");
+Model* modelSeq8x8 = createModel<KSnoopySEQ<8, 8>, KSnoopySEQWidget<8, 8>>("KSnpy2DGridSeq8x8");
+Model* modelSeq16x16 = createModel<KSnoopySEQ<16, 16>, KSnoopySEQWidget<16, 16>>("KSnpy2DGridSeq16x16");
\ No newline at end of file
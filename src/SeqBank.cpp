@@ -0,0 +1,175 @@
+#include "SeqBank.hpp"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool SeqMappedFile::Open(const std::string &path)
+{
+    Close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping)
+    {
+        return false;
+    }
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+    m_mapping = mapping;
+    m_data = (const uint8_t *)data;
+    m_size = (size_t)size.QuadPart;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+    m_data = (const uint8_t *)data;
+    m_size = st.st_size;
+#endif
+    return true;
+}
+
+void SeqMappedFile::Close()
+{
+    if (!m_data)
+    {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping);
+    m_mapping = nullptr;
+#else
+    munmap((void *)m_data, m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+
+void SeqMappedFile::Prefault() const
+{
+    volatile uint8_t sum = 0;
+    for (size_t i = 0; i < m_size; i += 4096)
+    {
+        sum += m_data[i];
+    }
+    (void)sum;
+}
+
+template <int W, int H>
+bool SeqBank<W, H>::Load(const std::string &path)
+{
+    m_path = path;
+    m_slots = nullptr;
+    m_numSlots = 0;
+    if (!m_file.Open(path))
+    {
+        return false;
+    }
+
+    SeqBankHeader header;
+    if (m_file.m_size < sizeof(header))
+    {
+        m_file.Close();
+        return false;
+    }
+    header = *(const SeqBankHeader *)m_file.m_data;
+    if (header.magic != SEQ_BANK_MAGIC || header.version != SEQ_BANK_VERSION || header.width != W ||
+        header.height != H || header.slotSize != sizeof(Slot) ||
+        m_file.m_size < sizeof(header) + (size_t)header.numSlots * sizeof(Slot))
+    {
+        m_file.Close();
+        return false;
+    }
+
+    m_file.Prefault();
+    m_slots = (const Slot *)(m_file.m_data + sizeof(header));
+    m_numSlots = header.numSlots;
+    return true;
+}
+
+template <int W, int H>
+bool SeqBank<W, H>::Write(const std::string &path, const std::vector<Slot> &slots)
+{
+    return WriteTemp(path, slots) && Replace(path);
+}
+
+template <int W, int H>
+bool SeqBank<W, H>::WriteTemp(const std::string &path, const std::vector<Slot> &slots)
+{
+    std::string tempPath = TempPath(path);
+    FILE *file = std::fopen(tempPath.c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    SeqBankHeader header = {SEQ_BANK_MAGIC, SEQ_BANK_VERSION, W, H, (uint32_t)slots.size(), sizeof(Slot), 0};
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    if (ok && !slots.empty())
+    {
+        ok = std::fwrite(slots.data(), sizeof(Slot), slots.size(), file) == slots.size();
+    }
+    ok = (std::fclose(file) == 0) && ok;
+    if (!ok)
+    {
+        std::remove(tempPath.c_str());
+    }
+    return ok;
+}
+
+template <int W, int H>
+bool SeqBank<W, H>::Replace(const std::string &path)
+{
+    std::string tempPath = TempPath(path);
+#ifdef _WIN32
+    bool ok = MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+    bool ok = std::rename(tempPath.c_str(), path.c_str()) == 0;
+#endif
+    if (!ok)
+    {
+        std::remove(tempPath.c_str());
+    }
+    return ok;
+}
+
+#define SEQ_INSTANTIATE(W, H) template struct SeqBank<W, H>;
+SEQ_FOR_EACH_GRID(SEQ_INSTANTIATE)
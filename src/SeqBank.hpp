@@ -0,0 +1,129 @@
+#pragma once
+
+// Pattern bank: hundreds of full grid snapshots in one binary file, mapped
+// into memory rather than parsed.  Loading a bank costs an open and an mmap
+// whatever its size, and recalling a slot is a plain copy out of the
+// mapping, so the audio thread can switch sections at a step boundary
+// without allocating.
+//
+// File layout, in host byte order: a SeqBankHeader, then numSlots fixed-size
+// SeqBankSlots.  Files written for another grid size are rejected.
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SeqGrid.hpp"
+
+#define SEQ_BANK_MAGIC 0x4b42534bu // "KSBK"
+#define SEQ_BANK_VERSION 1
+#define SEQ_BANK_EXTENSION ".ksbank"
+
+struct SeqBankHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint16_t width;
+    uint16_t height;
+    uint32_t numSlots;
+    uint32_t slotSize;
+    uint32_t reserved;
+};
+
+// One grid as the panel has it: the knob values and both masks
+template <int W, int H>
+struct SeqBankSlot
+{
+    typedef typename SeqGrid<W, H>::Mask Mask;
+
+    float pitches[W * H];
+    uint64_t pitchOn[Mask::kWords];
+    uint64_t skip[Mask::kWords];
+    float pattern; // PATTERN and STEPS knob values
+    float steps;
+
+    static Mask ToMask(const uint64_t *words)
+    {
+        Mask mask;
+        std::copy(words, words + Mask::kWords, mask.m_words);
+        return mask;
+    }
+
+    static void FromMask(const Mask &mask, uint64_t *words)
+    {
+        std::copy(mask.m_words, mask.m_words + Mask::kWords, words);
+    }
+};
+
+// A read-only mapping of a whole file
+struct SeqMappedFile
+{
+    const uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void *m_mapping = nullptr;
+#endif
+
+    SeqMappedFile() = default;
+    SeqMappedFile(const SeqMappedFile &) = delete;
+    SeqMappedFile &operator=(const SeqMappedFile &) = delete;
+
+    ~SeqMappedFile()
+    {
+        Close();
+    }
+
+    bool Open(const std::string &path);
+    void Close();
+
+    // Touches every page so the audio thread never takes a page fault
+    void Prefault() const;
+};
+
+template <int W, int H>
+struct SeqBank
+{
+    typedef SeqBankSlot<W, H> Slot;
+
+    std::string m_path;
+    SeqMappedFile m_file;
+    const Slot *m_slots = nullptr;
+    int m_numSlots = 0;
+
+    // UI thread.  Maps the file at `path`, or returns false and leaves the
+    // bank empty if it is missing or isn't a bank for this grid size.
+    bool Load(const std::string &path);
+
+    // UI thread.  Writes `slots` to `path` through a temporary file, so a
+    // bank mapped from `path` stays intact until it is replaced.
+    static bool Write(const std::string &path, const std::vector<Slot> &slots);
+
+    // Write() in two halves: the temporary file, then moving it onto `path`.
+    // Windows can't replace a file that is mapped, so every bank loaded from
+    // `path` has to be closed before Replace().
+    static bool WriteTemp(const std::string &path, const std::vector<Slot> &slots);
+    static bool Replace(const std::string &path);
+
+    static std::string TempPath(const std::string &path)
+    {
+        return path + ".tmp";
+    }
+
+    int NumSlots() const
+    {
+        return m_numSlots;
+    }
+
+    const Slot &GetSlot(int slot) const
+    {
+        return m_slots[slot];
+    }
+
+    // 0-10V across all the slots
+    int SlotFromCv(float cv) const
+    {
+        int slot = (int)(cv * m_numSlots / 10.f);
+        return (slot < 0) ? 0 : (slot >= m_numSlots) ? m_numSlots - 1 : slot;
+    }
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+// Chaining sequencers placed side by side into one long sequence.  The
+// leftmost runs the clock; each module passes the modules to its right the
+// leader's clock state and tick count (a Rack expander message, so a sample
+// later per module) and the others work out from it where the leader's
+// clock is now.  Ticks the leader could predict, from its internal clock or
+// between the edges of a multiplied external one, land on the same sample
+// in every module; ticks it couldn't, an external edge, come a sample per
+// module late, as they would through a cable.
+//
+// Only one module plays at a time.  When the one playing is about to wrap
+// its pattern it says at which tick, and the next module to the right (or
+// the leader, from the right end) takes over at that tick, so the hand-off
+// needs no more than a step's notice.  A reset at the leader starts the
+// whole chain again from its first step.
+
+#include <cstdint>
+
+#include "SeqClock.hpp"
+
+#define SEQ_CHAIN_NEVER UINT64_MAX
+
+// Sent each sample from a module to the one on its right
+struct SeqChainMessage
+{
+    bool valid = false;
+    int hops = 0; // modules between the leader and the sender
+
+    // The leader's clock as it was when the leader sent it
+    SeqClock clock;
+    uint64_t phaseAcc = 0;
+    uint64_t phaseInc = 0; // 0 when its ticks can't be predicted
+    bool synced = false;
+    bool running = true;
+    bool gate = false; // for a clock that can't be predicted
+    uint64_t ticks = 0;
+    uint32_t resets = 0;
+
+    // The tick at which the sender hands on to the receiver
+    uint64_t passAt = SEQ_CHAIN_NEVER;
+};
+
+// Sent each sample from a module to the one on its left
+struct SeqChainReply
+{
+    // The tick at which the chain's right end hands back to the leader
+    uint64_t returnAt = SEQ_CHAIN_NEVER;
+    int length = 0; // modules from the sender to the right end
+};
+
+// One module's place in a chain, kept by its engine
+struct SeqChain
+{
+    bool m_following = false; // a module on the left runs the clock
+    bool m_hasNext = false;   // a module on the right to hand on to
+    SeqChainMessage m_in;
+    SeqChainReply m_reply;
+
+    int m_length = 1; // modules from this one to the right end
+
+    bool m_playing = true; // this module's turn
+    uint64_t m_ticks = 0;  // the leader's ticks, as far as this module knows
+    uint32_t m_resets = 0;
+    uint64_t m_passAt = SEQ_CHAIN_NEVER;
+
+    bool Chained() const
+    {
+        return m_following || m_hasNext;
+    }
+
+    // When this module takes over
+    uint64_t TakeAt() const
+    {
+        return m_following ? m_in.passAt : m_reply.returnAt;
+    }
+
+    // What it tells the module on its left: its own hand-off at the right end
+    SeqChainReply Reply() const
+    {
+        SeqChainReply reply;
+        reply.returnAt = m_hasNext ? m_reply.returnAt : m_passAt;
+        reply.length = m_length;
+        return reply;
+    }
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+// Clock multiply/divide and swing for SeqEngine.  The engine's phase runs
+// over a pair of ticks: the on-beat at 0 and the off-beat at m_offbeat,
+// which swing moves later than halfway.  A tick is m_divide clock periods,
+// and the internal clock's phase increment is m_multiply times its rate, so
+// multiplied and divided ticks stay exact integers like the plain clock.
+//
+// With an external clock the period between its edges is measured, and the
+// phase increment for the ticks between them worked out once per edge.
+// Every edge (or every m_divide-th) is a sync: it starts a group of
+// m_multiply ticks, the ones after the first predicted from the measured
+// period.  A group whose ticks are done waits for the next sync, and a sync
+// that comes early cuts the group short.  At 1x with no swing the external
+// clock drives steps edge for edge, as it always has.
+
+#include <cstdint>
+
+#define SEQ_CLOCK_MAX_RATIO 16
+#define SEQ_MAX_SWING 0.75f
+
+struct SeqClock
+{
+    int m_multiply = 1;
+    int m_divide = 1;
+    float m_swing = 0.5f; // where the off-beat falls in a pair, 0.5 is straight
+
+    // In the engine's phase units, for its current period
+    uint64_t m_tick = 0;    // one straight tick
+    uint64_t m_offbeat = 0; // the second tick of a pair
+    uint64_t m_pair = 0;
+
+    // External clock, timed in samples
+    double m_lastEdge = -1.0;
+    uint64_t m_extInc = 0; // phase per sample, 0 until a period was measured
+    int m_extEdges = 0;    // since the last sync
+    int m_groupTicks = 0;  // ticks since the last sync
+    bool m_groupOdd = false; // the next group starts on an off-beat
+    bool m_waiting = false;  // the group's ticks are done
+
+    // The external clock steps edge for edge
+    bool Straight() const
+    {
+        return m_multiply == 1 && m_divide == 1 && m_swing == 0.5f;
+    }
+
+    // ratio > 0 multiplies, < 0 divides
+    static int Ratio(int multiply, int divide)
+    {
+        return (divide > 1) ? -divide : multiply;
+    }
+
+    void Set(int ratio, float swing, uint64_t period)
+    {
+        ratio = (ratio < -SEQ_CLOCK_MAX_RATIO) ? -SEQ_CLOCK_MAX_RATIO : (ratio > SEQ_CLOCK_MAX_RATIO) ? SEQ_CLOCK_MAX_RATIO : ratio;
+        m_multiply = (ratio > 1) ? ratio : 1;
+        m_divide = (ratio < -1) ? -ratio : 1;
+        m_swing = (swing < 0.5f) ? 0.5f : (swing > SEQ_MAX_SWING) ? SEQ_MAX_SWING : swing;
+        m_lastEdge = -1.0;
+        m_extInc = 0;
+        Restart();
+        Update(period);
+    }
+
+    void Update(uint64_t period)
+    {
+        m_tick = period * m_divide;
+        m_pair = 2 * m_tick;
+        m_offbeat = (uint64_t)((double)m_pair * m_swing);
+    }
+
+    // At a reset, which is the first tick of a group
+    void Restart()
+    {
+        m_extEdges = 0;
+        m_groupTicks = 1;
+        m_groupOdd = m_multiply & 1;
+        m_waiting = false;
+    }
+
+    // The gate is high for the first half of each straight tick
+    bool GateHigh(uint64_t acc) const
+    {
+        uint64_t half = m_tick / 2;
+        return acc < half || (acc >= m_offbeat && acc - m_offbeat < half);
+    }
+
+    // Where the gate next falls from `acc`, or 0 when it is already low
+    uint64_t GateFall(uint64_t acc) const
+    {
+        uint64_t half = m_tick / 2;
+        return (acc < half) ? half : (acc >= m_offbeat && acc - m_offbeat < half) ? m_offbeat + half : 0;
+    }
+
+    // The next tick from `acc`
+    uint64_t NextTick(uint64_t acc) const
+    {
+        return (acc < m_offbeat) ? m_offbeat : m_pair;
+    }
+
+    // Moves `acc` on a sample.  True when it crosses a tick, with `over`
+    // how far past it.  A synced group whose ticks are done holds just
+    // short of the tick instead, until the next sync.
+    bool Advance(uint64_t &acc, uint64_t inc, bool synced, uint64_t &over)
+    {
+        uint64_t tick = NextTick(acc);
+        acc += inc;
+        if (acc < tick)
+        {
+            return false;
+        }
+        if (synced && m_groupTicks >= m_multiply)
+        {
+            acc = tick - 1;
+            m_waiting = true;
+            return false;
+        }
+        over = acc - tick;
+        if (tick == m_pair)
+        {
+            acc = over;
+        }
+        if (acc >= m_pair)
+        {
+            // faster than the sample rate, at most one step per sample
+            acc %= m_pair;
+        }
+        m_groupTicks++;
+        return true;
+    }
+};
@@ -0,0 +1,96 @@
+#include "SeqConditions.hpp"
+
+const char *SeqCondition::Name(Type type)
+{
+    static const char *const names[NUM_TYPES] = {
+        "Always",
+        "Loop a of every b",
+        "First loop of phrase",
+        "Not first loop",
+        "Last loop of phrase",
+        "Not last loop",
+        "Fill",
+        "Not fill"
+    };
+    return names[type];
+}
+
+template <int W, int H>
+void SeqConditions<W, H>::Set(int step, const SeqCondition &condition, int fields)
+{
+    int first = (step < 0) ? 0 : step;
+    int last = (step < 0) ? Grid::kSteps - 1 : step;
+    for (int i = first; i <= last; i++)
+    {
+        SeqCondition &target = m_steps[i];
+        if (fields & WHEN)
+        {
+            target.type = condition.type;
+            target.a = condition.a;
+            target.b = condition.b;
+        }
+        if (fields & CHANCE)
+        {
+            target.chance = condition.chance;
+        }
+    }
+
+    m_numConditions = 0;
+    for (int i = 0; i < Grid::kSteps; i++)
+    {
+        m_numConditions += !m_steps[i].Always();
+    }
+    Evaluate();
+}
+
+template <int W, int H>
+void SeqConditions<W, H>::SetAll(const SeqCondition *conditions)
+{
+    m_numConditions = 0;
+    for (int i = 0; i < Grid::kSteps; i++)
+    {
+        m_steps[i] = conditions[i];
+        m_numConditions += !m_steps[i].Always();
+    }
+    Evaluate();
+}
+
+template <int W, int H>
+void SeqConditions<W, H>::SetPhrase(int phrase)
+{
+    m_phrase = (phrase < 1) ? 1 : (phrase > SEQ_MAX_PHRASE) ? SEQ_MAX_PHRASE : phrase;
+    Evaluate();
+}
+
+template <int W, int H>
+void SeqConditions<W, H>::Evaluate()
+{
+    if (m_numConditions == 0)
+    {
+        m_play[0].SetAll();
+        m_play[1].SetAll();
+        return;
+    }
+
+    for (int fill = 0; fill < 2; fill++)
+    {
+        Mask &play = m_play[fill];
+        for (int w = 0; w < Mask::kWords; w++)
+        {
+            int count = (Grid::kSteps - 64 * w < 64) ? Grid::kSteps - 64 * w : 64;
+            uint64_t word = 0;
+            for (int b = 0; b < count; b++)
+            {
+                int step = 64 * w + b;
+                const SeqCondition &condition = m_steps[step];
+                bool plays = condition.Test(m_loop, m_phrase, fill) &&
+                             Roll(step) < ((uint64_t)condition.chance << 32) / 100;
+                word |= (uint64_t)plays << b;
+            }
+            play.m_words[w] = word;
+        }
+    }
+}
+
+#define SEQ_INSTANTIATE(W, H) template struct SeqConditions<W, H>;
+SEQ_FOR_EACH_GRID(SEQ_INSTANTIATE)
@@ -0,0 +1,158 @@
+#pragma once
+
+// Per-step trig conditions and probability.  A step can be limited to loop
+// a of every b, the first or last loop of a phrase, or to playing only with
+// or without fill, and given a chance of playing.  They're evaluated once
+// per loop of the pattern into two masks, without and with fill, so while
+// the loop plays a step's fate is a bit test.  Chances take one draw per
+// loop, which seeds a hash per step, so editing a step re-evaluates the loop
+// without drawing again.  Loops are counted from the last reset.
+
+#include <cstdint>
+
+#include "SeqGrid.hpp"
+#include "SeqRandom.hpp"
+
+#define SEQ_MAX_RATIO 8
+#define SEQ_MAX_PHRASE 16
+#define SEQ_DEFAULT_PHRASE 4
+
+struct SeqCondition
+{
+    enum Type
+    {
+        ALWAYS,
+        RATIO,     // loop a of every b
+        FIRST,     // first loop of each phrase
+        NOT_FIRST,
+        LAST,      // last loop of each phrase
+        NOT_LAST,
+        FILL,      // only while fill is on
+        NOT_FILL,
+        NUM_TYPES
+    };
+
+    uint8_t type = ALWAYS;
+    uint8_t a = 1;
+    uint8_t b = 1;
+    uint8_t chance = 100; // percent
+
+    static const char *Name(Type type);
+
+    bool operator==(const SeqCondition &other) const
+    {
+        return type == other.type && a == other.a && b == other.b && chance == other.chance;
+    }
+
+    // Plays every loop, draws nothing
+    bool Always() const
+    {
+        return type == ALWAYS && chance >= 100;
+    }
+
+    bool Test(int loop, int phrase, bool fill) const
+    {
+        switch (type)
+        {
+            case RATIO: return loop % b == a - 1;
+            case FIRST: return loop % phrase == 0;
+            case NOT_FIRST: return loop % phrase != 0;
+            case LAST: return loop % phrase == phrase - 1;
+            case NOT_LAST: return loop % phrase != phrase - 1;
+            case FILL: return fill;
+            case NOT_FILL: return !fill;
+            default: return true;
+        }
+    }
+
+    // 16 bits: type, a - 1 and b - 1 in 3 bits each, then the chance
+    uint16_t Pack() const
+    {
+        return type | (a - 1) << 3 | (b - 1) << 6 | chance << 9;
+    }
+
+    static SeqCondition Unpack(uint16_t packed)
+    {
+        SeqCondition condition;
+        condition.type = (packed & 7) < NUM_TYPES ? packed & 7 : ALWAYS;
+        condition.b = ((packed >> 6) & 7) + 1;
+        condition.a = ((packed >> 3) & 7) + 1;
+        condition.a = (condition.a <= condition.b) ? condition.a : condition.b;
+        condition.chance = (packed >> 9) <= 100 ? packed >> 9 : 100;
+        return condition;
+    }
+};
+
+template <int W, int H>
+struct SeqConditions
+{
+    typedef SeqGrid<W, H> Grid;
+    typedef typename Grid::Mask Mask;
+
+    SeqCondition m_steps[W * H];
+    int m_phrase = SEQ_DEFAULT_PHRASE;
+    int m_loop = 0;
+    uint32_t m_loopSeed = 0;
+    int m_numConditions = 0; // steps that aren't Always()
+
+    // This loop's steps that play, without and with fill
+    Mask m_play[2];
+
+    SeqConditions()
+    {
+        m_play[0].SetAll();
+        m_play[1].SetAll();
+    }
+
+    bool Plays(int step, bool fill) const
+    {
+        return m_play[fill].Test(step);
+    }
+
+    // What Set() copies from the condition it is given
+    enum Fields
+    {
+        WHEN = 1 << 0, // type, a and b
+        CHANCE = 1 << 1
+    };
+
+    // step < 0 sets every step
+    void Set(int step, const SeqCondition &condition, int fields = WHEN | CHANCE);
+    void SetAll(const SeqCondition *conditions);
+    void SetPhrase(int phrase);
+
+    // At a reset, and each time the pattern wraps
+    void Restart(SeqRandom &random)
+    {
+        StartLoop(0, random);
+    }
+
+    void NextLoop(SeqRandom &random)
+    {
+        StartLoop(m_loop + 1, random);
+    }
+
+    void StartLoop(int loop, SeqRandom &random)
+    {
+        m_loop = loop;
+        if (m_numConditions > 0)
+        {
+            m_loopSeed = random.Next();
+            Evaluate();
+        }
+    }
+
+    // Step `step`'s roll this loop, 0 to 2^32 - 1
+    uint32_t Roll(int step) const
+    {
+        uint32_t h = m_loopSeed ^ ((uint32_t)step * 0x9e3779b9u);
+        h ^= h >> 16;
+        h *= 0x85ebca6bu;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35u;
+        return h ^ (h >> 16);
+    }
+
+    // Rebuilds m_play for m_loop and m_loopSeed
+    void Evaluate();
+};
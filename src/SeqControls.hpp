@@ -0,0 +1,106 @@
+#pragma once
+
+// Panel controls as the audio thread sees them.  Knobs and buttons are
+// scanned once per UI block rather than every sample, and a scan only marks
+// what actually moved as dirty.  While no CV is patched the engine's inputs
+// are then known not to have changed, so it isn't even asked to compare
+// them; with CV patched it compares them, and still coasts between clock
+// edges.  The pitch of the playing step is cached until the step changes or
+// a scan finds its knob was turned.
+
+#include <cstdint>
+
+#include "SeqEngine.hpp"
+
+template <int W, int H>
+struct SeqControls
+{
+    enum Knob
+    {
+        RUN,
+        CLOCK,
+        RESET,
+        STEPS,
+        PATTERN,
+        NUM_KNOBS
+    };
+
+    enum DirtyBits
+    {
+        KNOBS_DIRTY = 1 << 0,
+        PITCH_DIRTY = 1 << 1
+    };
+
+    float m_knobs[NUM_KNOBS] = {};
+    uint32_t m_dirty = KNOBS_DIRTY | PITCH_DIRTY;
+
+    // Any of the inputs that feed the engine patched, as of the last scan
+    bool m_cvPatched = false;
+
+    // The knob half of the engine's inputs, rebuilt only when a knob moved
+    SeqInputs m_knobInputs;
+
+    int m_pitchStep = -1;
+    float m_pitchKnob = 0.f; // m_pitchStep's knob when m_pitch was set
+    float m_pitch = 0.f;     // what that knob gives, after quantizing
+
+    // Scan side
+    void SetKnob(Knob knob, float value)
+    {
+        if (value != m_knobs[knob])
+        {
+            m_knobs[knob] = value;
+            m_dirty |= KNOBS_DIRTY;
+        }
+    }
+
+    void SetCvPatched(bool cvPatched)
+    {
+        if (cvPatched != m_cvPatched)
+        {
+            m_cvPatched = cvPatched;
+            m_dirty |= KNOBS_DIRTY;
+        }
+    }
+
+    // The knob of m_pitchStep as of this scan
+    void ScanPitch(float value)
+    {
+        if (value != m_pitchKnob)
+        {
+            m_dirty |= PITCH_DIRTY;
+        }
+    }
+
+    // Per sample: brings m_knobInputs up to date and says whether it changed
+    // since the last call.  With CV patched the caller adds it on top, and
+    // the sum has to be compared instead.
+    bool UpdateKnobInputs()
+    {
+        if (!(m_dirty & KNOBS_DIRTY))
+        {
+            return false;
+        }
+        m_knobInputs.run = m_knobs[RUN];
+        m_knobInputs.clock = m_knobs[CLOCK];
+        m_knobInputs.reset = m_knobs[RESET];
+        m_knobInputs.steps = m_knobs[STEPS];
+        m_knobInputs.pattern = m_knobs[PATTERN];
+        m_dirty &= ~KNOBS_DIRTY;
+        return true;
+    }
+
+    // Per sample: true when the pitch has to be re-read for `step`
+    bool PitchStale(int step) const
+    {
+        return step != m_pitchStep || (m_dirty & PITCH_DIRTY);
+    }
+
+    void SetPitch(int step, float knob, float pitch)
+    {
+        m_pitchStep = step;
+        m_pitchKnob = knob;
+        m_pitch = pitch;
+        m_dirty &= ~PITCH_DIRTY;
+    }
+};
@@ -0,0 +1,665 @@
+#include "SeqEngine.hpp"
+#include <algorithm>
+
+static int ClampInt(int x, int a, int b)
+{
+    return std::max(a, std::min(x, b));
+}
+
+static float ClampFloat(float x, float a, float b)
+{
+    return std::max(a, std::min(x, b));
+}
+
+const char *SeqMaskOp::Name(Type type)
+{
+    static const char *const names[NUM_TYPES] =
+    {
+        "Invert",
+        "Rotate right",
+        "Rotate left",
+        "Shift right",
+        "Shift left",
+        "Euclidean fill",
+        "Random fill"
+    };
+    return (type >= 0 && type < NUM_TYPES) ? names[type] : "";
+}
+
+template <int W, int H>
+SeqEngine<W, H>::SeqEngine()
+{
+    m_clock.Update(m_period);
+    Reset();
+}
+
+template <int W, int H>
+void SeqEngine<W, H>::Reset()
+{
+    m_pitchOn.SetAll();
+    m_skip.Clear();
+    BreakRun();
+}
+
+// Samples (0-1) since `threshold` was crossed between the last sample and
+// this one, assuming the input moved in a straight line
+static float CrossingOffset(float last, float cur, float threshold)
+{
+    float delta = cur - last;
+    return (delta != 0.f) ? ClampFloat((cur - threshold) / delta, 0.f, 1.f) : 0.f;
+}
+
+// Sample rates are whole numbers of Hz, so the period is exact
+template <int W, int H>
+void SeqEngine<W, H>::SetSampleTime(float sampleTime)
+{
+    if (sampleTime != m_sampleTime)
+    {
+        double phase = (double)m_phaseAcc / (double)m_period;
+        m_sampleTime = sampleTime;
+        m_period = (uint64_t)std::max(1L, std::lround(1.0 / sampleTime)) << 32;
+        m_phaseAcc = (uint64_t)(phase * (double)m_period);
+        m_clock.Update(m_period);
+        m_clock.m_extInc = 0;
+        m_clock.m_lastEdge = -1.0;
+    }
+}
+
+// Keeps the phase where it was in the pair of ticks
+template <int W, int H>
+void SeqEngine<W, H>::SetClock(int ratio, float swing)
+{
+    double phase = (double)m_phaseAcc / (double)m_clock.m_pair;
+    m_clockRatio = ratio;
+    m_swing = swing;
+    m_clock.Set(ratio, swing, m_period);
+    m_phaseAcc = (uint64_t)(phase * (double)m_clock.m_pair);
+    m_clockOctaves = NAN;
+    BreakRun();
+}
+
+template <int W, int H>
+float SeqEngine<W, H>::ClockRate(float octaves)
+{
+    if (octaves != m_clockOctaves)
+    {
+        m_clockOctaves = octaves;
+        m_clockRate = std::pow(2.f, octaves);
+        m_phaseInc = std::max((uint64_t)1, (uint64_t)std::llround((double)m_clockRate * 4294967296.0)) * m_clock.m_multiply;
+    }
+    return m_clockRate;
+}
+
+// An external clock edge times the clock's period and, at a sync, starts
+// the next group of ticks.  `started` says whether it did, and it returns
+// true when that fires a tick.
+template <int W, int H>
+bool SeqEngine<W, H>::SyncToExtClock(const SeqInputs &in, bool &started)
+{
+    started = false;
+    if (!m_clockTrigger.Process(in.extClock))
+    {
+        return false;
+    }
+    float offset = CrossingOffset(m_lastExtClock, in.extClock, 1.f);
+    double edge = (double)m_now - offset;
+    if (m_clock.m_lastEdge >= 0.0)
+    {
+        double period = edge - m_clock.m_lastEdge;
+        m_clock.m_extInc = std::max((uint64_t)1, (uint64_t)std::llround((double)m_period * m_clock.m_multiply / period));
+    }
+    m_clock.m_lastEdge = edge;
+    if (++m_clock.m_extEdges < m_clock.m_divide)
+    {
+        return false;
+    }
+
+    // The group starts here, on the on-beat or where a straight off-beat
+    // would be, so a swung off-beat still comes later
+    bool odd = m_clock.m_groupOdd;
+    uint64_t inc = m_clock.m_extInc;
+    started = true;
+    m_clock.m_extEdges = 0;
+    m_clock.m_groupOdd ^= (m_clock.m_multiply & 1);
+    m_clock.m_groupTicks = 0;
+    m_clock.m_waiting = false;
+    m_phaseAcc = (odd ? m_clock.m_tick : 0) + (uint64_t)(offset * (double)inc);
+    uint64_t tick = odd ? m_clock.m_offbeat : 0;
+    if (m_phaseAcc < tick)
+    {
+        return false;
+    }
+    m_edgeOffset = (inc > 0) ? std::min(1.f, (float)((double)(m_phaseAcc - tick) / (double)inc)) : offset;
+    m_clock.m_groupTicks = 1;
+    return true;
+}
+
+// Where the leader's clock is now: its state as it was sent, moved on by
+// the samples since, the last of them this one.  True when the leader ticks
+// this sample, or ticked earlier where it couldn't be seen coming.
+template <int W, int H>
+bool SeqEngine<W, H>::FollowChain(bool &gateIn)
+{
+    const SeqChainMessage &in = m_chain.m_in;
+    m_clock = in.clock;
+    m_phaseAcc = in.phaseAcc;
+    uint64_t ticks = in.ticks;
+    bool tick = false;
+    if (in.phaseInc > 0)
+    {
+        for (int i = 0; i <= in.hops; i++)
+        {
+            tick = !m_clock.m_waiting && AdvancePhase(in.phaseInc, in.synced);
+            ticks += tick;
+        }
+        gateIn = m_clock.GateHigh(m_phaseAcc);
+        if (m_clock.m_waiting)
+        {
+            m_gateLevel = gateIn ? 1.f : 0.f;
+        }
+    }
+    else
+    {
+        gateIn = in.gate;
+        m_gateLevel = gateIn ? 1.f : 0.f;
+    }
+
+    if (in.resets != m_chain.m_resets)
+    {
+        // The chain starts again at the leader, this module's turn comes later
+        m_chain.m_resets = in.resets;
+        m_chain.m_ticks = ticks;
+        m_chain.m_playing = false;
+        m_chain.m_passAt = SEQ_CHAIN_NEVER;
+        m_currentPatternIndex = -1;
+        RestartConditions();
+        return false;
+    }
+    if (ticks <= m_chain.m_ticks)
+    {
+        return false;
+    }
+
+    // At most one a sample when catching up
+    m_chain.m_ticks++;
+    if (!tick)
+    {
+        m_edgeOffset = 0.f;
+    }
+    return true;
+}
+
+// Moves the phase on a sample, carrying the overshoot past a tick into the
+// next one.  True when a tick fires.
+template <int W, int H>
+bool SeqEngine<W, H>::AdvancePhase(uint64_t inc, bool synced)
+{
+    uint64_t lastAcc = m_phaseAcc;
+    uint64_t over = 0;
+    if (m_clock.Advance(m_phaseAcc, inc, synced, over))
+    {
+        m_edgeOffset = std::min(1.f, (float)((double)over / (double)inc));
+        m_gateLevel = m_edgeOffset;
+        return true;
+    }
+
+    // The gate ramps down in the sample it falls in, unless a group is held
+    uint64_t fall = m_clock.GateFall(lastAcc);
+    if (!m_clock.m_waiting && fall > 0 && m_phaseAcc >= fall)
+    {
+        m_gateLevel = (float)((double)(fall - lastAcc) / (double)inc);
+    }
+    else
+    {
+        m_gateLevel = m_clock.GateHigh(m_phaseAcc) ? 1.f : 0.f;
+    }
+    return false;
+}
+
+template <int W, int H>
+bool SeqEngine<W, H>::ProcessClockAndReset(const SeqInputs &in, float sampleTime, bool& gateIn)
+{
+    bool nextStep = false;
+    SetSampleTime(sampleTime);
+    bool synced = in.extClockConnected && !m_clock.Straight();
+    if (m_chain.m_following)
+    {
+        // The leader's clock, and its resets
+        nextStep = FollowChain(gateIn);
+    }
+    else if (in.extClockConnected && !synced)
+    {
+        // External clock, the edge is placed where the input crossed 1V
+        bool wasHigh = m_clockTrigger.IsHigh();
+        if (m_clockTrigger.Process(in.extClock))
+        {
+            m_phaseAcc = 0;
+            nextStep = true;
+            m_edgeOffset = CrossingOffset(m_lastExtClock, in.extClock, 1.f);
+        }
+        gateIn = m_clockTrigger.IsHigh();
+        if (gateIn != wasHigh)
+        {
+            m_gateLevel = gateIn ? m_edgeOffset : 1.f - CrossingOffset(m_lastExtClock, in.extClock, 0.f);
+        }
+        else
+        {
+            m_gateLevel = gateIn ? 1.f : 0.f;
+        }
+    }
+    else if (synced)
+    {
+        // Multiplied, divided or swung external clock: ticks between its
+        // edges are predicted from its measured period
+        bool started = false;
+        nextStep = SyncToExtClock(in, started);
+        if (!started && !m_clock.m_waiting && m_clock.m_extInc > 0)
+        {
+            nextStep = AdvancePhase(m_clock.m_extInc, true);
+        }
+        else
+        {
+            m_gateLevel = nextStep ? m_edgeOffset : m_clock.GateHigh(m_phaseAcc) ? 1.f : 0.f;
+        }
+        if (m_clock.m_extInc > 0)
+        {
+            gateIn = m_clock.GateHigh(m_phaseAcc);
+        }
+        else
+        {
+            // no period measured yet, the gate follows the clock
+            gateIn = m_clockTrigger.IsHigh();
+            m_gateLevel = gateIn ? 1.f : 0.f;
+        }
+    }
+    else
+    {
+        // Internal clock
+        ClockRate(in.clock);
+        nextStep = AdvancePhase(m_phaseInc, false);
+        gateIn = m_clock.GateHigh(m_phaseAcc);
+    }
+
+    if (m_resetTrigger.Process(in.reset) && !m_chain.m_following)
+    {
+        m_edgeOffset = CrossingOffset(m_lastReset, in.reset, 1.f);
+        m_currentStepIndex = Grid::kSteps;
+        nextStep = true;
+        m_resetFired = true;
+        m_clock.Restart();
+        if (in.extClockConnected && !synced)
+        {
+            m_phaseAcc = 0;
+        }
+        else
+        {
+            m_phaseAcc = (uint64_t)(m_edgeOffset * (double)(synced ? m_clock.m_extInc : m_phaseInc));
+            gateIn = true;
+            m_gateLevel = m_edgeOffset;
+        }
+    }
+
+    m_lastExtClock = in.extClock;
+    m_lastReset = in.reset;
+    return nextStep;
+}
+
+template <int W, int H>
+int SeqEngine<W, H>::PatternFromCv(float cv) const
+{
+    float patternScale = ClampFloat(cv, 0.0f, 10.0f);
+    patternScale /= 10.0f;
+    int numPatterns = NumPatterns();
+    return ClampInt((int)roundf(patternScale * numPatterns), 1, numPatterns);
+}
+
+template <int W, int H>
+int SeqEngine<W, H>::StepsFromCv(float cv, int pattern) const
+{
+    float stepsScale = ClampFloat(cv, 0.0f, 10.0f);
+    stepsScale /= 10.0f;
+    int maxStepsInPattern = Patterns().Length(pattern);
+    return ClampInt((int)roundf(stepsScale * maxStepsInPattern), 1, maxStepsInPattern);
+}
+
+template <int W, int H>
+void SeqEngine<W, H>::ApplyMaskOp(SeqMaskOp::Target target, SeqMaskOp::Type type, float amount)
+{
+    Mask &mask = (target == SeqMaskOp::GATES) ? m_pitchOn : m_skip;
+    amount = ClampFloat(amount, 0.f, 1.f);
+    switch (type)
+    {
+        case SeqMaskOp::INVERT: mask = ~mask; break;
+        case SeqMaskOp::ROTATE_RIGHT: mask = mask.Rotated(1); break;
+        case SeqMaskOp::ROTATE_LEFT: mask = mask.Rotated(-1); break;
+        case SeqMaskOp::SHIFT_RIGHT: mask = mask.Shifted(1); break;
+        case SeqMaskOp::SHIFT_LEFT: mask = mask.Shifted(-1); break;
+        case SeqMaskOp::EUCLID: mask = Mask::Euclid((int)roundf(amount * Grid::kSteps)); break;
+        case SeqMaskOp::RANDOM: mask = Mask::Random(amount, m_random); break;
+        default: break;
+    }
+    BreakRun();
+}
+
+template <int W, int H>
+void SeqEngine<W, H>::AdvanceStep(const SeqInputs &in)
+{
+    if (m_patternSets.Update())
+    {
+        // the number of patterns may have changed, so re-map the CV
+        m_patternCv = NAN;
+    }
+
+    if (in.pattern != m_patternCv || in.steps != m_stepsCv)
+    {
+        m_patternCv = in.pattern;
+        m_stepsCv = in.steps;
+        m_currentPattern = PatternFromCv(in.pattern);
+        m_numSteps = StepsFromCv(in.steps, m_currentPattern);
+    }
+
+    m_lastStepIndex = m_currentStepIndex;
+    m_stepTable.Update(Patterns(), m_currentPattern, m_numSteps, m_skip);
+    int lastPatternIndex = m_currentPatternIndex;
+    m_currentStepIndex = m_stepTable.Advance(m_currentPatternIndex);
+
+    // A new loop starts when the pattern wraps, and the count starts over at a reset
+    if (m_resetFired)
+    {
+        RestartConditions();
+    }
+    else if (m_currentPatternIndex <= lastPatternIndex)
+    {
+        m_conditions.NextLoop(m_random);
+    }
+}
+
+template <int W, int H>
+void SeqEngine<W, H>::RestartConditions()
+{
+    if (m_reseedOnReset)
+    {
+        m_random.Seed(m_random.m_seed);
+    }
+    m_conditions.Restart(m_random);
+}
+
+template <int W, int H>
+void SeqEngine<W, H>::ProcessXYTriggers(bool gateIn, SeqFrame &frame) const
+{
+    // Rows
+    int lastX = Grid::X(m_lastStepIndex);
+    int curX = Grid::X(m_currentStepIndex);
+    int lastY = Grid::Y(m_lastStepIndex);
+    int curY = Grid::Y(m_currentStepIndex);
+
+    // X row
+    bool on = StepOn(m_currentStepIndex);
+    bool gateXChanged = (m_running && on && lastX != curX);
+    frame.xActive = gateXChanged;
+    frame.gateX = gateXChanged && gateIn;
+
+    // Y row
+    bool gateYChanged = (m_running && on && lastY != curY);
+    frame.yActive = gateYChanged;
+    frame.gateY = gateYChanged && gateIn;
+
+    frame.gateXorY = frame.gateX || frame.gateY;
+}
+
+// A module joining the chain on the right waits for its turn.  One that is
+// now the leader, or on its own again, has its own clock back, and the
+// leader starts the chain over whenever its length changes.
+template <int W, int H>
+void SeqEngine<W, H>::SetChain(bool following, bool hasNext)
+{
+    int length = hasNext ? m_chain.m_reply.length + 1 : 1;
+    if (following == m_chain.m_following && hasNext == m_chain.m_hasNext && length == m_chain.m_length)
+    {
+        return;
+    }
+    bool wasFollowing = m_chain.m_following;
+    m_chain.m_following = following;
+    m_chain.m_hasNext = hasNext;
+    m_chain.m_length = length;
+    if (following)
+    {
+        if (!wasFollowing)
+        {
+            m_chain.m_ticks = m_chain.m_in.ticks;
+            m_chain.m_resets = m_chain.m_in.resets;
+            m_chain.m_playing = false;
+            m_chain.m_passAt = SEQ_CHAIN_NEVER;
+            m_currentPatternIndex = -1;
+        }
+    }
+    else
+    {
+        if (wasFollowing)
+        {
+            SetClock(m_clockRatio, m_swing);
+        }
+        RestartChain();
+    }
+    BreakRun();
+}
+
+// The leader takes the turn and plays its first step at the next tick
+template <int W, int H>
+void SeqEngine<W, H>::RestartChain()
+{
+    m_chain.m_resets++;
+    m_chain.m_playing = true;
+    m_chain.m_passAt = SEQ_CHAIN_NEVER;
+    m_currentPatternIndex = -1;
+}
+
+// Counts a tick and passes the turn on or takes it.  True when this module
+// plays the tick.
+template <int W, int H>
+bool SeqEngine<W, H>::ChainTick()
+{
+    if (!m_chain.m_following)
+    {
+        m_chain.m_ticks++;
+        if (m_resetFired)
+        {
+            RestartChain();
+        }
+    }
+    uint64_t tick = m_chain.m_ticks;
+    if (m_chain.m_playing && tick == m_chain.m_passAt)
+    {
+        m_chain.m_playing = false;
+    }
+    else if (!m_chain.m_playing && tick == m_chain.TakeAt())
+    {
+        m_chain.m_playing = true;
+    }
+    return m_chain.m_playing;
+}
+
+template <int W, int H>
+void SeqEngine<W, H>::WriteChainMessage(SeqChainMessage &message) const
+{
+    if (m_chain.m_following)
+    {
+        // the leader's state goes on as it came
+        message = m_chain.m_in;
+        message.hops++;
+        message.passAt = m_chain.m_passAt;
+        return;
+    }
+
+    bool ext = m_runInputs.extClockConnected;
+    bool synced = ext && !m_clock.Straight();
+    message.valid = true;
+    message.hops = 0;
+    message.clock = m_clock;
+    message.phaseAcc = m_phaseAcc;
+    message.phaseInc = !m_running ? 0 : synced ? m_clock.m_extInc : ext ? 0 : m_phaseInc;
+    message.synced = synced;
+    message.running = m_running;
+    message.gate = m_clockTrigger.IsHigh();
+    message.ticks = m_chain.m_ticks;
+    message.resets = m_chain.m_resets;
+    message.passAt = m_chain.m_passAt;
+}
+
+// First k >= 1 such that start + k * inc >= target, exact in integers
+static int SamplesUntil(uint64_t start, uint64_t inc, uint64_t target)
+{
+    if (start >= target)
+    {
+        return 1;
+    }
+    uint64_t k = (target - start + inc - 1) / inc;
+    return (int)std::min(k, (uint64_t)(INT_MAX / 2));
+}
+
+template <int W, int H>
+void SeqEngine<W, H>::StartRun(const SeqInputs &in, float sampleTime, bool gateIn)
+{
+    m_runInputs = in;
+    m_runSampleTime = sampleTime;
+    m_runStartAcc = m_phaseAcc;
+    m_runStartSample = m_now;
+    m_runPos = 0;
+    float fallLevel = 0.f;
+
+    bool synced = in.extClockConnected && !m_clock.Straight();
+    uint64_t inc = synced ? m_clock.m_extInc : m_phaseInc;
+    bool predicted = !in.extClockConnected || (synced && !m_clock.m_waiting && inc > 0);
+    if (m_chain.m_following)
+    {
+        // The leader's clock
+        m_runMessage = m_chain.m_in;
+        inc = m_chain.m_in.phaseInc;
+        predicted = inc > 0 && !m_clock.m_waiting;
+    }
+    if (m_running && predicted)
+    {
+        // Internal or predicted clock: the next tick and where the gate
+        // falls are known
+        uint64_t fall = m_clock.GateFall(m_phaseAcc);
+        m_runPhaseInc = inc;
+        m_runLength = SamplesUntil(m_phaseAcc, inc, m_clock.NextTick(m_phaseAcc)) - 1;
+        m_runGateFallPos = (fall > 0) ? SamplesUntil(m_phaseAcc, inc, fall) : 0;
+        if (m_runGateFallPos > 0)
+        {
+            uint64_t lastAcc = m_phaseAcc + (uint64_t)(m_runGateFallPos - 1) * inc;
+            fallLevel = (float)((double)(fall - lastAcc) / (double)inc);
+        }
+    }
+    else
+    {
+        // Stopped or external clock: nothing changes until the inputs do
+        m_runPhaseInc = 0;
+        m_runLength = INT_MAX;
+        m_runGateFallPos = gateIn ? INT_MAX : 0;
+    }
+
+    static const float levels[3] = {0.f, 1.f, 0.f};
+    for (int i = 0; i < 3; i++)
+    {
+        bool gate = (i == 1) && m_chain.m_playing;
+        SeqFrame &frame = m_runFrames[i];
+        frame = SeqFrame();
+        ProcessXYTriggers(m_running && gate, frame);
+        frame.step = m_currentStepIndex;
+        frame.running = m_running;
+        frame.gateIn = m_running && gate;
+        frame.gateLevel = m_chain.m_playing ? ((i == 2) ? fallLevel : levels[i]) : 0.f;
+    }
+}
+
+template <int W, int H>
+SeqFrame SeqEngine<W, H>::ProcessEvent(const SeqInputs &in, float sampleTime)
+{
+    SeqFrame frame;
+    m_now = m_runStartSample + m_runPos + 1;
+
+    // Run, or the leader's
+    if (m_chain.m_following)
+    {
+        m_running = m_chain.m_in.running;
+    }
+    else if (m_runningTrigger.Process(in.run))
+    {
+        m_running = !m_running;
+    }
+
+    bool nextStep = false;
+    bool gateIn = false;
+    m_resetFired = false;
+    if (m_running)
+    {
+        SeqProfileScope scope(m_profiler, SeqProfiler::CLOCK_AND_RESET);
+        nextStep = ProcessClockAndReset(in, sampleTime, gateIn);
+    }
+    if (nextStep && m_chain.Chained())
+    {
+        nextStep = ChainTick();
+    }
+    if (nextStep)
+    {
+        SeqProfileScope scope(m_profiler, SeqProfiler::ADVANCE_STEP);
+        AdvanceStep(in);
+        if (m_chain.Chained())
+        {
+            // Hands on at the next tick when that would wrap the pattern
+            int index = m_currentPatternIndex;
+            m_stepTable.Advance(index);
+            m_chain.m_passAt = (index <= m_currentPatternIndex) ? m_chain.m_ticks + 1 : SEQ_CHAIN_NEVER;
+        }
+    }
+    gateIn = gateIn && m_chain.m_playing;
+    {
+        SeqProfileScope scope(m_profiler, SeqProfiler::XY_TRIGGERS);
+        ProcessXYTriggers(gateIn, frame);
+    }
+
+    frame.step = m_currentStepIndex;
+    frame.running = m_running;
+    frame.advanced = nextStep;
+    frame.reset = m_resetFired;
+    frame.gateIn = gateIn;
+    frame.edgeOffset = nextStep ? m_edgeOffset : 0.f;
+    frame.gateLevel = (m_running && m_chain.m_playing) ? m_gateLevel : 0.f;
+
+    StartRun(in, sampleTime, gateIn);
+    return frame;
+}
+
+template <int W, int H>
+void SeqEngine<W, H>::ProcessBlock(const SeqInputs &in, float sampleTime, int frames, SeqFrame *out)
+{
+    int i = 0;
+    while (i < frames)
+    {
+        if (!CanCoast(in, sampleTime))
+        {
+            out[i++] = ProcessEvent(in, sampleTime);
+            continue;
+        }
+
+        int run = std::min(m_runLength - m_runPos, frames - i);
+        int gateOn = std::max(0, std::min(m_runGateFallPos - 1 - m_runPos, run));
+        std::fill(out + i, out + i + gateOn, m_runFrames[1]);
+        std::fill(out + i + gateOn, out + i + run, m_runFrames[0]);
+        if (gateOn < run && m_runPos + gateOn + 1 == m_runGateFallPos)
+        {
+            out[i + gateOn] = m_runFrames[2];
+        }
+        i += run;
+
+        m_runPos += run;
+        if (m_runPhaseInc != 0)
+        {
+            m_phaseAcc = m_runStartAcc + m_runPos * m_runPhaseInc;
+        }
+    }
+}
+
+#define SEQ_INSTANTIATE(W, H) template struct SeqEngine<W, H>;
+SEQ_FOR_EACH_GRID(SEQ_INSTANTIATE)
@@ -0,0 +1,361 @@
+#pragma once
+
+// Sequencing core of KSnoopySEQ.  This file must not include rack.hpp so the
+// engine can be built and benchmarked outside of VCV Rack (see bench/).
+
+#include <climits>
+#include <cmath>
+#include <cstdint>
+
+#include "SeqChain.hpp"
+#include "SeqClock.hpp"
+#include "SeqConditions.hpp"
+#include "SeqPatterns.hpp"
+#include "SeqProfiler.hpp"
+#include "SeqRandom.hpp"
+#include "SeqTripleBuffer.hpp"
+
+// Same thresholds and power-on state as rack::dsp::SchmittTrigger
+struct SeqSchmittTrigger
+{
+    bool m_state = true;
+
+    bool Process(float in)
+    {
+        if (m_state)
+        {
+            if (in <= 0.f)
+            {
+                m_state = false;
+            }
+        }
+        else if (in >= 1.f)
+        {
+            m_state = true;
+            return true;
+        }
+        return false;
+    }
+
+    bool IsHigh() const
+    {
+        return m_state;
+    }
+};
+
+// Control values for one sample.  Knob and CV are already summed, the way
+// the module used to read them (param + input voltage).
+struct SeqInputs
+{
+    float run = 0.f;
+    float clock = 2.f;
+    bool extClockConnected = false;
+    float extClock = 0.f;
+    float reset = 0.f;
+    float steps = 10.f;
+    float pattern = 0.f;
+
+    bool operator==(const SeqInputs &other) const
+    {
+        return run == other.run && clock == other.clock && extClockConnected == other.extClockConnected &&
+               extClock == other.extClock && reset == other.reset && steps == other.steps && pattern == other.pattern;
+    }
+};
+
+// What the engine produced for one sample
+struct SeqFrame
+{
+    int step = 0;
+    bool running = false;
+    bool advanced = false;
+    bool reset = false;
+    bool gateIn = false;
+    bool gateX = false;
+    bool gateY = false;
+    bool gateXorY = false;
+
+    // The X/Y gates that are open this step, whatever the clock's level
+    bool xActive = false;
+    bool yActive = false;
+
+    // Samples (0-1) since the clock or reset edge that advanced this sample
+    float edgeOffset = 0.f;
+
+    // gateIn averaged over the sample, so edges that fall between samples
+    // come out as a one sample ramp (a box-filtered, band-limited edge)
+    float gateLevel = 0.f;
+};
+
+// Bulk edits of the gate or skip mask, from the menu or the trigger inputs
+struct SeqMaskOp
+{
+    enum Target
+    {
+        GATES,
+        SKIPS,
+        NUM_TARGETS
+    };
+
+    enum Type
+    {
+        INVERT,
+        ROTATE_RIGHT,
+        ROTATE_LEFT,
+        SHIFT_RIGHT,
+        SHIFT_LEFT,
+        EUCLID,
+        RANDOM,
+        NUM_TYPES
+    };
+
+    static const char *Name(Type type);
+};
+
+template <int W, int H>
+struct SeqEngine
+{
+    typedef SeqGrid<W, H> Grid;
+    typedef typename Grid::Mask Mask;
+    typedef SeqPatternSet<W, H> PatternSet;
+
+    bool m_running = true;
+    SeqSchmittTrigger m_clockTrigger;
+    SeqSchmittTrigger m_runningTrigger;
+    SeqSchmittTrigger m_resetTrigger;
+
+    // Internal clock phase in fixed point: one period is m_period and every
+    // sample adds m_phaseInc, both exact integers (sample rate and clock
+    // rate scaled by 2^32), so edges never drift however long it runs.
+    // The phase runs over a pair of ticks, see SeqClock.
+    uint64_t m_phaseAcc = 0;
+    uint64_t m_period = (uint64_t)44100 << 32;
+    uint64_t m_phaseInc = 0;
+    float m_sampleTime = 1.f / 44100.f;
+    SeqClock m_clock;
+    int m_clockRatio = 1;
+    float m_swing = 0.5f;
+
+    // Place in a chain of modules playing one sequence, see SeqChain
+    SeqChain m_chain;
+
+    // Samples processed, for timing the external clock
+    uint64_t m_now = 0;
+
+    // Previous values of the edge inputs, to interpolate their crossings
+    float m_lastExtClock = 0.f;
+    float m_lastReset = 0.f;
+    float m_edgeOffset = 0.f;
+    float m_gateLevel = 0.f;
+
+    int m_currentPattern = 0;
+    int m_currentPatternIndex = 0;
+    int m_currentStepIndex = 0;
+    int m_lastStepIndex = 0;
+    bool m_resetFired = false;
+    Mask m_pitchOn;
+    Mask m_skip;
+
+    // Per-step conditions and chances, evaluated each loop of the pattern,
+    // and whether fill is on
+    SeqConditions<W, H> m_conditions;
+    bool m_fill = false;
+
+    // Pattern and step count only get recomputed when their knob + CV moves
+    float m_patternCv = NAN;
+    float m_stepsCv = NAN;
+    int m_numSteps = 1;
+    SeqStepTable<W, H> m_stepTable;
+
+    // Built-in + user patterns.  The UI thread compiles into the back buffer
+    // and publishes; the engine picks the new set up at its next step.
+    SeqTripleBuffer<PatternSet> m_patternSets;
+    uint32_t m_patternGeneration = 0;
+
+    // Times the event path's stages when set, eg by the module's menu
+    SeqProfiler *m_profiler = nullptr;
+
+    // Draws for SeqMaskOp::RANDOM and the module's randomize actions, on
+    // the engine thread only so a seed always plays back the same way.
+    // With m_reseedOnReset a reset starts them over from the seed, before
+    // the first loop's chances are rolled.
+    SeqRandom m_random;
+    bool m_reseedOnReset = false;
+
+    // std::pow is only paid when the clock knob + CV actually moves
+    float m_clockOctaves = NAN;
+    float m_clockRate = 0.f;
+
+    // Between events the inputs are unchanged and the outputs are a constant
+    // run until the next clock edge, which is computed analytically from
+    // m_phaseAcc.  m_runLength is the number of samples that can be emitted
+    // without running the full step logic.
+    SeqInputs m_runInputs;
+    float m_runSampleTime = 0.f;
+    uint64_t m_runStartAcc = 0;
+    uint64_t m_runStartSample = 0;
+    uint64_t m_runPhaseInc = 0;
+    int m_runPos = 0;
+    int m_runLength = 0;
+    int m_runGateFallPos = 0;
+    SeqFrame m_runFrames[3]; // gate low, gate high, the sample the gate falls in
+    SeqChainMessage m_runMessage; // what a chained module's run started from
+
+    SeqEngine();
+
+    void Reset();
+    const PatternSet &Patterns() const
+    {
+        return m_patternSets.Front();
+    }
+
+    int NumPatterns() const
+    {
+        return Patterns().m_numPatterns;
+    }
+
+    // UI thread only: fill EditPatterns() then call PublishPatterns()
+    PatternSet &EditPatterns()
+    {
+        return m_patternSets.Back();
+    }
+
+    void PublishPatterns()
+    {
+        m_patternSets.Back().m_generation = ++m_patternGeneration;
+        m_patternSets.Publish();
+    }
+
+    // Phase as a fraction of the tick it is in
+    float Phase() const
+    {
+        if (m_phaseAcc < m_clock.m_offbeat)
+        {
+            return (float)((double)m_phaseAcc / (double)m_clock.m_offbeat);
+        }
+        return (float)((double)(m_phaseAcc - m_clock.m_offbeat) / (double)(m_clock.m_pair - m_clock.m_offbeat));
+    }
+
+    void SetSampleTime(float sampleTime);
+    float ClockRate(float octaves);
+
+    // ratio > 0 multiplies the clock, < 0 divides it; swing 0.5-0.75
+    void SetClock(int ratio, float swing);
+    bool SyncToExtClock(const SeqInputs &in, bool &started);
+    bool FollowChain(bool &gateIn);
+    bool AdvancePhase(uint64_t inc, bool synced);
+    int PatternFromCv(float cv) const;
+    int StepsFromCv(float cv, int pattern) const;
+    bool ProcessClockAndReset(const SeqInputs &in, float sampleTime, bool& gateIn);
+    void AdvanceStep(const SeqInputs &in);
+    void RestartConditions();
+    void ProcessXYTriggers(bool gateIn, SeqFrame &frame) const;
+
+    // Chaining: SetChain() every sample with m_chain.m_in and m_reply
+    // filled in from the neighbours, then WriteChainMessage() and
+    // m_chain.Reply() go out to them
+    void SetChain(bool following, bool hasNext);
+    void RestartChain();
+    bool ChainTick();
+    void WriteChainMessage(SeqChainMessage &message) const;
+
+    // Invalidate the current constant run, eg after the grid was edited
+    void BreakRun()
+    {
+        m_runLength = 0;
+    }
+
+    void SetPitchOnMask(const Mask &mask)
+    {
+        m_pitchOn = mask;
+        BreakRun();
+    }
+
+    void SetSkipMask(const Mask &mask)
+    {
+        m_skip = mask;
+        BreakRun();
+    }
+
+    void SetFill(bool fill)
+    {
+        if (fill != m_fill)
+        {
+            m_fill = fill;
+            BreakRun();
+        }
+    }
+
+    // Gate on, its condition met this loop, and this module's turn
+    bool StepOn(int step) const
+    {
+        return m_chain.m_playing && m_pitchOn.Test(step) && m_conditions.Plays(step, m_fill);
+    }
+
+    // `amount` (0-1) is the density of EUCLID and RANDOM
+    void ApplyMaskOp(SeqMaskOp::Target target, SeqMaskOp::Type type, float amount);
+
+    bool CanCoast(const SeqInputs &in, float sampleTime) const
+    {
+        return m_runPos < m_runLength && sampleTime == m_runSampleTime && in == m_runInputs && ChainSteady();
+    }
+
+    // The leader's clock is where the run said it would be: its phase, sent
+    // hops + 1 samples back, moved on steadily, and nothing else changed
+    bool ChainSteady() const
+    {
+        if (!m_chain.m_following)
+        {
+            return true;
+        }
+        const SeqChainMessage &in = m_chain.m_in;
+        const SeqChainMessage &run = m_runMessage;
+        return (!run.running || in.phaseAcc == m_runStartAcc + (uint64_t)(int64_t)(m_runPos - in.hops) * m_runPhaseInc) &&
+               in.ticks == run.ticks && in.resets == run.resets && in.passAt == run.passAt &&
+               in.running == run.running && in.gate == run.gate && in.phaseInc == run.phaseInc &&
+               in.clock.m_pair == run.clock.m_pair && in.clock.m_offbeat == run.clock.m_offbeat &&
+               in.clock.m_waiting == run.clock.m_waiting && in.clock.m_groupTicks == run.clock.m_groupTicks;
+    }
+
+    // One sample inside a constant run
+    SeqFrame Coast()
+    {
+        m_runPos++;
+        if (m_runPhaseInc != 0)
+        {
+            m_phaseAcc = m_runStartAcc + m_runPos * m_runPhaseInc;
+        }
+        return m_runFrames[RunFrame(m_runPos)];
+    }
+
+    int RunFrame(int pos) const
+    {
+        return (pos < m_runGateFallPos) ? 1 : (pos == m_runGateFallPos) ? 2 : 0;
+    }
+
+    SeqFrame ProcessEvent(const SeqInputs &in, float sampleTime);
+    void StartRun(const SeqInputs &in, float sampleTime, bool gateIn);
+
+    SeqFrame Process(const SeqInputs &in, float sampleTime)
+    {
+        if (CanCoast(in, sampleTime))
+        {
+            return Coast();
+        }
+        return ProcessEvent(in, sampleTime);
+    }
+
+    // For callers that track their own changes: `in` must be what was passed
+    // last time unless inputsChanged is set, and then isn't compared at all
+    SeqFrame Process(const SeqInputs &in, float sampleTime, bool inputsChanged)
+    {
+        if (!inputsChanged && m_runPos < m_runLength && sampleTime == m_runSampleTime && ChainSteady())
+        {
+            return Coast();
+        }
+        return ProcessEvent(in, sampleTime);
+    }
+
+    // Processes `frames` samples with `in` held for the whole block.  Runs
+    // between clock edges are written out without touching the step logic.
+    void ProcessBlock(const SeqInputs &in, float sampleTime, int frames, SeqFrame *out);
+};
@@ -0,0 +1,191 @@
+#include "SeqGates.hpp"
+#include <algorithm>
+
+const char *SeqGateMode::Name(Mode mode)
+{
+    switch (mode)
+    {
+        case TRIGGER: return "Trigger";
+        case RETRIGGER: return "Retrigger";
+        case CONTINUOUS: return "Continuous";
+        case CLOCK: return "Clock";
+        default: return "";
+    }
+}
+
+template <int W, int H>
+SeqGateGenerator<W, H>::SeqGateGenerator()
+{
+    SetLength(-1, SEQ_GATE_LENGTHS / 2);
+    SetRatchets(-1, 1);
+    SetSampleRate(44100.f);
+}
+
+template <int W, int H>
+void SeqGateGenerator<W, H>::SetSampleRate(float sampleRate)
+{
+    if (sampleRate != m_sampleRate)
+    {
+        m_sampleRate = sampleRate;
+        m_pulseSamples = std::max(1, (int)std::lround(SEQ_TRIGGER_TIME * sampleRate));
+        m_stepSamples = std::max(1, (int)(sampleRate / 4.f)); // until a step has been timed
+    }
+}
+
+template <int W, int H>
+void SeqGateGenerator<W, H>::SetMode(SeqGateMode::Mode mode, bool bandLimited)
+{
+    m_mode = mode;
+    m_bandLimited = bandLimited;
+    switch (mode)
+    {
+        case SeqGateMode::TRIGGER:
+            m_process = &SeqGateGenerator::ProcessFrames<SeqGateMode::TRIGGER, false>;
+            break;
+        case SeqGateMode::RETRIGGER:
+            m_process = &SeqGateGenerator::ProcessFrames<SeqGateMode::RETRIGGER, false>;
+            break;
+        case SeqGateMode::CONTINUOUS:
+            m_process = &SeqGateGenerator::ProcessFrames<SeqGateMode::CONTINUOUS, false>;
+            break;
+        default:
+            m_mode = SeqGateMode::CLOCK;
+            m_process = bandLimited ? &SeqGateGenerator::ProcessFrames<SeqGateMode::CLOCK, true>
+                                    : &SeqGateGenerator::ProcessFrames<SeqGateMode::CLOCK, false>;
+            break;
+    }
+    for (int o = 0; o < SEQ_GATE_OUTPUTS; o++)
+    {
+        m_states[o].Stop();
+    }
+}
+
+template <int W, int H>
+void SeqGateGenerator<W, H>::SetLength(int step, int eighths)
+{
+    eighths = std::max(1, std::min(eighths, SEQ_GATE_LENGTHS));
+    for (int i = 0; i < Grid::kSteps; i++)
+    {
+        if (step < 0 || i == step)
+        {
+            m_lengths[i] = eighths;
+        }
+    }
+}
+
+template <int W, int H>
+void SeqGateGenerator<W, H>::SetRatchets(int step, int ratchets)
+{
+    ratchets = std::max(1, std::min(ratchets, SEQ_MAX_RATCHETS));
+    for (int i = 0; i < Grid::kSteps; i++)
+    {
+        if (step < 0 || i == step)
+        {
+            m_ratchets[i] = ratchets;
+        }
+    }
+}
+
+template <int W, int H>
+template <SeqGateMode::Mode M>
+void SeqGateGenerator<W, H>::Start(SeqGateState &state, int sub, int ratchets, int eighths)
+{
+    int gap = std::min(m_pulseSamples, sub / 2);
+    bool wasHigh = state.level; // read before this step's length replaces `high`
+    switch (M)
+    {
+        case SeqGateMode::TRIGGER:
+            state.high = std::min(m_pulseSamples, sub);
+            state.gap = 0;
+            state.ratchetGap = 0;
+            break;
+        case SeqGateMode::RETRIGGER:
+            // a gate that would run into the next one is pulled low first
+            state.high = std::max(1, sub * eighths / SEQ_GATE_LENGTHS);
+            state.gap = wasHigh ? gap : 0;
+            state.ratchetGap = (state.high >= sub) ? gap : 0;
+            break;
+        default:
+            // held until a step that doesn't fire this output
+            state.high = INT_MAX;
+            sub = INT_MAX;
+            ratchets = 1;
+            state.gap = 0;
+            state.ratchetGap = 0;
+            break;
+    }
+    state.pos = 0;
+    state.sub = sub;
+    state.ratchetsLeft = ratchets - 1;
+}
+
+template <int W, int H>
+template <SeqGateMode::Mode M>
+void SeqGateGenerator<W, H>::StartStep(const SeqFrame &frame)
+{
+    // Steps are timed edge to edge, so ratchets follow an external clock too
+    if (!frame.reset)
+    {
+        m_stepSamples = std::max(1, m_samplesSinceStep);
+    }
+    m_samplesSinceStep = 0;
+
+    int step = std::min(frame.step, Grid::kSteps - 1);
+    int ratchets = m_ratchets[step];
+    int sub = std::max(1, m_stepSamples / ratchets);
+    bool fires[SEQ_GATE_OUTPUTS] = {frame.xActive, frame.yActive, frame.xActive || frame.yActive};
+    for (int o = 0; o < SEQ_GATE_OUTPUTS; o++)
+    {
+        if (fires[o])
+        {
+            Start<M>(m_states[o], sub, ratchets, m_lengths[step]);
+        }
+        else
+        {
+            m_states[o].Stop();
+        }
+    }
+}
+
+template <int W, int H>
+template <SeqGateMode::Mode M, bool kBandLimited>
+void SeqGateGenerator<W, H>::ProcessFrames(const SeqFrame *frames, int count, float (*out)[SEQ_GATE_OUTPUTS])
+{
+    for (int i = 0; i < count; i++)
+    {
+        const SeqFrame &frame = frames[i];
+        m_samplesSinceStep++;
+
+        if (frame.running != m_running)
+        {
+            m_running = frame.running;
+            for (int o = 0; o < SEQ_GATE_OUTPUTS; o++)
+            {
+                m_states[o].Stop();
+            }
+        }
+
+        if (M == SeqGateMode::CLOCK)
+        {
+            // the engine's gates as they are, optionally with sub-sample edges
+            float level = kBandLimited ? frame.gateLevel : (frame.gateIn ? 1.f : 0.f);
+            out[i][0] = frame.xActive ? level : 0.f;
+            out[i][1] = frame.yActive ? level : 0.f;
+            out[i][2] = (frame.xActive || frame.yActive) ? level : 0.f;
+        }
+        else
+        {
+            if (frame.advanced)
+            {
+                StartStep<M>(frame);
+            }
+            for (int o = 0; o < SEQ_GATE_OUTPUTS; o++)
+            {
+                out[i][o] = m_states[o].Tick();
+            }
+        }
+    }
+}
+
+#define SEQ_INSTANTIATE(W, H) template struct SeqGateGenerator<W, H>;
+SEQ_FOR_EACH_GRID(SEQ_INSTANTIATE)
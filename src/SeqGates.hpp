@@ -0,0 +1,113 @@
+#pragma once
+
+// Gate generation for the X, Y and X-or-Y outputs.  The engine decides which
+// outputs a step fires; this turns that into triggers, gates or tied gates,
+// with a gate length and a ratchet count for every step.
+
+#include <algorithm>
+
+#include "SeqEngine.hpp"
+
+#define SEQ_GATE_OUTPUTS 3
+#define SEQ_MAX_RATCHETS 4
+#define SEQ_GATE_LENGTHS 8 // gate lengths are whole eighths of a step
+#define SEQ_TRIGGER_TIME 1e-3f
+
+struct SeqGateMode
+{
+    enum Mode
+    {
+        TRIGGER,    // a short pulse at the start of every ratchet
+        RETRIGGER,  // a gate per ratchet, pulled low briefly if it's still high
+        CONTINUOUS, // held for the whole step and tied into the next step that fires
+        CLOCK,      // open while the clock is high, as the module always did
+        NUM_MODES
+    };
+
+    static const char *Name(Mode mode);
+};
+
+// State machine of one output.  The gate mode only matters when a step
+// starts; from then on every mode is the same counter compare per sample.
+struct SeqGateState
+{
+    int pos = 0;          // samples since the current ratchet started
+    int sub = 0;          // samples per ratchet
+    int gap = 0;          // held low for this many samples first
+    int high = 0;         // high until pos gets here
+    int ratchetsLeft = 0;
+    int ratchetGap = 0;   // gap of the ratchets after the first
+    bool level = false;   // what Tick() last output
+
+    bool IsHigh() const
+    {
+        return pos >= gap && pos < high;
+    }
+
+    float Tick()
+    {
+        level = IsHigh();
+        pos += (pos < sub);
+        if (pos >= sub && ratchetsLeft > 0)
+        {
+            pos = 0;
+            gap = ratchetGap;
+            ratchetsLeft--;
+        }
+        return level ? 1.f : 0.f;
+    }
+
+    // Ends the gate now and drops any ratchets still to come
+    void Stop()
+    {
+        high = std::min(high, pos);
+        ratchetsLeft = 0;
+    }
+};
+
+template <int W, int H>
+struct SeqGateGenerator
+{
+    typedef SeqGrid<W, H> Grid;
+    typedef void (SeqGateGenerator::*ProcessFn)(const SeqFrame *frames, int count, float (*out)[SEQ_GATE_OUTPUTS]);
+
+    SeqGateMode::Mode m_mode = SeqGateMode::CLOCK;
+    bool m_bandLimited = false;
+    ProcessFn m_process = &SeqGateGenerator::ProcessFrames<SeqGateMode::CLOCK, false>;
+
+    // Per step, in eighths of the step and in gates per step
+    uint8_t m_lengths[Grid::kSteps];
+    uint8_t m_ratchets[Grid::kSteps];
+
+    SeqGateState m_states[SEQ_GATE_OUTPUTS];
+    float m_sampleRate = 0.f;
+    int m_pulseSamples = 1;
+    int m_stepSamples = 1;      // length of the last step, what ratchets divide
+    int m_samplesSinceStep = 0;
+    bool m_running = false;
+
+    SeqGateGenerator();
+
+    void SetSampleRate(float sampleRate);
+    void SetMode(SeqGateMode::Mode mode, bool bandLimited);
+
+    // step < 0 sets every step
+    void SetLength(int step, int eighths);
+    void SetRatchets(int step, int ratchets);
+
+    // Levels (0-1) of the X, Y and X-or-Y gates for each frame.  The mode was
+    // resolved into m_process when it was set, not per sample.
+    void Process(const SeqFrame *frames, int count, float (*out)[SEQ_GATE_OUTPUTS])
+    {
+        (this->*m_process)(frames, count, out);
+    }
+
+    template <SeqGateMode::Mode M, bool kBandLimited>
+    void ProcessFrames(const SeqFrame *frames, int count, float (*out)[SEQ_GATE_OUTPUTS]);
+
+    template <SeqGateMode::Mode M>
+    void StartStep(const SeqFrame &frame);
+
+    template <SeqGateMode::Mode M>
+    void Start(SeqGateState &state, int sub, int ratchets, int eighths);
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+// Pitch glide for the PITCH output, one slew per lane.  A step with glide
+// on slides into its pitch over the glide time, exponentially (a one-pole
+// lag, within 1% at the glide time) or linearly (a fixed time, however far
+// it goes); other steps jump.  Lanes are plain float arrays updated all
+// together, a fixed 16 wide without branches so they vectorize, and the
+// whole stage is skipped while no lane is gliding.  Coefficients are only
+// worked out again when the time, shape or sample rate change.
+
+#include <cmath>
+#include <cstdint>
+
+#include "SeqLanes.hpp"
+
+#define SEQ_GLIDE_DEFAULT_TIME 0.1f
+#define SEQ_GLIDE_MIN_TIME 0.001f
+#define SEQ_GLIDE_MAX_TIME 2.f
+#define SEQ_GLIDE_SETTLE 1e-4f // volts from the target that count as there
+
+struct SeqGlide
+{
+    enum Shape
+    {
+        EXPONENTIAL,
+        LINEAR,
+        NUM_SHAPES
+    };
+
+    Shape m_shape = EXPONENTIAL;
+    float m_time = SEQ_GLIDE_DEFAULT_TIME; // seconds
+    float m_sampleRate = 0.f;
+    float m_decay = 0.f;   // exponential: share of the gap left after a sample
+    float m_samples = 1.f;     // linear: samples a glide takes
+
+    alignas(16) float m_out[SEQ_MAX_LANES] = {};
+    alignas(16) float m_target[SEQ_MAX_LANES] = {};
+    alignas(16) float m_increment[SEQ_MAX_LANES] = {}; // linear, per sample
+    alignas(16) float m_remaining[SEQ_MAX_LANES] = {}; // linear, samples left
+    alignas(16) float m_gap[SEQ_MAX_LANES] = {};       // exponential, target - out
+    bool m_active = false; // some lane may still be gliding
+
+    static const char *Name(Shape shape)
+    {
+        return (shape == LINEAR) ? "Linear" : "Exponential";
+    }
+
+    // Glides under way carry on with a new time, a new shape ends them
+    void Configure(Shape shape, float time, float sampleRate)
+    {
+        if (shape == m_shape && time == m_time && sampleRate == m_sampleRate)
+        {
+            return;
+        }
+        if (shape != m_shape)
+        {
+            for (int i = 0; i < SEQ_MAX_LANES; i++)
+            {
+                Jump(i, m_target[i]);
+            }
+        }
+        m_shape = shape;
+        m_time = time;
+        m_sampleRate = sampleRate;
+        m_samples = std::fmax(time * sampleRate, 1.f);
+        m_decay = std::exp(-std::log(100.f) / m_samples);
+    }
+
+    void Jump(int lane, float pitch)
+    {
+        m_out[lane] = m_target[lane] = pitch;
+        m_remaining[lane] = 0.f;
+        m_gap[lane] = 0.f;
+    }
+
+    // From wherever the lane is now
+    void GlideTo(int lane, float pitch)
+    {
+        m_target[lane] = pitch;
+        m_gap[lane] = pitch - m_out[lane];
+        m_increment[lane] = m_gap[lane] / m_samples;
+        m_remaining[lane] = m_samples;
+        m_active = true;
+    }
+
+    // One sample for every lane.  Each lane's output is its target less
+    // what is left of the gap, which is exactly zero once the glide is over,
+    // so lanes that aren't gliding can run too and the loops need no
+    // branches.
+    void Process()
+    {
+        if (!m_active)
+        {
+            return;
+        }
+        if (m_shape == LINEAR)
+        {
+            for (int i = 0; i < SEQ_MAX_LANES; i++)
+            {
+                float remaining = m_remaining[i] - 1.f;
+                remaining = (remaining > 0.f) ? remaining : 0.f;
+                m_out[i] = m_target[i] - m_increment[i] * remaining;
+                m_remaining[i] = remaining;
+            }
+        }
+        else
+        {
+            for (int i = 0; i < SEQ_MAX_LANES; i++)
+            {
+                float gap = m_gap[i] * m_decay;
+                gap = (std::fabs(gap) > SEQ_GLIDE_SETTLE) ? gap : 0.f;
+                m_out[i] = m_target[i] - gap;
+                m_gap[i] = gap;
+            }
+        }
+
+        int moving = 0;
+        for (int i = 0; i < SEQ_MAX_LANES; i++)
+        {
+            moving += (m_out[i] != m_target[i]);
+        }
+        m_active = (moving > 0);
+    }
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+// Grid dimensions of a sequencer.  Everything that depends on the grid size
+// is a template on <W, H>; the .cpp files instantiate the sizes listed in
+// SEQ_FOR_EACH_GRID.
+
+#include "SeqStepMask.hpp"
+
+#define SEQ_FOR_EACH_GRID(X) \
+    X(4, 4)                  \
+    X(8, 8)                  \
+    X(16, 16)
+
+template <int W, int H>
+struct SeqGrid
+{
+    static const int kWidth = W;
+    static const int kHeight = H;
+    static const int kSteps = W * H;
+
+    // Room for the ping pong built-ins, and never less than 64 steps
+    static const int kMaxPatternLength = (2 * W * H > 64) ? 2 * W * H : 64;
+
+    typedef SeqStepMask<W * H> Mask;
+
+    static_assert(W * H <= 256, "steps are stored as uint8_t");
+
+    static int X(int step)
+    {
+        return step % W;
+    }
+
+    static int Y(int step)
+    {
+        return step / W;
+    }
+};
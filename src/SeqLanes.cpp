@@ -0,0 +1,187 @@
+#include "SeqLanes.hpp"
+#include <algorithm>
+
+template <int W, int H>
+void SeqLanes<W, H>::SetNumLanes(int numLanes, const Engine &engine)
+{
+    m_numLanes = std::max(1, std::min(numLanes, SEQ_MAX_LANES));
+    Sync(engine);
+}
+
+// Restart every lane from the engine's position, keeping each lane's offset
+template <int W, int H>
+void SeqLanes<W, H>::Sync(const Engine &engine)
+{
+    for (int lane = 0; lane < SEQ_MAX_LANES; lane++)
+    {
+        float phase = engine.Phase() + m_config[lane].phaseOffset;
+        m_phase[lane] = phase - std::floor(phase);
+        m_step[lane] = engine.m_currentStepIndex;
+        m_lastStep[lane] = engine.m_lastStepIndex;
+        m_patternIndex[lane] = engine.m_currentPatternIndex;
+        m_xActive[lane] = false;
+        m_yActive[lane] = false;
+        m_gateLevel[lane] = 0.f;
+        m_gateX[lane] = 0.f;
+        m_gateY[lane] = 0.f;
+        m_gateXorY[lane] = 0.f;
+    }
+}
+
+template <int W, int H>
+typename SeqLanes<W, H>::Mask SeqLanes<W, H>::LaneSkipMask(int lane, const Mask &gridMask) const
+{
+    switch (m_config[lane].skipMode)
+    {
+        case SeqLaneConfig::SKIP_NONE:
+            return Mask();
+        case SeqLaneConfig::SKIP_INVERTED:
+            return ~gridMask;
+        case SeqLaneConfig::SKIP_ROTATED:
+            return gridMask.Rotated(lane);
+        default:
+            return gridMask;
+    }
+}
+
+template <int W, int H>
+void SeqLanes<W, H>::AdvanceLane(int lane, const Engine &engine, const SeqInputs &in)
+{
+    const SeqLaneConfig &config = m_config[lane];
+    const SeqPatternSet<W, H> &patterns = engine.Patterns();
+    int pattern = (config.pattern > 0) ? std::min(config.pattern, patterns.m_numPatterns) : engine.PatternFromCv(in.pattern);
+    int maxStepsInPattern = patterns.Length(pattern);
+    int numSteps = (config.steps > 0) ? std::min(config.steps, maxStepsInPattern) : engine.StepsFromCv(in.steps, pattern);
+
+    m_stepTables[lane].Update(patterns, pattern, numSteps, LaneSkipMask(lane, engine.m_skip));
+    m_lastStep[lane] = m_step[lane];
+    m_step[lane] = m_stepTables[lane].Advance(m_patternIndex[lane]);
+    UpdateLaneGates(lane, engine);
+}
+
+// Same rule as SeqEngine::ProcessXYTriggers
+template <int W, int H>
+void SeqLanes<W, H>::UpdateLaneGates(int lane, const Engine &engine)
+{
+    int last = m_lastStep[lane];
+    int cur = m_step[lane];
+    bool on = engine.StepOn(cur);
+    m_xActive[lane] = on && Grid::X(last) != Grid::X(cur);
+    m_yActive[lane] = on && Grid::Y(last) != Grid::Y(cur);
+}
+
+template <int W, int H>
+void SeqLanes<W, H>::SetGates(const SeqGateGenerator<W, H> &gates)
+{
+    for (int lane = 0; lane < SEQ_MAX_LANES; lane++)
+    {
+        SeqGateGenerator<W, H> &laneGates = m_gates[lane];
+        if (laneGates.m_mode != gates.m_mode || laneGates.m_bandLimited != gates.m_bandLimited)
+        {
+            laneGates.SetMode(gates.m_mode, gates.m_bandLimited);
+        }
+        std::copy(gates.m_lengths, gates.m_lengths + Grid::kSteps, laneGates.m_lengths);
+        std::copy(gates.m_ratchets, gates.m_ratchets + Grid::kSteps, laneGates.m_ratchets);
+    }
+}
+
+template <int W, int H>
+void SeqLanes<W, H>::Process(Engine &engine, const SeqFrame &frame, const SeqInputs &in)
+{
+    int numLanes = NumGroups() * SEQ_LANE_WIDTH;
+    bool running = engine.m_running;
+
+    const uint32_t allLanes = (1u << m_numLanes) - 1;
+    uint32_t ticked = 0;
+    if (!running)
+    {
+        std::fill(m_gateLevel, m_gateLevel + numLanes, 0.f);
+    }
+    else if (frame.reset)
+    {
+        // Like the engine: every lane steps on from the reset position
+        for (int lane = 0; lane < numLanes; lane++)
+        {
+            m_phase[lane] = m_config[lane].phaseOffset;
+            m_step[lane] = Grid::kSteps;
+            m_gateLevel[lane] = (m_phase[lane] < 0.5f) ? 1.f : 0.f;
+        }
+        ticked = allLanes;
+    }
+    else if (in.extClockConnected)
+    {
+        if (frame.advanced)
+        {
+            ticked = allLanes;
+        }
+        std::fill(m_gateLevel, m_gateLevel + numLanes, frame.gateLevel);
+    }
+    else
+    {
+        // Lane phases are offsets from the engine's exact phase rather than
+        // running sums of their own, so lanes never drift apart from it;
+        // a lane ticks when its phase wraps
+        float phase = engine.Phase();
+        alignas(16) float lastPhase[SEQ_MAX_LANES];
+        for (int lane = 0; lane < numLanes; lane++)
+        {
+            float lanePhase = phase + m_config[lane].phaseOffset;
+            lanePhase -= std::floor(lanePhase);
+            lastPhase[lane] = m_phase[lane];
+            ticked |= (uint32_t)(lanePhase < lastPhase[lane]) << lane;
+            m_phase[lane] = lanePhase;
+            m_gateLevel[lane] = (lanePhase < 0.5f) ? 1.f : 0.f;
+        }
+        ticked &= allLanes;
+
+        // Only band-limited clock gates look at the level: the gate, high
+        // for the first half of the phase, averaged over the distance moved
+        if (m_gates[0].m_mode == SeqGateMode::CLOCK && m_gates[0].m_bandLimited)
+        {
+            for (int lane = 0; lane < numLanes; lane++)
+            {
+                float last = lastPhase[lane];
+                float lanePhase = m_phase[lane];
+                bool wrapped = lanePhase < last;
+                float moved = lanePhase - last + (wrapped ? 1.f : 0.f);
+                float high = wrapped ? std::max(0.f, 0.5f - last) + std::min(lanePhase, 0.5f) : std::max(0.f, std::min(lanePhase, 0.5f) - last);
+                m_gateLevel[lane] = (moved > 0.f) ? std::min(high / moved, 1.f) : m_gateLevel[lane];
+            }
+        }
+    }
+
+    for (int lane = 0; lane < m_numLanes; lane++)
+    {
+        if (ticked & (1u << lane))
+        {
+            AdvanceLane(lane, engine, in);
+        }
+    }
+
+    // Each lane's gates from its own generator
+    float levels[1][SEQ_GATE_OUTPUTS];
+    for (int lane = 0; lane < numLanes; lane++)
+    {
+        SeqFrame &laneFrame = m_frames[lane];
+        laneFrame.step = m_step[lane];
+        laneFrame.running = running;
+        laneFrame.advanced = (ticked >> lane) & 1;
+        laneFrame.reset = frame.reset;
+        laneFrame.gateIn = running && (in.extClockConnected ? frame.gateIn : m_phase[lane] < 0.5f);
+        laneFrame.xActive = running && m_xActive[lane];
+        laneFrame.yActive = running && m_yActive[lane];
+        laneFrame.gateX = laneFrame.xActive && laneFrame.gateIn;
+        laneFrame.gateY = laneFrame.yActive && laneFrame.gateIn;
+        laneFrame.gateXorY = laneFrame.gateX || laneFrame.gateY;
+        laneFrame.edgeOffset = (laneFrame.advanced && (frame.reset || in.extClockConnected)) ? frame.edgeOffset : 0.f;
+        laneFrame.gateLevel = m_gateLevel[lane];
+
+        m_gates[lane].Process(&laneFrame, 1, levels);
+        m_gateX[lane] = 10.f * levels[0][0];
+        m_gateY[lane] = 10.f * levels[0][1];
+        m_gateXorY[lane] = 10.f * levels[0][2];
+    }
+}
+
+#define SEQ_INSTANTIATE(W, H) template struct SeqLanes<W, H>;
+SEQ_FOR_EACH_GRID(SEQ_INSTANTIATE)
@@ -0,0 +1,85 @@
+#pragma once
+
+// Polyphonic mode: up to SEQ_MAX_LANES grid sequencers sharing the module's
+// pitch/gate grid and clock.  Per-lane state is kept as structure-of-arrays
+// so the per-sample phase work is plain 4-wide loops that the compiler turns
+// into SSE, and only lanes that hit a clock edge run the scalar step logic.
+// Each lane's X, Y and X-or-Y go through a gate generator of its own, set
+// up like the module's, so the gate mode and step gates apply to every lane.
+
+#include "SeqEngine.hpp"
+#include "SeqGates.hpp"
+
+#define SEQ_MAX_LANES 16
+#define SEQ_LANE_WIDTH 4
+
+struct SeqLaneConfig
+{
+    enum SkipMode
+    {
+        SKIP_GRID,
+        SKIP_NONE,
+        SKIP_INVERTED,
+        SKIP_ROTATED,
+        NUM_SKIP_MODES
+    };
+
+    int pattern = 0;          // 1-based, 0 follows the pattern knob + CV
+    int steps = 0;            // 0 follows the steps knob + CV
+    float phaseOffset = 0.f;  // fraction of a clock period
+    SkipMode skipMode = SKIP_GRID;
+};
+
+template <int W, int H>
+struct SeqLanes
+{
+    typedef SeqGrid<W, H> Grid;
+    typedef typename Grid::Mask Mask;
+    typedef SeqEngine<W, H> Engine;
+
+    int m_numLanes = 1;
+    SeqLaneConfig m_config[SEQ_MAX_LANES];
+
+    alignas(16) float m_phase[SEQ_MAX_LANES] = {};
+    alignas(16) float m_gateLevel[SEQ_MAX_LANES] = {}; // the lane's clock gate averaged over the sample
+    alignas(16) float m_gateX[SEQ_MAX_LANES] = {};
+    alignas(16) float m_gateY[SEQ_MAX_LANES] = {};
+    alignas(16) float m_gateXorY[SEQ_MAX_LANES] = {};
+    int m_step[SEQ_MAX_LANES] = {};
+    int m_lastStep[SEQ_MAX_LANES] = {};
+    int m_patternIndex[SEQ_MAX_LANES] = {};
+    bool m_xActive[SEQ_MAX_LANES] = {};
+    bool m_yActive[SEQ_MAX_LANES] = {};
+    SeqStepTable<W, H> m_stepTables[SEQ_MAX_LANES];
+    SeqFrame m_frames[SEQ_MAX_LANES]; // what each lane's gate generator is given
+    SeqGateGenerator<W, H> m_gates[SEQ_MAX_LANES];
+
+    // Number of lanes rounded up to whole SIMD groups
+    int NumGroups() const
+    {
+        return (m_numLanes + SEQ_LANE_WIDTH - 1) / SEQ_LANE_WIDTH;
+    }
+
+    void SetNumLanes(int numLanes, const Engine &engine);
+    void Sync(const Engine &engine);
+    Mask LaneSkipMask(int lane, const Mask &gridMask) const;
+    void AdvanceLane(int lane, const Engine &engine, const SeqInputs &in);
+    void UpdateLaneGates(int lane, const Engine &engine);
+
+    // The gate mode, band-limiting and step gates of `gates`, for every lane
+    void SetGates(const SeqGateGenerator<W, H> &gates);
+
+    void SetSampleRate(float sampleRate)
+    {
+        if (sampleRate != m_gates[0].m_sampleRate)
+        {
+            for (int lane = 0; lane < SEQ_MAX_LANES; lane++)
+            {
+                m_gates[lane].SetSampleRate(sampleRate);
+            }
+        }
+    }
+
+    // Call once per sample after engine.Process() with the same inputs
+    void Process(Engine &engine, const SeqFrame &frame, const SeqInputs &in);
+};
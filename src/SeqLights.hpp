@@ -0,0 +1,106 @@
+#pragma once
+
+// Panel lights updated once every few hundred samples instead of per sample.
+// Falls use the exact exponential decay for the time since the last update,
+// so lights fade the same whatever the divider, and only lights that are
+// still fading or were given a new target are written out.  A light that
+// just rose is written at its new value first and fades from the next update.
+
+#include <cmath>
+
+#include "SeqStepMask.hpp"
+
+#define SEQ_LIGHT_LAMBDA 30.f    // fall rate of rack::engine::Light::setSmoothBrightness
+#define SEQ_LIGHT_SETTLED 1e-4f
+
+template <int N>
+struct SeqLightBank
+{
+    float m_value[N] = {};
+    float m_target[N] = {};
+    SeqStepMask<N> m_dirty;
+    SeqStepMask<N> m_risen; // written as they are on the next update
+    float m_deltaTime = 0.f;
+    float m_decay = 0.f;
+
+    void SetDeltaTime(float deltaTime)
+    {
+        if (deltaTime != m_deltaTime)
+        {
+            m_deltaTime = deltaTime;
+            m_decay = std::exp(-SEQ_LIGHT_LAMBDA * deltaTime);
+        }
+    }
+
+    // Same curve as Light::setSmoothBrightness: rises at once, falls slowly.
+    // Cheap when nothing changed, so it can be called every update.
+    void SetTarget(int i, float brightness)
+    {
+        float v = (brightness > 0.f) ? brightness * brightness : 0.f;
+        if (v != m_target[i] || v > m_value[i])
+        {
+            m_target[i] = v;
+            if (v >= m_value[i])
+            {
+                m_value[i] = v;
+                m_risen.Set(i, true);
+            }
+            m_dirty.Set(i, true);
+        }
+    }
+
+    // Lights up at once and fades out, eg for a trigger
+    void Flash(int i)
+    {
+        m_target[i] = 0.f;
+        m_value[i] = 1.f;
+        m_dirty.Set(i, true);
+        m_risen.Set(i, true);
+    }
+
+    // No smoothing either way
+    void SetValue(int i, float value)
+    {
+        if (value != m_value[i] || value != m_target[i])
+        {
+            m_value[i] = value;
+            m_target[i] = value;
+            m_dirty.Set(i, true);
+        }
+    }
+
+    // Moves the fading lights on by deltaTime and calls write(i, value) for
+    // every light that changed
+    template <typename TWrite>
+    void Update(TWrite write)
+    {
+        for (int w = 0; w < SeqStepMask<N>::kWords; w++)
+        {
+            uint64_t word = m_dirty.m_words[w];
+            while (word)
+            {
+                int i = (w << 6) + SeqCountTrailingZeros(word);
+                word &= word - 1;
+
+                if (m_risen.Test(i))
+                {
+                    m_risen.Set(i, false);
+                    if (m_value[i] > m_target[i])
+                    {
+                        write(i, m_value[i]);
+                        continue;
+                    }
+                }
+
+                float v = m_target[i] + (m_value[i] - m_target[i]) * m_decay;
+                if (m_value[i] <= m_target[i] || v - m_target[i] < SEQ_LIGHT_SETTLED)
+                {
+                    v = m_target[i];
+                    m_dirty.Set(i, false);
+                }
+                m_value[i] = v;
+                write(i, v);
+            }
+        }
+    }
+};
@@ -0,0 +1,491 @@
+#include "SeqPatternCompiler.hpp"
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+// Keeps nested rep() from building huge intermediate lists
+#define SEQ_MAX_EXPRESSION_LENGTH 4096
+
+namespace
+{
+
+template <int W, int H>
+struct Parser
+{
+    typedef SeqGrid<W, H> Grid;
+    typedef SeqPatterns<W, H> Builtins;
+
+    const std::string &m_source;
+    size_t m_pos = 0;
+    std::string m_error;
+
+    explicit Parser(const std::string &source) : m_source(source)
+    {
+    }
+
+    bool Fail(const char *message)
+    {
+        if (m_error.empty())
+        {
+            char buf[128];
+            snprintf(buf, sizeof(buf), "%s at column %d", message, (int)m_pos + 1);
+            m_error = buf;
+        }
+        return false;
+    }
+
+    void SkipSpace()
+    {
+        while (m_pos < m_source.size() && isspace((unsigned char)m_source[m_pos]))
+        {
+            m_pos++;
+        }
+    }
+
+    bool AtEnd()
+    {
+        SkipSpace();
+        return m_pos >= m_source.size();
+    }
+
+    char Peek()
+    {
+        SkipSpace();
+        return (m_pos < m_source.size()) ? m_source[m_pos] : '\0';
+    }
+
+    bool Expect(char c)
+    {
+        if (Peek() != c)
+        {
+            char message[32];
+            snprintf(message, sizeof(message), "expected '%c'", c);
+            return Fail(message);
+        }
+        m_pos++;
+        return true;
+    }
+
+    bool ParseNumber(int &value)
+    {
+        SkipSpace();
+        size_t start = m_pos;
+        value = 0;
+        while (m_pos < m_source.size() && isdigit((unsigned char)m_source[m_pos]) && m_pos - start < 9)
+        {
+            value = value * 10 + (m_source[m_pos] - '0');
+            m_pos++;
+        }
+        if (m_pos == start)
+        {
+            return Fail("expected a number");
+        }
+        return true;
+    }
+
+    bool ParseStep(int &step)
+    {
+        if (!ParseNumber(step))
+        {
+            return false;
+        }
+        if (step < 1 || step > Grid::kSteps)
+        {
+            return FailStepRange();
+        }
+        step--;
+        return true;
+    }
+
+    bool FailStepRange()
+    {
+        char message[32];
+        snprintf(message, sizeof(message), "step out of range 1-%d", Grid::kSteps);
+        return Fail(message);
+    }
+
+    std::string ParseName()
+    {
+        SkipSpace();
+        size_t start = m_pos;
+        while (m_pos < m_source.size() && isalpha((unsigned char)m_source[m_pos]))
+        {
+            m_pos++;
+        }
+        return m_source.substr(start, m_pos - start);
+    }
+
+    // list := term { term }
+    bool ParseList(std::vector<int> &out)
+    {
+        do
+        {
+            if (!ParseTerm(out))
+            {
+                return false;
+            }
+            if (out.size() > SEQ_MAX_EXPRESSION_LENGTH)
+            {
+                return Fail("pattern too long");
+            }
+        }
+        while (!AtEnd() && Peek() != ',' && Peek() != ')');
+        return true;
+    }
+
+    bool ParseTerm(std::vector<int> &out)
+    {
+        if (isdigit((unsigned char)Peek()))
+        {
+            int first;
+            if (!ParseStep(first))
+            {
+                return false;
+            }
+            if (Peek() != '-')
+            {
+                out.push_back(first);
+                return true;
+            }
+            m_pos++;
+            int last;
+            if (!ParseStep(last))
+            {
+                return false;
+            }
+            int dir = (last >= first) ? 1 : -1;
+            for (int i = first; i != last + dir; i += dir)
+            {
+                out.push_back(i);
+            }
+            return true;
+        }
+
+        if (!isalpha((unsigned char)Peek()))
+        {
+            return Fail("expected a step or a function");
+        }
+
+        std::string name = ParseName();
+        int builtin = BuiltinByName(name);
+        if (builtin > 0)
+        {
+            AppendBuiltin(builtin, out);
+            return true;
+        }
+        return ParseCall(name, out);
+    }
+
+    static int BuiltinByName(const std::string &name)
+    {
+        static const char *const names[SEQ_NUM_PATTERNS] =
+        {
+            "forward", "backward", "pingpong", "snake", "osnake", "bsnake", "ppsnake", "circle"
+        };
+        for (int i = 0; i < SEQ_NUM_PATTERNS; i++)
+        {
+            if (name == names[i])
+            {
+                return i + 1;
+            }
+        }
+        return 0;
+    }
+
+    static void AppendBuiltin(int pattern, std::vector<int> &out)
+    {
+        for (int i = 0; i < Builtins::Length(pattern); i++)
+        {
+            out.push_back(Builtins::Step(pattern, i));
+        }
+    }
+
+    bool ParseCall(const std::string &name, std::vector<int> &out)
+    {
+        if (!Expect('('))
+        {
+            return false;
+        }
+
+        if (name == "rev" || name == "rot" || name == "rep")
+        {
+            std::vector<int> list;
+            if (!ParseList(list))
+            {
+                return false;
+            }
+            int n = 0;
+            if (name != "rev")
+            {
+                if (!Expect(',') || !ParseNumber(n))
+                {
+                    return false;
+                }
+            }
+            if (!Expect(')'))
+            {
+                return false;
+            }
+
+            if (name == "rev")
+            {
+                out.insert(out.end(), list.rbegin(), list.rend());
+            }
+            else if (name == "rot")
+            {
+                for (size_t i = 0; i < list.size(); i++)
+                {
+                    out.push_back(list[(i + n) % list.size()]);
+                }
+            }
+            else
+            {
+                if ((size_t)n * list.size() > SEQ_MAX_EXPRESSION_LENGTH)
+                {
+                    return Fail("pattern too long");
+                }
+                for (int r = 0; r < n; r++)
+                {
+                    out.insert(out.end(), list.begin(), list.end());
+                }
+            }
+            return true;
+        }
+
+        int args[3] = {0, 0, 0};
+        int numArgs = 0;
+        do
+        {
+            if (numArgs == 3)
+            {
+                return Fail("too many arguments");
+            }
+            if (numArgs > 0)
+            {
+                m_pos++; // ','
+            }
+            if (!ParseNumber(args[numArgs++]))
+            {
+                return false;
+            }
+        }
+        while (Peek() == ',');
+        if (!Expect(')'))
+        {
+            return false;
+        }
+
+        if (name == "pattern")
+        {
+            if (numArgs != 1 || args[0] < 1 || args[0] > SEQ_NUM_PATTERNS)
+            {
+                return Fail("pattern() takes a number 1-8");
+            }
+            AppendBuiltin(args[0], out);
+            return true;
+        }
+        if (name == "euclid")
+        {
+            return Euclid(args, numArgs, out);
+        }
+        if (name == "knight")
+        {
+            return Knight(args, numArgs, out);
+        }
+        if (name == "walk")
+        {
+            return Walk(args, numArgs, out);
+        }
+        return Fail("unknown function");
+    }
+
+    bool CheckLength(int length)
+    {
+        if (length < 1 || length > Grid::kMaxPatternLength)
+        {
+            char message[32];
+            snprintf(message, sizeof(message), "length out of range 1-%d", Grid::kMaxPatternLength);
+            return Fail(message);
+        }
+        return true;
+    }
+
+    bool Euclid(const int *args, int numArgs, std::vector<int> &out)
+    {
+        if (numArgs < 2)
+        {
+            return Fail("euclid() takes hits, steps and an optional rotation");
+        }
+        int hits = args[0];
+        int steps = args[1];
+        int rotation = (numArgs > 2) ? args[2] : 0;
+        if (steps < 1 || steps > Grid::kSteps || hits < 1 || hits > steps)
+        {
+            char message[48];
+            snprintf(message, sizeof(message), "euclid() needs 1 <= hits <= steps <= %d", Grid::kSteps);
+            return Fail(message);
+        }
+        for (int i = 0; i < steps; i++)
+        {
+            int pos = (i + rotation) % steps;
+            if ((pos * hits) % steps < hits)
+            {
+                out.push_back(i);
+            }
+        }
+        return true;
+    }
+
+    bool Knight(const int *args, int numArgs, std::vector<int> &out)
+    {
+        static const int moves[8][2] = {{1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
+
+        if (numArgs != 2 || args[0] < 1 || args[0] > Grid::kSteps)
+        {
+            return Fail("knight() takes a start step and a length");
+        }
+        if (!CheckLength(args[1]))
+        {
+            return false;
+        }
+
+        // Always take the legal move to the least visited cell, first wins ties
+        int visits[Grid::kSteps] = {};
+        int cell = args[0] - 1;
+        for (int i = 0; i < args[1]; i++)
+        {
+            out.push_back(cell);
+            visits[cell]++;
+            int x = Grid::X(cell);
+            int y = Grid::Y(cell);
+            int best = -1;
+            for (int m = 0; m < 8; m++)
+            {
+                int nx = x + moves[m][0];
+                int ny = y + moves[m][1];
+                if (nx < 0 || ny < 0 || nx >= W || ny >= H)
+                {
+                    continue;
+                }
+                int next = ny * W + nx;
+                if (best < 0 || visits[next] < visits[best])
+                {
+                    best = next;
+                }
+            }
+            cell = best;
+        }
+        return true;
+    }
+
+    bool Walk(const int *args, int numArgs, std::vector<int> &out)
+    {
+        if (numArgs < 2)
+        {
+            return Fail("walk() takes a seed, a length and an optional start step");
+        }
+        if (!CheckLength(args[1]))
+        {
+            return false;
+        }
+        int start = (numArgs > 2) ? args[2] : 1;
+        if (start < 1 || start > Grid::kSteps)
+        {
+            return FailStepRange();
+        }
+
+        // xorshift32, so a seed always gives the same walk
+        uint32_t state = (uint32_t)args[0] * 2654435761u + 1;
+        int cell = start - 1;
+        for (int i = 0; i < args[1]; i++)
+        {
+            out.push_back(cell);
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            int x = Grid::X(cell);
+            int y = Grid::Y(cell);
+            switch (state & 3)
+            {
+                case 0: x = (x + 1) % W; break;
+                case 1: x = (x + W - 1) % W; break;
+                case 2: y = (y + 1) % H; break;
+                default: y = (y + H - 1) % H; break;
+            }
+            cell = y * W + x;
+        }
+        return true;
+    }
+};
+
+}
+
+template <int W, int H>
+bool SeqPatternCompiler<W, H>::Compile(const std::string &source, std::vector<uint8_t> &steps, std::string &error)
+{
+    Parser<W, H> parser(source);
+    std::vector<int> list;
+    steps.clear();
+
+    if (parser.AtEnd())
+    {
+        error = "empty pattern";
+        return false;
+    }
+    if (!parser.ParseList(list))
+    {
+        error = parser.m_error;
+        return false;
+    }
+    if (!parser.AtEnd())
+    {
+        parser.Fail("unexpected character");
+        error = parser.m_error;
+        return false;
+    }
+    if (list.empty())
+    {
+        error = "empty pattern";
+        return false;
+    }
+    if (list.size() > (size_t)Grid::kMaxPatternLength)
+    {
+        char message[48];
+        snprintf(message, sizeof(message), "pattern longer than %d steps", Grid::kMaxPatternLength);
+        error = message;
+        return false;
+    }
+
+    steps.assign(list.begin(), list.end());
+    error.clear();
+    return true;
+}
+
+template <int W, int H>
+void SeqPatternCompiler<W, H>::BuildSet(const std::string *sources, int count, SeqPatternSet<W, H> &set, std::string *errors, int *patternOfSlot)
+{
+    std::vector<uint8_t> steps;
+    set.SetBuiltins();
+    for (int i = 0; i < count; i++)
+    {
+        patternOfSlot[i] = 0;
+        errors[i].clear();
+        if (sources[i].empty())
+        {
+            continue;
+        }
+        if (!Compile(sources[i], steps, errors[i]))
+        {
+            // The first built-in stands in, so the slots after this one
+            // stay on the same pattern knob/CV positions
+            steps.assign(set.m_steps + set.m_offsets[0], set.m_steps + set.m_offsets[1]);
+        }
+        if (set.Append(steps.data(), steps.size()))
+        {
+            patternOfSlot[i] = set.m_numPatterns;
+        }
+    }
+}
+
+#define SEQ_INSTANTIATE(W, H) template struct SeqPatternCompiler<W, H>;
+SEQ_FOR_EACH_GRID(SEQ_INSTANTIATE)
@@ -0,0 +1,44 @@
+#pragma once
+
+// Compiles a user pattern expression into grid step indices (0-based) in the
+// flat format SeqPatternSet stores.  Runs on the UI thread; it allocates.
+//
+// An expression is a space separated list of terms.  Steps are numbered
+// 1 to W * H (1-16 on the 4x4 grid), left to right and top to bottom.
+//
+//   5                  a single step
+//   1-4  16-13         a run of steps, either direction
+//   forward ... circle one of the built-in patterns by name (see below)
+//   pattern(n)         built-in pattern n (1-8)
+//   rev(list)          list backwards
+//   rot(list, n)       list rotated left by n entries
+//   rep(list, n)       list repeated n times
+//   euclid(k, n, r)    k hits spread over steps 1..n, rotated by r (r optional)
+//   knight(start, len) len knight's moves around the grid from start
+//   walk(seed, len, start)  seeded random walk to neighbouring cells
+//                      (start optional, defaults to 1)
+//
+// Built-in names: forward, backward, pingpong, snake, osnake, bsnake,
+// ppsnake, circle.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SeqPatterns.hpp"
+
+template <int W, int H>
+struct SeqPatternCompiler
+{
+    typedef SeqGrid<W, H> Grid;
+
+    // Returns false and fills error if the expression is invalid or its
+    // result is empty or longer than Grid::kMaxPatternLength
+    static bool Compile(const std::string &source, std::vector<uint8_t> &steps, std::string &error);
+
+    // Resets `set` to the built-ins and appends every non-empty source, as
+    // the first built-in pattern if it doesn't compile.  errors[i] gets the
+    // compile error of slot i (or is cleared) and patternOfSlot[i] the
+    // 1-based pattern number it became (or 0 if the source is empty).
+    static void BuildSet(const std::string *sources, int count, SeqPatternSet<W, H> &set, std::string *errors, int *patternOfSlot);
+};
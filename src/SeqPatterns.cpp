@@ -0,0 +1,75 @@
+#include "SeqPatterns.hpp"
+
+const char *SeqPatternName(int pattern)
+{
+    static const char *const names[SEQ_NUM_PATTERNS] =
+    {
+        "Forward",
+        "Backward",
+        "Ping pong",
+        "Snake",
+        "Opposite snake",
+        "Backward snake",
+        "Ping pong snake",
+        "Circle"
+    };
+    if (pattern < 1 || pattern > SEQ_NUM_PATTERNS)
+    {
+        return "";
+    }
+    return names[pattern - 1];
+}
+
+template <int W, int H>
+void SeqPatternSet<W, H>::SetBuiltins()
+{
+    typedef SeqPatterns<W, H> Builtins;
+    m_numPatterns = SEQ_NUM_PATTERNS;
+    for (int i = 0; i <= SEQ_NUM_PATTERNS; i++)
+    {
+        m_offsets[i] = Builtins::kOffsets[i];
+    }
+    for (int i = 0; i < Builtins::kOffsets[SEQ_NUM_PATTERNS]; i++)
+    {
+        m_steps[i] = Builtins::kSteps[i];
+    }
+}
+
+template <int W, int H>
+bool SeqPatternSet<W, H>::Append(const uint8_t *steps, int length)
+{
+    if (m_numPatterns >= SEQ_MAX_PATTERNS || length < 1 || length > Grid::kMaxPatternLength)
+    {
+        return false;
+    }
+    int offset = m_offsets[m_numPatterns];
+    for (int i = 0; i < length; i++)
+    {
+        m_steps[offset + i] = steps[i];
+    }
+    m_numPatterns++;
+    m_offsets[m_numPatterns] = offset + length;
+    return true;
+}
+
+template <int W, int H>
+void SeqStepTable<W, H>::Build(const SeqPatternSet<W, H> &patterns, int pattern, int numSteps, const Mask &skipMask)
+{
+    m_generation = patterns.m_generation;
+    m_pattern = pattern;
+    m_numSteps = numSteps;
+    m_skipMask = skipMask;
+    m_length = patterns.Length(pattern);
+
+    m_active.Clear();
+    for (int i = 0; i < m_length; i++)
+    {
+        m_steps[i] = patterns.Step(pattern, i);
+        m_active.Set(i, !skipMask.Test(m_steps[i]));
+    }
+}
+
+#define SEQ_INSTANTIATE(W, H)          \
+    template struct SeqPatternSet<W, H>; \
+    template struct SeqStepTable<W, H>;
+SEQ_FOR_EACH_GRID(SEQ_INSTANTIATE)
@@ -0,0 +1,233 @@
+#pragma once
+
+// Grid traversal orders (built-in and user defined) and the per-sequencer
+// lookup table that turns "advance to the next non-skipped step" into a
+// single array read.
+
+#include <cstdint>
+
+#include "SeqGrid.hpp"
+
+#define SEQ_NUM_PATTERNS 8
+#define SEQ_MAX_USER_PATTERNS 8
+#define SEQ_MAX_PATTERNS (SEQ_NUM_PATTERNS + SEQ_MAX_USER_PATTERNS)
+
+// Name of built-in pattern `pattern` (1-based)
+const char *SeqPatternName(int pattern);
+
+// The built-in patterns of a W x H grid as C++11 constexpr expressions, so
+// their tables are generated at compile time for every grid size.  On the
+// 4x4 grid they are the original hand written tables.
+template <int W, int H>
+struct SeqBuiltinPattern
+{
+    static constexpr int kSteps = W * H;
+
+    static constexpr int Length(int pattern)
+    {
+        return (pattern == 3 || pattern == 7) ? 2 * kSteps - 2 : kSteps;
+    }
+
+    // Sum of the lengths of patterns 1..pattern
+    static constexpr int Offset(int pattern)
+    {
+        return (pattern == 0) ? 0 : Offset(pattern - 1) + Length(pattern);
+    }
+
+    // Rows left to right, every other row reversed (`opposite` starts reversed)
+    static constexpr int Snake(int i, bool opposite)
+    {
+        return (i / W) * W + ((((i / W) % 2 == 0) != opposite) ? i % W : W - 1 - i % W);
+    }
+
+    // The opposite snake run from the bottom row up
+    static constexpr int BackwardSnake(int i)
+    {
+        return (H - 1 - i / W) * W + (((i / W) % 2 == 0) ? W - 1 - i % W : i % W);
+    }
+
+    // Clockwise spiral from the top left corner of the w x h box at (x, y)
+    static constexpr int Spiral(int i, int x, int y, int w, int h)
+    {
+        return (h == 1) ? y * W + x + i :
+               (w == 1) ? (y + i) * W + x :
+               (i < w) ? y * W + x + i :
+               (i < w + h - 1) ? (y + i - w + 1) * W + x + w - 1 :
+               (i < 2 * w + h - 2) ? (y + h - 1) * W + x + w - 1 - (i - w - h + 2) :
+               (i < 2 * w + 2 * h - 4) ? (y + h - 1 - (i - 2 * w - h + 3)) * W + x :
+               Spiral(i - (2 * w + 2 * h - 4), x + 1, y + 1, w - 2, h - 2);
+    }
+
+    static constexpr int Step(int pattern, int i)
+    {
+        return (pattern == 1) ? i :
+               (pattern == 2) ? kSteps - 1 - i :
+               (pattern == 3) ? ((i < kSteps) ? i : 2 * kSteps - 2 - i) :
+               (pattern == 4) ? Snake(i, false) :
+               (pattern == 5) ? Snake(i, true) :
+               (pattern == 6) ? BackwardSnake(i) :
+               (pattern == 7) ? Snake((i < kSteps) ? i : 2 * kSteps - 2 - i, true) :
+               Spiral(i, 0, 0, W, H);
+    }
+
+    // Step at `flat` in the concatenation of patterns `pattern`..8
+    static constexpr int At(int flat, int pattern = 1)
+    {
+        return (flat < Length(pattern)) ? Step(pattern, flat) : At(flat - Length(pattern), pattern + 1);
+    }
+};
+
+// C++11 stand-in for std::make_integer_sequence, log(N) deep so the 16x16
+// tables stay within the compiler's template depth
+template <int... I>
+struct SeqIndices
+{
+};
+
+template <typename A, typename B>
+struct SeqConcatIndices;
+
+template <int... A, int... B>
+struct SeqConcatIndices<SeqIndices<A...>, SeqIndices<B...>>
+{
+    typedef SeqIndices<A..., (int)sizeof...(A) + B...> Type;
+};
+
+template <int N>
+struct SeqMakeIndices
+{
+    typedef typename SeqConcatIndices<typename SeqMakeIndices<N / 2>::Type, typename SeqMakeIndices<N - N / 2>::Type>::Type Type;
+};
+
+template <>
+struct SeqMakeIndices<0>
+{
+    typedef SeqIndices<> Type;
+};
+
+template <>
+struct SeqMakeIndices<1>
+{
+    typedef SeqIndices<0> Type;
+};
+
+// The built-in patterns flattened into one array.  Pattern p (1-based) occupies
+// kSteps[kOffsets[p - 1]] up to kSteps[kOffsets[p]].
+template <int W, int H, typename Indices = typename SeqMakeIndices<SeqBuiltinPattern<W, H>::Offset(SEQ_NUM_PATTERNS)>::Type>
+struct SeqPatterns;
+
+template <int W, int H, int... I>
+struct SeqPatterns<W, H, SeqIndices<I...>>
+{
+    typedef SeqBuiltinPattern<W, H> Builtin;
+
+    static constexpr uint8_t kSteps[sizeof...(I)] = {(uint8_t)Builtin::At(I)...};
+
+    static constexpr int16_t kOffsets[SEQ_NUM_PATTERNS + 1] =
+    {
+        Builtin::Offset(0), Builtin::Offset(1), Builtin::Offset(2), Builtin::Offset(3), Builtin::Offset(4),
+        Builtin::Offset(5), Builtin::Offset(6), Builtin::Offset(7), Builtin::Offset(8)
+    };
+
+    static constexpr int Length(int pattern)
+    {
+        return kOffsets[pattern] - kOffsets[pattern - 1];
+    }
+
+    static constexpr int Step(int pattern, int index)
+    {
+        return kSteps[kOffsets[pattern - 1] + index];
+    }
+};
+
+template <int W, int H, int... I>
+constexpr uint8_t SeqPatterns<W, H, SeqIndices<I...>>::kSteps[sizeof...(I)];
+
+template <int W, int H, int... I>
+constexpr int16_t SeqPatterns<W, H, SeqIndices<I...>>::kOffsets[SEQ_NUM_PATTERNS + 1];
+
+static_assert(SeqPatterns<4, 4>::kOffsets[SEQ_NUM_PATTERNS] == 156, "4x4 built-ins changed length");
+static_assert(SeqPatterns<4, 4>::Step(7, 16) == 14 && SeqPatterns<4, 4>::Step(8, 15) == 9, "4x4 built-ins changed order");
+
+// Every pattern the sequencer can currently select, in the same flat format:
+// the built-ins followed by the compiled user patterns.  Fixed size so it can
+// be handed to the engine through a SeqTripleBuffer without allocating.
+template <int W, int H>
+struct SeqPatternSet
+{
+    typedef SeqGrid<W, H> Grid;
+
+    uint32_t m_generation = 0;
+    int m_numPatterns = 0;
+    int16_t m_offsets[SEQ_MAX_PATTERNS + 1] = {};
+    uint8_t m_steps[SEQ_MAX_PATTERNS * Grid::kMaxPatternLength] = {};
+
+    SeqPatternSet()
+    {
+        SetBuiltins();
+    }
+
+    void SetBuiltins();
+    bool Append(const uint8_t *steps, int length);
+
+    int Length(int pattern) const
+    {
+        return m_offsets[pattern] - m_offsets[pattern - 1];
+    }
+
+    int Step(int pattern, int index) const
+    {
+        return m_steps[m_offsets[pattern - 1] + index];
+    }
+};
+
+// One pattern with the skip mask folded in: bit i of m_active is set when
+// pattern index i lands on a step that isn't skipped, so finding the next
+// step is a count-trailing-zeros search whatever the number of skips.
+// Rebuilt only when the pattern set, pattern, step count or skips change.
+template <int W, int H>
+struct SeqStepTable
+{
+    typedef SeqGrid<W, H> Grid;
+    typedef typename Grid::Mask Mask;
+
+    uint32_t m_generation = 0;
+    int m_pattern = 0;
+    int m_numSteps = 0;
+    int m_length = 1;
+    Mask m_skipMask;
+    SeqStepMask<Grid::kMaxPatternLength> m_active;
+    uint8_t m_steps[Grid::kMaxPatternLength] = {};
+
+    void Build(const SeqPatternSet<W, H> &patterns, int pattern, int numSteps, const Mask &skipMask);
+
+    void Update(const SeqPatternSet<W, H> &patterns, int pattern, int numSteps, const Mask &skipMask)
+    {
+        if (patterns.m_generation != m_generation || pattern != m_pattern || numSteps != m_numSteps || skipMask != m_skipMask)
+        {
+            Build(patterns, pattern, numSteps, skipMask);
+        }
+    }
+
+    // Moves patternIndex on and returns the grid step it landed on.  Same
+    // result as the original walk: wrap after numSteps, skipped steps don't
+    // count, and give up after one try per grid step if everything is skipped.
+    int Advance(int &patternIndex) const
+    {
+        int index = patternIndex + 1;
+        if (index >= m_numSteps)
+        {
+            index = 0;
+        }
+        index %= m_length;
+
+        int next = m_active.FindNext(index);
+        int distance = (next - index + m_length) % m_length;
+        if (next < 0 || distance >= Grid::kSteps)
+        {
+            next = (index + Grid::kSteps - 1) % m_length;
+        }
+        patternIndex = next;
+        return m_steps[next];
+    }
+};
@@ -0,0 +1,245 @@
+#pragma once
+
+// Per-instance cost of each stage of process(), for the context menu.  A
+// stage is timed about once every SEQ_PROFILE_INTERVAL samples (with
+// steady_clock, which is portable, less the clock's own overhead), and the
+// calls in between pay a counter decrement.  Times go into log-spaced
+// histograms with four buckets per octave, good for a p99 to within 25%.
+// The audio thread is the only writer; the UI thread reads through relaxed
+// atomics.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#define SEQ_PROFILE_INTERVAL 1024 // samples between timed calls of a stage
+#define SEQ_PROFILE_BUCKETS 64    // up to 2^16 ns, longer times land in the last
+
+// The engine's event path only runs on clock edges and input changes, so its
+// stages are timed as if they ran once every this many samples
+#define SEQ_PROFILE_EVENT_RATE 64
+
+struct SeqProfileHistogram
+{
+    std::atomic<uint32_t> m_buckets[SEQ_PROFILE_BUCKETS];
+    std::atomic<uint32_t> m_count;
+    std::atomic<uint32_t> m_minNs;
+    std::atomic<uint32_t> m_maxNs;
+    std::atomic<uint64_t> m_sumNs;
+
+    SeqProfileHistogram()
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        for (int i = 0; i < SEQ_PROFILE_BUCKETS; i++)
+        {
+            m_buckets[i].store(0, std::memory_order_relaxed);
+        }
+        m_count.store(0, std::memory_order_relaxed);
+        m_minNs.store(UINT32_MAX, std::memory_order_relaxed);
+        m_maxNs.store(0, std::memory_order_relaxed);
+        m_sumNs.store(0, std::memory_order_relaxed);
+    }
+
+    static int Bucket(uint32_t ns)
+    {
+        if (ns < 4)
+        {
+            return ns;
+        }
+        int octave = 2;
+        while (ns >> (octave + 1))
+        {
+            octave++;
+        }
+        int bucket = 4 * (octave - 1) + ((ns >> (octave - 2)) & 3);
+        return (bucket < SEQ_PROFILE_BUCKETS) ? bucket : SEQ_PROFILE_BUCKETS - 1;
+    }
+
+    // Shortest time that lands in `bucket`
+    static uint32_t BucketNs(int bucket)
+    {
+        if (bucket < 4)
+        {
+            return bucket;
+        }
+        return (uint32_t)(4 + bucket % 4) << (bucket / 4 - 1);
+    }
+
+    // Single writer, so plain read-modify-writes are enough
+    void Add(uint32_t ns)
+    {
+        std::atomic<uint32_t> &bucket = m_buckets[Bucket(ns)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        m_count.store(m_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        m_sumNs.store(m_sumNs.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+        if (ns < m_minNs.load(std::memory_order_relaxed))
+        {
+            m_minNs.store(ns, std::memory_order_relaxed);
+        }
+        if (ns > m_maxNs.load(std::memory_order_relaxed))
+        {
+            m_maxNs.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    uint32_t Count() const
+    {
+        return m_count.load(std::memory_order_relaxed);
+    }
+
+    uint32_t MinNs() const
+    {
+        return Count() ? m_minNs.load(std::memory_order_relaxed) : 0;
+    }
+
+    uint32_t MaxNs() const
+    {
+        return m_maxNs.load(std::memory_order_relaxed);
+    }
+
+    double MeanNs() const
+    {
+        uint32_t count = Count();
+        return count ? (double)m_sumNs.load(std::memory_order_relaxed) / count : 0.0;
+    }
+
+    // Upper edge of the bucket holding the given fraction of the times
+    uint32_t PercentileNs(double fraction) const
+    {
+        uint32_t count = Count();
+        uint64_t seen = 0;
+        for (int i = 0; i < SEQ_PROFILE_BUCKETS; i++)
+        {
+            seen += m_buckets[i].load(std::memory_order_relaxed);
+            if (count && seen >= fraction * count)
+            {
+                return (i + 1 < SEQ_PROFILE_BUCKETS) ? BucketNs(i + 1) - 1 : MaxNs();
+            }
+        }
+        return MaxNs();
+    }
+};
+
+struct SeqProfiler
+{
+    typedef std::chrono::steady_clock Clock;
+
+    enum Stage
+    {
+        ENGINE,          // SeqEngine::Process, mostly coasting between events
+        CLOCK_AND_RESET, // the engine's event path, see SEQ_PROFILE_EVENT_RATE
+        ADVANCE_STEP,
+        XY_TRIGGERS,
+        GATES,           // gate generator and the X/Y lights
+        OUTPUTS,         // lanes and output voltages
+        CONTROLS,        // commands, knobs and buttons, once per UI block
+        LIGHTS,          // panel lights, once per light block
+        NUM_STAGES
+    };
+
+    SeqProfileHistogram m_stages[NUM_STAGES];
+    int m_interval[NUM_STAGES];
+    int m_countdown[NUM_STAGES];
+    uint32_t m_clockNs = 0; // cost of reading the clock, taken off every time
+
+    SeqProfiler()
+    {
+        for (int i = 0; i < NUM_STAGES; i++)
+        {
+            m_interval[i] = SEQ_PROFILE_INTERVAL;
+            m_countdown[i] = 1 + i; // staggered so stages aren't all timed on one sample
+        }
+
+        uint32_t clockNs = UINT32_MAX;
+        for (int i = 0; i < 64; i++)
+        {
+            Clock::time_point start = Clock::now();
+            clockNs = std::min(clockNs, ElapsedNs(start, Clock::now()));
+        }
+        m_clockNs = clockNs;
+    }
+
+    static const char *Name(Stage stage)
+    {
+        switch (stage)
+        {
+            case ENGINE: return "Engine";
+            case CLOCK_AND_RESET: return "Clock and reset";
+            case ADVANCE_STEP: return "Advance step";
+            case XY_TRIGGERS: return "X/Y triggers";
+            case GATES: return "Gates";
+            case OUTPUTS: return "Outputs";
+            case CONTROLS: return "Controls";
+            case LIGHTS: return "Lights";
+            default: return "";
+        }
+    }
+
+    // Stages that run once every `samples` samples are timed on as many fewer
+    // calls, so every stage is timed about once per SEQ_PROFILE_INTERVAL
+    void SetRate(Stage stage, int samples)
+    {
+        m_interval[stage] = std::max(1, SEQ_PROFILE_INTERVAL / std::max(1, samples));
+        m_countdown[stage] = std::min(m_countdown[stage], m_interval[stage]);
+    }
+
+    void Reset()
+    {
+        for (int i = 0; i < NUM_STAGES; i++)
+        {
+            m_stages[i].Reset();
+        }
+    }
+
+    static uint32_t ElapsedNs(Clock::time_point start, Clock::time_point end)
+    {
+        int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        return (ns < 0) ? 0 : (ns > UINT32_MAX) ? UINT32_MAX : (uint32_t)ns;
+    }
+
+    // True when this call of `stage` is to be timed, start then holds the time
+    bool Start(Stage stage, Clock::time_point &start)
+    {
+        if (--m_countdown[stage] > 0)
+        {
+            return false;
+        }
+        m_countdown[stage] = m_interval[stage];
+        start = Clock::now();
+        return true;
+    }
+
+    void Stop(Stage stage, Clock::time_point start)
+    {
+        uint32_t ns = ElapsedNs(start, Clock::now());
+        m_stages[stage].Add((ns > m_clockNs) ? ns - m_clockNs : 0);
+    }
+};
+
+// Times one stage when the profiler says this call is sampled.  A null
+// profiler times nothing.
+struct SeqProfileScope
+{
+    SeqProfiler *m_profiler;
+    SeqProfiler::Stage m_stage;
+    SeqProfiler::Clock::time_point m_start;
+    bool m_timed;
+
+    SeqProfileScope(SeqProfiler *profiler, SeqProfiler::Stage stage)
+        : m_profiler(profiler), m_stage(stage), m_timed(profiler && profiler->Start(stage, m_start))
+    {
+    }
+
+    ~SeqProfileScope()
+    {
+        if (m_timed)
+        {
+            m_profiler->Stop(m_stage, m_start);
+        }
+    }
+};
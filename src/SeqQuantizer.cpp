@@ -0,0 +1,81 @@
+#include "SeqQuantizer.hpp"
+
+#include <cstdlib>
+
+const char *SeqScale::Name(Scale scale)
+{
+    static const char *const names[NUM_SCALES] = {
+        "Off",
+        "Chromatic",
+        "Major",
+        "Minor",
+        "Harmonic minor",
+        "Dorian",
+        "Phrygian",
+        "Lydian",
+        "Mixolydian",
+        "Major pentatonic",
+        "Minor pentatonic",
+        "Blues",
+        "Whole tone"
+    };
+    return names[scale];
+}
+
+const char *SeqScale::RootName(int root)
+{
+    static const char *const names[12] = {"C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
+    return names[root];
+}
+
+uint16_t SeqScale::Notes(Scale scale)
+{
+    switch (scale)
+    {
+        case MAJOR: return 0xab5;            // 0 2 4 5 7 9 11
+        case MINOR: return 0x5ad;            // 0 2 3 5 7 8 10
+        case HARMONIC_MINOR: return 0x9ad;   // 0 2 3 5 7 8 11
+        case DORIAN: return 0x6ad;           // 0 2 3 5 7 9 10
+        case PHRYGIAN: return 0x5ab;         // 0 1 3 5 7 8 10
+        case LYDIAN: return 0xad5;           // 0 2 4 6 7 9 11
+        case MIXOLYDIAN: return 0x6b5;       // 0 2 4 5 7 9 10
+        case MAJOR_PENTATONIC: return 0x295; // 0 2 4 7 9
+        case MINOR_PENTATONIC: return 0x4a9; // 0 3 5 7 10
+        case BLUES: return 0x4e9;            // 0 3 5 6 7 10
+        case WHOLE_TONE: return 0x555;       // 0 2 4 6 8 10
+        default: return 0xfff;
+    }
+}
+
+template <int W, int H>
+void SeqQuantizer<W, H>::Build()
+{
+    uint16_t notes = SeqScale::Notes(m_scale);
+    for (int bin = 0; bin < SEQ_QUANT_BINS; bin++)
+    {
+        // The bin's middle, in quarter semitones, and the nearest note to
+        // it.  Ties can't happen: the middle is a quarter semitone off any edge.
+        int middle = 2 * bin + 1;
+        int best = 0;
+        int bestDistance = INT32_MAX;
+        for (int note = bin / 2 - 12; note <= bin / 2 + 12; note++)
+        {
+            int distance = std::abs(4 * note - middle);
+            if ((notes >> (((note - m_root) % 12 + 12) % 12) & 1) && distance < bestDistance)
+            {
+                best = note;
+                bestDistance = distance;
+            }
+        }
+        m_table[bin] = best / 12.f;
+    }
+
+    // Quantized pitches are worked out again as they are asked for
+    for (int i = 0; i < W * H; i++)
+    {
+        m_knobs[i] = NAN;
+    }
+}
+
+#define SEQ_INSTANTIATE(W, H) template struct SeqQuantizer<W, H>;
+SEQ_FOR_EACH_GRID(SEQ_INSTANTIATE)
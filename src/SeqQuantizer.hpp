@@ -0,0 +1,100 @@
+#pragma once
+
+// Pitch quantizer for the PITCH output.  The knobs' 0-10V range is split
+// into half-semitone bins, and a table gives the nearest note of the scale
+// for each bin, so quantizing is a multiply and a lookup.  Scale edges fall
+// on whole or half semitones, which are bin edges, so the table is exact.
+// It is rebuilt only when the scale or root changes.  Quantized pitches are
+// also kept per step along with the knob value they came from, so a step's
+// pitch is only worked out again once its knob moves or the table changes.
+
+#include <cmath>
+#include <cstdint>
+
+#include "SeqGrid.hpp"
+
+#define SEQ_QUANT_BINS_PER_OCTAVE 24
+#define SEQ_QUANT_MAX_VOLTS 10
+#define SEQ_QUANT_BINS (SEQ_QUANT_BINS_PER_OCTAVE * SEQ_QUANT_MAX_VOLTS + 1)
+
+struct SeqScale
+{
+    enum Scale
+    {
+        OFF, // knob voltages as they are
+        CHROMATIC,
+        MAJOR,
+        MINOR,
+        HARMONIC_MINOR,
+        DORIAN,
+        PHRYGIAN,
+        LYDIAN,
+        MIXOLYDIAN,
+        MAJOR_PENTATONIC,
+        MINOR_PENTATONIC,
+        BLUES,
+        WHOLE_TONE,
+        NUM_SCALES
+    };
+
+    static const char *Name(Scale scale);
+    static const char *RootName(int root);
+
+    // Bit i set when the note i semitones above the root is in the scale
+    static uint16_t Notes(Scale scale);
+};
+
+template <int W, int H>
+struct SeqQuantizer
+{
+    SeqScale::Scale m_scale = SeqScale::OFF;
+    int m_root = 0; // semitones above C
+    float m_table[SEQ_QUANT_BINS];
+
+    // Per step: the knob value last quantized and what it gave
+    float m_knobs[W * H];
+    float m_pitches[W * H];
+
+    SeqQuantizer()
+    {
+        Build();
+    }
+
+    // Rebuilds the table only when something changed.  True when it did.
+    bool Set(SeqScale::Scale scale, int root)
+    {
+        root = ((root % 12) + 12) % 12;
+        if (scale == m_scale && root == m_root)
+        {
+            return false;
+        }
+        m_scale = scale;
+        m_root = root;
+        Build();
+        return true;
+    }
+
+    void Build();
+
+    float Quantize(float volts) const
+    {
+        if (m_scale == SeqScale::OFF)
+        {
+            return volts;
+        }
+        int bin = (int)(volts * SEQ_QUANT_BINS_PER_OCTAVE);
+        bin = (bin < 0) ? 0 : (bin >= SEQ_QUANT_BINS) ? SEQ_QUANT_BINS - 1 : bin;
+        return m_table[bin];
+    }
+
+    // Step `step`'s pitch for knob value `knob`
+    float Pitch(int step, float knob)
+    {
+        if (knob != m_knobs[step])
+        {
+            m_knobs[step] = knob;
+            m_pitches[step] = Quantize(knob);
+        }
+        return m_pitches[step];
+    }
+};
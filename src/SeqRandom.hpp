@@ -0,0 +1,188 @@
+#pragma once
+
+// Seedable random numbers for the randomize actions and random fills.  Four
+// xoshiro128+ streams run side by side, stored word by word so the compiler
+// steps all four with one set of vector instructions, and single draws are
+// served from the last batch.  It is all integer arithmetic, so a seed and
+// the same sequence of draws give bit-identical results on every platform.
+
+#include <cstdint>
+#include <cstdio>
+
+#define SEQ_RANDOM_LANES 4
+#define SEQ_RANDOM_DEFAULT_SEED 1
+
+struct SeqRandom
+{
+    // Saved state: the streams, the batch being served and its position
+    static const int kStateWords = 5 * SEQ_RANDOM_LANES + 1;
+    static const int kTextSize = 8 * kStateWords + 1;
+
+    uint32_t m_seed = SEQ_RANDOM_DEFAULT_SEED; // what the streams started from
+    uint32_t m_s[4][SEQ_RANDOM_LANES] = {};
+    uint32_t m_batch[SEQ_RANDOM_LANES] = {};
+    int m_next = SEQ_RANDOM_LANES;
+
+    SeqRandom()
+    {
+        Seed(SEQ_RANDOM_DEFAULT_SEED);
+    }
+
+    static uint64_t SplitMix64(uint64_t &x)
+    {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    // Same seed, same draws
+    void Seed(uint32_t seed)
+    {
+        m_seed = seed;
+        uint64_t x = seed;
+        for (int i = 0; i < SEQ_RANDOM_LANES; i++)
+        {
+            uint64_t a = SplitMix64(x);
+            uint64_t b = SplitMix64(x);
+            m_s[0][i] = (uint32_t)a;
+            m_s[1][i] = (uint32_t)(a >> 32);
+            m_s[2][i] = (uint32_t)b;
+            m_s[3][i] = (uint32_t)(b >> 32) | 1; // never all zero
+        }
+        m_next = SEQ_RANDOM_LANES;
+    }
+
+    // Steps every stream once
+    void NextBatch(uint32_t *out)
+    {
+        for (int i = 0; i < SEQ_RANDOM_LANES; i++)
+        {
+            uint32_t s0 = m_s[0][i];
+            uint32_t s1 = m_s[1][i];
+            uint32_t s2 = m_s[2][i];
+            uint32_t s3 = m_s[3][i];
+            out[i] = s0 + s3;
+            uint32_t t = s1 << 9;
+            s2 ^= s0;
+            s3 ^= s1;
+            s1 ^= s2;
+            s0 ^= s3;
+            s2 ^= t;
+            m_s[0][i] = s0;
+            m_s[1][i] = s1;
+            m_s[2][i] = s2;
+            m_s[3][i] = (s3 << 11) | (s3 >> 21);
+        }
+    }
+
+    uint32_t Next()
+    {
+        if (m_next == SEQ_RANDOM_LANES)
+        {
+            NextBatch(m_batch);
+            m_next = 0;
+        }
+        return m_batch[m_next++];
+    }
+
+    // `count` draws, the same values `count` calls of Next() would give
+    void Fill(uint32_t *out, int count)
+    {
+        int i = 0;
+        while (i < count && m_next < SEQ_RANDOM_LANES)
+        {
+            out[i++] = m_batch[m_next++];
+        }
+        for (; i + SEQ_RANDOM_LANES <= count; i += SEQ_RANDOM_LANES)
+        {
+            NextBatch(out + i);
+        }
+        if (i < count)
+        {
+            NextBatch(m_batch);
+            for (m_next = 0; i < count; i++)
+            {
+                out[i] = m_batch[m_next++];
+            }
+        }
+    }
+
+    // 0-1 from the top 24 bits, xoshiro128+'s low bits being its weakest
+    static float ToUniform(uint32_t draw)
+    {
+        return (draw >> 8) * (1.f / 16777216.f);
+    }
+
+    float Uniform()
+    {
+        return ToUniform(Next());
+    }
+
+    // A draw below this happens with probability `p`, exactly
+    static uint64_t Threshold(float p)
+    {
+        return (p <= 0.f) ? 0 : (p >= 1.f) ? ((uint64_t)1 << 32) : (uint64_t)((double)p * 4294967296.0);
+    }
+
+    // As hex, for the patch
+    void Encode(char *text) const
+    {
+        uint32_t words[kStateWords];
+        for (int i = 0; i < SEQ_RANDOM_LANES; i++)
+        {
+            for (int w = 0; w < 4; w++)
+            {
+                words[4 * i + w] = m_s[w][i];
+            }
+            words[4 * SEQ_RANDOM_LANES + i] = m_batch[i];
+        }
+        words[kStateWords - 1] = m_next;
+        for (int i = 0; i < kStateWords; i++)
+        {
+            snprintf(text + 8 * i, 9, "%08x", (unsigned)words[i]);
+        }
+    }
+
+    // Leaves the state as it was unless `text` is a whole valid state
+    bool Decode(const char *text)
+    {
+        uint32_t words[kStateWords];
+        for (int i = 0; i < kStateWords; i++)
+        {
+            uint32_t word = 0;
+            for (int c = 0; c < 8; c++)
+            {
+                char ch = *text++;
+                int digit = (ch >= '0' && ch <= '9') ? ch - '0' : (ch >= 'a' && ch <= 'f') ? ch - 'a' + 10 : -1;
+                if (digit < 0)
+                {
+                    return false;
+                }
+                word = (word << 4) | digit;
+            }
+            words[i] = word;
+        }
+        if (*text || words[kStateWords - 1] > SEQ_RANDOM_LANES)
+        {
+            return false;
+        }
+        for (int i = 0; i < SEQ_RANDOM_LANES; i++)
+        {
+            if (!(words[4 * i] | words[4 * i + 1] | words[4 * i + 2] | words[4 * i + 3]))
+            {
+                return false;
+            }
+        }
+        for (int i = 0; i < SEQ_RANDOM_LANES; i++)
+        {
+            for (int w = 0; w < 4; w++)
+            {
+                m_s[w][i] = words[4 * i + w];
+            }
+            m_batch[i] = words[4 * SEQ_RANDOM_LANES + i];
+        }
+        m_next = words[kStateWords - 1];
+        return true;
+    }
+};
@@ -0,0 +1,322 @@
+#include "SeqRender.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+const char *SeqRenderEvent::Name(int output)
+{
+    static const char *const names[NUM_OUTPUTS] = {"pitch", "x", "y", "xory"};
+    return (output >= 0 && output < NUM_OUTPUTS) ? names[output] : "";
+}
+
+// Through a temporary file, so a render that fails halfway leaves the last
+// one at `path` alone
+static bool WriteFile(const std::string &path, const std::string &data)
+{
+    std::string tempPath = path + ".tmp";
+    FILE *file = std::fopen(tempPath.c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+    bool ok = data.empty() || std::fwrite(data.data(), data.size(), 1, file) == 1;
+    ok = (std::fclose(file) == 0) && ok;
+
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && std::rename(tempPath.c_str(), path.c_str()) == 0;
+#endif
+    if (!ok)
+    {
+        std::remove(tempPath.c_str());
+    }
+    return ok;
+}
+
+// Steps are numbered from 1 as on the panel and in user patterns
+bool SeqTimeline::WriteCsv(const std::string &path) const
+{
+    std::string csv = "sample,seconds,output,step,volts\n";
+    char line[96];
+    for (const SeqRenderEvent &event : m_events)
+    {
+        snprintf(line, sizeof(line), "%llu,%.6f,%s,%d,%g\n", (unsigned long long)event.sample, (double)event.sample / m_sampleRate,
+                 SeqRenderEvent::Name(event.output), event.step + 1, event.volts);
+        csv += line;
+    }
+    snprintf(line, sizeof(line), "%llu,%.6f,end,0,0\n", (unsigned long long)m_length, (double)m_length / m_sampleRate);
+    csv += line;
+    return WriteFile(path, csv);
+}
+
+// MIDI variable-length quantity, 7 bits a byte, most significant first
+static void AppendVarLen(std::string &track, uint32_t value)
+{
+    char bytes[5];
+    int count = 0;
+    do
+    {
+        bytes[count++] = (char)(value & 0x7f);
+        value >>= 7;
+    } while (value != 0);
+    while (count > 1)
+    {
+        track += (char)(bytes[--count] | 0x80);
+    }
+    track += bytes[0];
+}
+
+static void AppendBigEndian(std::string &data, uint32_t value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; i--)
+    {
+        data += (char)((value >> (8 * i)) & 0xff);
+    }
+}
+
+// Events go in time order, so one that would come before the last (a
+// note held for at least a tick) is written at the same tick instead
+struct SeqMidiTrack
+{
+    std::string m_data;
+    uint64_t m_tick = 0;
+
+    void Event(uint64_t tick, uint8_t status, uint8_t a, uint8_t b)
+    {
+        tick = std::max(tick, m_tick);
+        AppendVarLen(m_data, (uint32_t)std::min(tick - m_tick, (uint64_t)0x0fffffff));
+        m_tick = tick;
+        m_data += (char)status;
+        m_data += (char)a;
+        m_data += (char)b;
+    }
+
+    void Meta(uint8_t type, const std::string &text)
+    {
+        AppendVarLen(m_data, 0);
+        m_data += (char)0xff;
+        m_data += (char)type;
+        AppendVarLen(m_data, (uint32_t)text.size());
+        m_data += text;
+    }
+
+    void End(uint64_t tick)
+    {
+        tick = std::max(tick, m_tick);
+        AppendVarLen(m_data, (uint32_t)std::min(tick - m_tick, (uint64_t)0x0fffffff));
+        m_tick = tick;
+        m_data += "\xff\x2f";
+        m_data += '\0';
+    }
+
+    void AppendTo(std::string &file) const
+    {
+        file += "MTrk";
+        AppendBigEndian(file, (uint32_t)m_data.size(), 4);
+        file += m_data;
+    }
+};
+
+// 0V is C4, MIDI note 60
+static int MidiNote(float volts)
+{
+    return std::max(0, std::min(127, 60 + (int)std::lround(12.f * volts)));
+}
+
+bool SeqTimeline::WriteMidi(const std::string &path) const
+{
+    const int numGates = SeqRenderEvent::NUM_OUTPUTS - 1;
+    double ticksPerSample = (double)m_clockRate * SEQ_MIDI_PPQ / m_sampleRate;
+    uint32_t tempo = (uint32_t)std::max(1LL, std::min(0xffffffLL, std::llround(1e6 / m_clockRate))); // us per step
+
+    SeqMidiTrack tempoTrack;
+    std::string tempoBytes;
+    AppendBigEndian(tempoBytes, tempo, 3);
+    tempoTrack.Meta(0x51, tempoBytes);
+    tempoTrack.End(0);
+
+    SeqMidiTrack tracks[numGates];
+    int notes[numGates]; // sounding, or -1
+    uint64_t noteOn[numGates];
+    for (int i = 0; i < numGates; i++)
+    {
+        tracks[i].Meta(0x03, SeqRenderEvent::Name(SeqRenderEvent::GATE_X + i));
+        notes[i] = -1;
+        noteOn[i] = 0;
+    }
+
+    int pitchNote = MidiNote(0.f);
+    for (const SeqRenderEvent &event : m_events)
+    {
+        uint64_t tick = (uint64_t)std::llround((double)event.sample * ticksPerSample);
+        if (event.output == SeqRenderEvent::PITCH)
+        {
+            pitchNote = MidiNote(event.volts);
+        }
+        for (int i = 0; i < numGates; i++)
+        {
+            bool thisGate = (event.output == SeqRenderEvent::GATE_X + i);
+            bool opens = thisGate && event.volts > 0.f;
+            bool retrigger = (event.output == SeqRenderEvent::PITCH && notes[i] >= 0 && notes[i] != pitchNote);
+            if (notes[i] >= 0 && (thisGate || retrigger))
+            {
+                tracks[i].Event(std::max(tick, noteOn[i] + 1), 0x80 | i, (uint8_t)notes[i], 0);
+                notes[i] = -1;
+            }
+            if (opens || retrigger)
+            {
+                tracks[i].Event(tick, 0x90 | i, (uint8_t)pitchNote, 100);
+                notes[i] = pitchNote;
+                noteOn[i] = tick;
+            }
+        }
+    }
+
+    uint64_t end = (uint64_t)std::llround((double)m_length * ticksPerSample);
+    std::string file = "MThd";
+    AppendBigEndian(file, 6, 4);
+    AppendBigEndian(file, 1, 2);
+    AppendBigEndian(file, 1 + numGates, 2);
+    AppendBigEndian(file, SEQ_MIDI_PPQ, 2);
+    tempoTrack.AppendTo(file);
+    for (int i = 0; i < numGates; i++)
+    {
+        if (notes[i] >= 0)
+        {
+            tracks[i].Event(std::max(end, noteOn[i] + 1), 0x80 | i, (uint8_t)notes[i], 0);
+        }
+        tracks[i].End(end);
+        tracks[i].AppendTo(file);
+    }
+    return WriteFile(path, file);
+}
+
+template <int W, int H>
+SeqRenderer<W, H>::SeqRenderer()
+{
+    std::fill(m_pitches, m_pitches + W * H, 0.f);
+    m_state.pitchOn.SetAll();
+    m_state.skip.Clear();
+    std::fill(m_state.gateLengths, m_state.gateLengths + W * H, SEQ_GATE_LENGTHS / 2);
+    std::fill(m_state.ratchets, m_state.ratchets + W * H, 1);
+    m_state.glide.Clear();
+}
+
+template <int W, int H>
+void SeqRenderer<W, H>::Render(int numSteps, float sampleRate, SeqTimeline &timeline) const
+{
+    float sampleTime = 1.f / sampleRate;
+    SeqEngine<W, H> engine;
+    engine.SetSampleTime(sampleTime);
+    engine.SetClock(m_clockRatio, m_swing);
+    engine.SetPitchOnMask(m_state.pitchOn);
+    engine.SetSkipMask(m_state.skip);
+    engine.SetFill(m_fill);
+    engine.m_random.Seed(m_seed);
+    engine.m_conditions.SetAll(m_state.conditions);
+    engine.m_conditions.SetPhrase(m_phrase);
+
+    std::string errors[SEQ_MAX_USER_PATTERNS];
+    int patternOfSlot[SEQ_MAX_USER_PATTERNS];
+    SeqPatternCompiler<W, H>::BuildSet(m_userPatterns, SEQ_MAX_USER_PATTERNS, engine.EditPatterns(), errors, patternOfSlot);
+    engine.PublishPatterns();
+
+    SeqGateGenerator<W, H> gates;
+    gates.SetSampleRate(sampleRate);
+    gates.SetMode(m_gateMode, false);
+    for (int i = 0; i < W * H; i++)
+    {
+        gates.SetLength(i, m_state.gateLengths[i]);
+        gates.SetRatchets(i, m_state.ratchets[i]);
+    }
+    SeqQuantizer<W, H> quantizer;
+    quantizer.Set(m_scale, m_root);
+
+    // The internal clock, nothing else moving.  The render starts with a
+    // reset right on sample 0, from before the pattern's first step the way
+    // a chain restarts, so that step plays first.
+    SeqInputs in = m_inputs;
+    in.run = 0.f;
+    in.extClockConnected = false;
+    in.extClock = 0.f;
+    in.reset = 0.f;
+    engine.Process(in, sampleTime);
+    engine.m_currentPatternIndex = -1;
+    SeqInputs start = in;
+    start.reset = 1.f;
+
+    timeline.m_sampleRate = sampleRate;
+    timeline.m_clockRate = engine.ClockRate(in.clock);
+    timeline.m_events.clear();
+    timeline.m_length = 0;
+    if (numSteps <= 0)
+    {
+        return;
+    }
+
+    // A swung on-beat is at most 1.5 ticks, so this is past the last one
+    // whatever the settings
+    double tickSamples = (double)sampleRate * engine.m_clock.m_divide / engine.m_clock.m_multiply / timeline.m_clockRate;
+    uint64_t maxLength = (uint64_t)(2.0 * (numSteps + 1) * tickSamples) + SEQ_RENDER_BLOCK;
+
+    SeqFrame frames[SEQ_RENDER_BLOCK];
+    float levels[SEQ_RENDER_BLOCK][SEQ_GATE_OUTPUTS];
+    bool high[SEQ_GATE_OUTPUTS] = {};
+    int lastStep = -1;
+    float pitch = NAN;
+    int ticks = 0;
+    uint64_t end = 0;
+    for (uint64_t sample = 0; end == 0 && sample < maxLength;)
+    {
+        engine.ProcessBlock((sample == 0) ? start : in, sampleTime, SEQ_RENDER_BLOCK, frames);
+        gates.Process(frames, SEQ_RENDER_BLOCK, levels);
+        for (int i = 0; i < SEQ_RENDER_BLOCK && end == 0; i++, sample++)
+        {
+            const SeqFrame &frame = frames[i];
+            ticks += frame.advanced;
+            if (ticks > numSteps || sample + 1 == maxLength)
+            {
+                end = sample;
+                continue;
+            }
+            if (frame.step != lastStep)
+            {
+                lastStep = frame.step;
+                float stepPitch = quantizer.Pitch(frame.step, m_pitches[frame.step]);
+                if (stepPitch != pitch)
+                {
+                    pitch = stepPitch;
+                    timeline.m_events.push_back({sample, SeqRenderEvent::PITCH, frame.step, pitch});
+                }
+            }
+            for (int g = 0; g < SEQ_GATE_OUTPUTS; g++)
+            {
+                bool on = levels[i][g] >= 0.5f;
+                if (on != high[g])
+                {
+                    high[g] = on;
+                    timeline.m_events.push_back({sample, SeqRenderEvent::GATE_X + g, frame.step, on ? 10.f : 0.f});
+                }
+            }
+        }
+    }
+
+    // Gates still open close where the render ends
+    timeline.m_length = end;
+    for (int g = 0; g < SEQ_GATE_OUTPUTS; g++)
+    {
+        if (high[g])
+        {
+            timeline.m_events.push_back({timeline.m_length, SeqRenderEvent::GATE_X + g, lastStep, 0.f});
+        }
+    }
+}
+
+#define SEQ_INSTANTIATE(W, H) template struct SeqRenderer<W, H>;
+SEQ_FOR_EACH_GRID(SEQ_INSTANTIATE)
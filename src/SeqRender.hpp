@@ -0,0 +1,90 @@
+#pragma once
+
+// Offline render of a sequence: the PITCH, X, Y and X-or-Y outputs of the
+// first lane as a timeline of changes, from the top of the pattern on the
+// internal clock.  The engine coasts between clock edges the way it does in
+// ProcessBlock(), so a minute of sequence renders in a few milliseconds.
+// The timeline can be written as CSV, one change per line, or as a Standard
+// MIDI File with a track per gate output.  The module exports from its menu
+// and tools/SeqRender.cpp does the same from the command line, so renders
+// can be diffed between versions.
+//
+// Glide and the TRANSPOSE input are left out: PITCH changes are the step's
+// quantized pitch, as it is slid to or jumped to.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SeqEngine.hpp"
+#include "SeqGates.hpp"
+#include "SeqPatternCompiler.hpp"
+#include "SeqQuantizer.hpp"
+#include "SeqState.hpp"
+
+#define SEQ_RENDER_DEFAULT_RATE 48000.f
+#define SEQ_RENDER_BLOCK 256
+#define SEQ_MIDI_PPQ 960 // ticks per step at the clock knob's rate
+
+// One output changing
+struct SeqRenderEvent
+{
+    enum Output
+    {
+        PITCH,
+        GATE_X,
+        GATE_Y,
+        GATE_XORY,
+        NUM_OUTPUTS
+    };
+
+    uint64_t sample;
+    int output;
+    int step;    // the step playing
+    float volts; // 0 or 10 for the gates
+
+    static const char *Name(int output);
+};
+
+struct SeqTimeline
+{
+    float m_sampleRate = SEQ_RENDER_DEFAULT_RATE;
+    float m_clockRate = 2.f; // steps per second before the clock ratio, the MIDI tempo
+    uint64_t m_length = 0;   // samples
+    std::vector<SeqRenderEvent> m_events;
+
+    // Both write through a temporary file like SeqBank::Write().  False if
+    // it couldn't be written.
+    bool WriteCsv(const std::string &path) const;
+
+    // Format 1: a tempo track, then X, Y and X-or-Y on MIDI channels 1-3.
+    // Each gate is a note of the pitch it opened on, retriggered if the
+    // pitch changes while a tied gate is held.
+    bool WriteMidi(const std::string &path) const;
+};
+
+// Everything that decides what the first lane plays, as the module has it
+template <int W, int H>
+struct SeqRenderer
+{
+    typedef SeqGrid<W, H> Grid;
+
+    float m_pitches[W * H];                 // knob values
+    SeqState<W, H> m_state;                 // gates, skips, step gates, conditions
+    SeqInputs m_inputs;                     // clock, pattern and steps knobs + CV
+    std::string m_userPatterns[SEQ_MAX_USER_PATTERNS];
+    SeqGateMode::Mode m_gateMode = SeqGateMode::CLOCK;
+    SeqScale::Scale m_scale = SeqScale::OFF;
+    int m_root = 0;
+    int m_clockRatio = 1;
+    float m_swing = 0.5f;
+    int m_phrase = SEQ_DEFAULT_PHRASE;
+    bool m_fill = false;
+    uint32_t m_seed = SEQ_RANDOM_DEFAULT_SEED;
+
+    SeqRenderer();
+
+    // `numSteps` clock ticks at `sampleRate`, into `timeline`.  Allocates;
+    // call it off the audio thread.
+    void Render(int numSteps, float sampleRate, SeqTimeline &timeline) const;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+// Bounded single-producer/single-consumer lock-free queue.  The UI thread
+// pushes, the engine thread pops; neither blocks or allocates.  N must be a
+// power of two.
+
+#include <atomic>
+#include <cstdint>
+
+template <typename T, int N>
+struct SeqSpscQueue
+{
+    static_assert((N & (N - 1)) == 0, "SeqSpscQueue size must be a power of two");
+
+    T m_items[N];
+    alignas(64) std::atomic<uint32_t> m_head; // next item to pop, written by the consumer
+    alignas(64) std::atomic<uint32_t> m_tail; // next free slot, written by the producer
+
+    SeqSpscQueue() : m_head(0), m_tail(0)
+    {
+    }
+
+    // Producer side.  Returns false if the queue is full.
+    bool Push(const T &item)
+    {
+        uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == (uint32_t)N)
+        {
+            return false;
+        }
+        m_items[tail & (N - 1)] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side.  Returns false if the queue is empty.
+    bool Pop(T &item)
+    {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = m_items[head & (N - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Empty() const
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+};
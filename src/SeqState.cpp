@@ -0,0 +1,161 @@
+#include "SeqState.hpp"
+#include <algorithm>
+#include <cstring>
+
+static const char kBase64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static void PutUint(uint8_t *&out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        *out++ = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint64_t GetUint(const uint8_t *&in, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        value |= (uint64_t)*in++ << (8 * i);
+    }
+    return value;
+}
+
+static int Base64Value(char c)
+{
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+template <int W, int H>
+void SeqState<W, H>::Encode(char *text) const
+{
+    uint8_t binary[kBinarySize];
+    uint8_t *out = binary;
+    PutUint(out, SEQ_STATE_VERSION, 1);
+    PutUint(out, W, 1);
+    PutUint(out, H, 1);
+    PutUint(out, SEQ_MAX_LANES, 1);
+    for (int w = 0; w < Mask::kWords; w++)
+    {
+        PutUint(out, pitchOn.m_words[w], 8);
+    }
+    for (int w = 0; w < Mask::kWords; w++)
+    {
+        PutUint(out, skip.m_words[w], 8);
+    }
+    for (int i = 0; i < W * H; i++)
+    {
+        PutUint(out, (gateLengths[i] - 1) | (ratchets[i] - 1) << 4, 1);
+    }
+    for (int i = 0; i < SEQ_MAX_LANES; i++)
+    {
+        uint32_t phaseBits;
+        std::memcpy(&phaseBits, &lanes[i].phaseOffset, sizeof(phaseBits));
+        PutUint(out, lanes[i].pattern, 1);
+        PutUint(out, lanes[i].steps, 2);
+        PutUint(out, lanes[i].skipMode, 1);
+        PutUint(out, phaseBits, 4);
+    }
+    for (int i = 0; i < W * H; i++)
+    {
+        PutUint(out, conditions[i].Pack(), 2);
+    }
+    for (int w = 0; w < Mask::kWords; w++)
+    {
+        PutUint(out, glide.m_words[w], 8);
+    }
+
+    for (int i = 0; i < kBinarySize; i += 3)
+    {
+        uint32_t chunk = (uint32_t)binary[i] << 16;
+        chunk |= (i + 1 < kBinarySize) ? (uint32_t)binary[i + 1] << 8 : 0;
+        chunk |= (i + 2 < kBinarySize) ? (uint32_t)binary[i + 2] : 0;
+        *text++ = kBase64[(chunk >> 18) & 63];
+        *text++ = kBase64[(chunk >> 12) & 63];
+        *text++ = (i + 1 < kBinarySize) ? kBase64[(chunk >> 6) & 63] : '=';
+        *text++ = (i + 2 < kBinarySize) ? kBase64[chunk & 63] : '=';
+    }
+    *text = '\0';
+}
+
+template <int W, int H>
+bool SeqState<W, H>::Decode(const char *text)
+{
+    int length = (int)std::strlen(text);
+    if (length % 4 != 0 || length > kTextSize - 1)
+    {
+        return false;
+    }
+
+    uint8_t binary[kBinarySize];
+    int size = 0;
+    for (int i = 0; i < length; i += 4)
+    {
+        uint32_t chunk = 0;
+        int chars = 0;
+        for (int j = 0; j < 4; j++)
+        {
+            int value = Base64Value(text[i + j]);
+            if (value < 0 && text[i + j] != '=')
+            {
+                return false;
+            }
+            chars += (value >= 0);
+            chunk = (chunk << 6) | (value >= 0 ? value : 0);
+        }
+        for (int j = 0; j < chars - 1 && size < kBinarySize; j++)
+        {
+            binary[size++] = (uint8_t)(chunk >> (16 - 8 * j));
+        }
+    }
+
+    const uint8_t *in = binary;
+    int version = (size > 0) ? binary[0] : 0;
+    if (version < 1 || version > SEQ_STATE_VERSION || size != BinarySize(version) ||
+        GetUint(in, 1) != (uint64_t)version || GetUint(in, 1) != (uint64_t)W || GetUint(in, 1) != (uint64_t)H ||
+        GetUint(in, 1) != SEQ_MAX_LANES)
+    {
+        return false;
+    }
+    for (int w = 0; w < Mask::kWords; w++)
+    {
+        pitchOn.m_words[w] = GetUint(in, 8);
+    }
+    for (int w = 0; w < Mask::kWords; w++)
+    {
+        skip.m_words[w] = GetUint(in, 8);
+    }
+    for (int i = 0; i < W * H; i++)
+    {
+        int packed = (int)GetUint(in, 1);
+        gateLengths[i] = std::min((packed & 15) + 1, SEQ_GATE_LENGTHS);
+        ratchets[i] = std::min((packed >> 4) + 1, SEQ_MAX_RATCHETS);
+    }
+    for (int i = 0; i < SEQ_MAX_LANES; i++)
+    {
+        SeqLaneConfig &lane = lanes[i];
+        lane.pattern = (int)GetUint(in, 1);
+        lane.steps = std::min((int)GetUint(in, 2), W * H);
+        lane.skipMode = (SeqLaneConfig::SkipMode)std::min((int)GetUint(in, 1), SeqLaneConfig::NUM_SKIP_MODES - 1);
+        uint32_t phaseBits = (uint32_t)GetUint(in, 4);
+        std::memcpy(&lane.phaseOffset, &phaseBits, sizeof(phaseBits));
+    }
+    for (int i = 0; i < W * H; i++)
+    {
+        conditions[i] = (version >= 2) ? SeqCondition::Unpack((uint16_t)GetUint(in, 2)) : SeqCondition();
+    }
+    for (int w = 0; w < Mask::kWords; w++)
+    {
+        glide.m_words[w] = (version >= 3) ? GetUint(in, 8) : 0;
+    }
+    return true;
+}
+
+#define SEQ_INSTANTIATE(W, H) template struct SeqState<W, H>;
+SEQ_FOR_EACH_GRID(SEQ_INSTANTIATE)
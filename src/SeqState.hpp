@@ -0,0 +1,58 @@
+#pragma once
+
+// Compact form of the module's per-step and per-lane state for the patch
+// JSON.  Rack autosaves every few seconds, and one jansson value per step
+// for gates, skips, gate lengths and ratchets was hundreds of small
+// allocations per save on a 16x16 grid.  Here the state is packed into a
+// versioned binary blob and written as one base64 string, encoded into a
+// fixed-size buffer without allocating.
+//
+// Blob layout, little-endian whatever the host:
+//   version, width, height, lanes      4 bytes
+//   gate mask, skip mask words         8 bytes per word
+//   per step: (length - 1) | (ratchets - 1) << 4
+//   per lane: pattern, steps (2 bytes), skip mode, phase offset (float bits)
+//   per step: SeqCondition::Pack()     2 bytes, from version 2
+//   glide mask words                   8 bytes per word, from version 3
+// Older strings still load, with every step's condition left at Always and
+// glide off.
+
+#include <cstdint>
+
+#include "SeqConditions.hpp"
+#include "SeqGates.hpp"
+#include "SeqLanes.hpp"
+
+#define SEQ_STATE_VERSION 3
+
+template <int W, int H>
+struct SeqState
+{
+    typedef typename SeqGrid<W, H>::Mask Mask;
+
+    static const int kLaneBytes = 8;
+    static const int kBinarySizeV1 = 4 + 2 * 8 * Mask::kWords + W * H + SEQ_MAX_LANES * kLaneBytes;
+    static const int kBinarySizeV2 = kBinarySizeV1 + 2 * W * H;
+    static const int kBinarySize = kBinarySizeV2 + 8 * Mask::kWords;
+    static const int kTextSize = 4 * ((kBinarySize + 2) / 3) + 1; // base64 and a NUL
+
+    Mask pitchOn;
+    Mask skip;
+    uint8_t gateLengths[W * H];
+    uint8_t ratchets[W * H];
+    SeqLaneConfig lanes[SEQ_MAX_LANES];
+    SeqCondition conditions[W * H];
+    Mask glide;
+
+    static int BinarySize(int version)
+    {
+        return (version == 1) ? kBinarySizeV1 : (version == 2) ? kBinarySizeV2 : kBinarySize;
+    }
+
+    // Writes the state to `text` (kTextSize chars) as NUL-terminated base64
+    void Encode(char *text) const;
+
+    // False, with the state left alone, when `text` isn't a state this
+    // version can read for this grid size
+    bool Decode(const char *text);
+};
@@ -0,0 +1,220 @@
+#pragma once
+
+// Packed step state: one bit per step, 64 steps to a word, so masks are
+// edited, compared and searched a word at a time.  Bit i is step i.
+
+#include <cstdint>
+
+#include "SeqRandom.hpp"
+
+static inline int SeqCountTrailingZeros(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while (!(x & 1))
+    {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static inline int SeqPopCount(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#else
+    int n = 0;
+    for (; x; x &= x - 1)
+    {
+        n++;
+    }
+    return n;
+#endif
+}
+
+template <int N>
+struct SeqStepMask
+{
+    static const int kWords = (N + 63) / 64;
+
+    uint64_t m_words[kWords] = {};
+
+    bool Test(int i) const
+    {
+        return (m_words[i >> 6] >> (i & 63)) & 1;
+    }
+
+    void Set(int i, bool on)
+    {
+        uint64_t bit = (uint64_t)1 << (i & 63);
+        m_words[i >> 6] = on ? (m_words[i >> 6] | bit) : (m_words[i >> 6] & ~bit);
+    }
+
+    void Flip(int i)
+    {
+        m_words[i >> 6] ^= (uint64_t)1 << (i & 63);
+    }
+
+    void Clear()
+    {
+        for (int w = 0; w < kWords; w++)
+        {
+            m_words[w] = 0;
+        }
+    }
+
+    void SetAll()
+    {
+        for (int w = 0; w < kWords; w++)
+        {
+            m_words[w] = ~(uint64_t)0;
+        }
+        Trim();
+    }
+
+    int Count() const
+    {
+        int n = 0;
+        for (int w = 0; w < kWords; w++)
+        {
+            n += SeqPopCount(m_words[w]);
+        }
+        return n;
+    }
+
+    bool operator==(const SeqStepMask &other) const
+    {
+        for (int w = 0; w < kWords; w++)
+        {
+            if (m_words[w] != other.m_words[w])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool operator!=(const SeqStepMask &other) const
+    {
+        return !(*this == other);
+    }
+
+    SeqStepMask operator~() const
+    {
+        SeqStepMask r;
+        for (int w = 0; w < kWords; w++)
+        {
+            r.m_words[w] = ~m_words[w];
+        }
+        r.Trim();
+        return r;
+    }
+
+    SeqStepMask operator|(const SeqStepMask &other) const
+    {
+        SeqStepMask r;
+        for (int w = 0; w < kWords; w++)
+        {
+            r.m_words[w] = m_words[w] | other.m_words[w];
+        }
+        return r;
+    }
+
+    // Steps move up by n (down if n is negative); those pushed off an end are lost
+    SeqStepMask Shifted(int n) const
+    {
+        SeqStepMask r;
+        int distance = (n < 0) ? -n : n;
+        if (distance >= N)
+        {
+            return r;
+        }
+        int wordShift = distance >> 6;
+        int bitShift = distance & 63;
+        for (int w = 0; w < kWords; w++)
+        {
+            int src = (n >= 0) ? w - wordShift : w + wordShift;
+            int carry = (n >= 0) ? src - 1 : src + 1;
+            uint64_t word = (src >= 0 && src < kWords) ? m_words[src] : 0;
+            uint64_t carryWord = (bitShift && carry >= 0 && carry < kWords) ? m_words[carry] : 0;
+            if (n >= 0)
+            {
+                r.m_words[w] = (word << bitShift) | (bitShift ? carryWord >> (64 - bitShift) : 0);
+            }
+            else
+            {
+                r.m_words[w] = (word >> bitShift) | (bitShift ? carryWord << (64 - bitShift) : 0);
+            }
+        }
+        r.Trim();
+        return r;
+    }
+
+    // Steps move up by n, the ones pushed off the top come back at the bottom
+    SeqStepMask Rotated(int n) const
+    {
+        n = ((n % N) + N) % N;
+        return n ? (Shifted(n) | Shifted(n - N)) : *this;
+    }
+
+    // First set bit at or after `from`, wrapping around, or -1 if there is none
+    int FindNext(int from) const
+    {
+        int w = from >> 6;
+        uint64_t word = m_words[w] & (~(uint64_t)0 << (from & 63));
+        for (int i = 0; i <= kWords; i++)
+        {
+            if (word)
+            {
+                return (w << 6) + SeqCountTrailingZeros(word);
+            }
+            w = (w + 1 == kWords) ? 0 : w + 1;
+            word = m_words[w];
+        }
+        return -1;
+    }
+
+    // `hits` steps spread as evenly as possible, starting at step 0
+    static SeqStepMask Euclid(int hits)
+    {
+        SeqStepMask r;
+        for (int i = 0; i < N; i++)
+        {
+            r.Set(i, (i * hits) % N < hits);
+        }
+        return r;
+    }
+
+    // Each step set with probability `density`
+    static SeqStepMask Random(float density, SeqRandom &random)
+    {
+        uint32_t draws[N];
+        random.Fill(draws, N);
+        uint64_t threshold = SeqRandom::Threshold(density);
+        SeqStepMask r;
+        for (int w = 0; w < kWords; w++)
+        {
+            int count = (N - 64 * w < 64) ? N - 64 * w : 64;
+            uint64_t word = 0;
+            for (int b = 0; b < count; b++)
+            {
+                word |= (uint64_t)(draws[64 * w + b] < threshold) << b;
+            }
+            r.m_words[w] = word;
+        }
+        return r;
+    }
+
+    // Keeps the bits past step N - 1 clear, so masks compare and count correctly
+    void Trim()
+    {
+        if (N & 63)
+        {
+            m_words[kWords - 1] &= ((uint64_t)1 << (N & 63)) - 1;
+        }
+    }
+};
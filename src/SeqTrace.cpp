@@ -0,0 +1,148 @@
+#include "SeqTrace.hpp"
+
+#ifdef SEQ_TRACE
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define SEQ_TRACE_DRAIN_MS 20
+#define SEQ_TRACE_DRAIN_RECORDS 256
+
+namespace
+{
+
+struct SeqTraceDrain
+{
+    std::mutex m_mutex;
+    std::vector<SeqTrace *> m_traces;
+    std::thread m_thread;
+    std::atomic<bool> m_quit;
+    std::string m_path = SEQ_TRACE_FILE;
+    FILE *m_file = nullptr;
+    bool m_append = false; // the file was started by an earlier drain thread
+    uint32_t m_nextInstance = 0;
+
+    SeqTraceDrain() : m_quit(false)
+    {
+    }
+
+    static SeqTraceDrain &Get()
+    {
+        static SeqTraceDrain drain;
+        return drain;
+    }
+
+    void Add(SeqTrace *trace)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        trace->m_instance = m_nextInstance++;
+        m_traces.push_back(trace);
+        if (!m_thread.joinable())
+        {
+            m_file = std::fopen(m_path.c_str(), m_append ? "ab" : "wb");
+            m_append = true;
+            m_quit = false;
+            m_thread = std::thread(&SeqTraceDrain::Run, this);
+        }
+    }
+
+    void Remove(SeqTrace *trace)
+    {
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Drain(*trace);
+            m_traces.erase(std::remove(m_traces.begin(), m_traces.end(), trace), m_traces.end());
+            last = m_traces.empty();
+        }
+        if (last && m_thread.joinable())
+        {
+            m_quit = true;
+            m_thread.join();
+            if (m_file)
+            {
+                std::fclose(m_file);
+                m_file = nullptr;
+            }
+        }
+    }
+
+    void Run()
+    {
+        while (!m_quit)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(SEQ_TRACE_DRAIN_MS));
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (size_t i = 0; i < m_traces.size(); i++)
+            {
+                Drain(*m_traces[i]);
+            }
+            if (m_file)
+            {
+                std::fflush(m_file);
+            }
+        }
+    }
+
+    // Called with m_mutex held
+    void Drain(SeqTrace &trace)
+    {
+        SeqTraceRecord records[SEQ_TRACE_DRAIN_RECORDS];
+        int count = 0;
+        uint64_t lastSample = 0;
+        while (trace.m_records.Pop(records[count]))
+        {
+            lastSample = records[count].sample;
+            if (++count == SEQ_TRACE_DRAIN_RECORDS)
+            {
+                Write(records, count);
+                count = 0;
+            }
+        }
+        Write(records, count);
+
+        // The audio thread's sample counter isn't safe to read from here, so
+        // drops are stamped with the last record that did get through
+        uint32_t dropped = trace.m_dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped)
+        {
+            SeqTraceRecord record = {lastSample, trace.m_instance, SeqTraceEvent::DROPPED, (float)dropped, 0.f};
+            Write(&record, 1);
+        }
+    }
+
+    void Write(const SeqTraceRecord *records, int count)
+    {
+        if (m_file && count > 0)
+        {
+            std::fwrite(records, sizeof(SeqTraceRecord), count, m_file);
+        }
+    }
+};
+
+} // namespace
+
+SeqTrace::SeqTrace() : m_dropped(0)
+{
+    SeqTraceDrain::Get().Add(this);
+}
+
+SeqTrace::~SeqTrace()
+{
+    SeqTraceDrain::Get().Remove(this);
+}
+
+void SeqTrace::SetFile(const char *path)
+{
+    SeqTraceDrain &drain = SeqTraceDrain::Get();
+    std::lock_guard<std::mutex> lock(drain.m_mutex);
+    drain.m_path = path;
+    drain.m_append = false;
+}
+
+#endif
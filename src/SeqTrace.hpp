@@ -0,0 +1,85 @@
+#pragma once
+
+// Diagnostics for the audio thread.  Built with SEQ_TRACE defined (`make
+// SEQ_TRACE=1`) each instance counts its own samples and writes fixed-size
+// binary records into its own lock-free ring, and one background thread
+// drains every ring to a file.  Otherwise SeqTrace is empty and the macros
+// compile to nothing, arguments included.
+
+#include <cstdint>
+
+#define SEQ_TRACE_FILE "KSnoopy-trace.bin"
+
+struct SeqTraceEvent
+{
+    enum Type
+    {
+        STEP,     // a = step, b = edge offset
+        RESET,    // a = step
+        COMMAND,  // a = command type, b = its value
+        DROPPED,  // a = records lost since the last one, written by the drain
+        NUM_TYPES
+    };
+};
+
+// As written to the file, in host byte order
+struct SeqTraceRecord
+{
+    uint64_t sample;   // counted per instance
+    uint32_t instance;
+    uint32_t type;
+    float a;
+    float b;
+};
+
+#ifdef SEQ_TRACE
+
+#include <atomic>
+
+#include "SeqSpscQueue.hpp"
+
+#define SEQ_TRACE_RECORDS 4096
+
+struct SeqTrace
+{
+    uint64_t m_sample = 0;
+    uint32_t m_instance = 0;
+    std::atomic<uint32_t> m_dropped;
+    SeqSpscQueue<SeqTraceRecord, SEQ_TRACE_RECORDS> m_records;
+
+    // Instances are created and destroyed on one thread (the UI thread in
+    // Rack).  The first starts the drain thread and the last stops it.
+    SeqTrace();
+    ~SeqTrace();
+
+    // Where the drain thread writes, takes effect when it next starts
+    static void SetFile(const char *path);
+
+    void Record(uint32_t type, float a, float b)
+    {
+        SeqTraceRecord record = {m_sample, m_instance, type, a, b};
+        if (!m_records.Push(record))
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+};
+
+#define SEQ_TRACE_SET_FILE(path) SeqTrace::SetFile(path)
+#define SEQ_TRACE_TICK(trace) ((trace).m_sample++)
+#define SEQ_TRACE_EVENT(trace, type, a, b) ((trace).Record((type), (float)(a), (float)(b)))
+
+#else
+
+struct SeqTrace
+{
+    SeqTrace()
+    {
+    }
+};
+
+#define SEQ_TRACE_SET_FILE(path) ((void)0)
+#define SEQ_TRACE_TICK(trace) ((void)0)
+#define SEQ_TRACE_EVENT(trace, type, a, b) ((void)0)
+
+#endif
@@ -0,0 +1,51 @@
+#pragma once
+
+// Lock-free triple buffer for handing a whole value from one writer thread
+// (the UI) to one reader thread (the engine).  The writer fills Back() and
+// calls Publish(); the reader calls Update() at a safe point and then reads
+// Front().  Neither side ever blocks or allocates, and the reader never sees
+// a half-written value.
+
+#include <atomic>
+
+template <typename T>
+struct SeqTripleBuffer
+{
+    static const int DIRTY = 4;
+
+    T m_buffers[3];
+    int m_back = 1;
+    int m_front = 0;
+    std::atomic<int> m_middle;
+
+    SeqTripleBuffer() : m_middle(2)
+    {
+    }
+
+    // Writer side
+    T &Back()
+    {
+        return m_buffers[m_back];
+    }
+
+    void Publish()
+    {
+        m_back = m_middle.exchange(m_back | DIRTY, std::memory_order_acq_rel) & ~DIRTY;
+    }
+
+    // Reader side.  Returns true when a newer value was picked up.
+    bool Update()
+    {
+        if (!(m_middle.load(std::memory_order_relaxed) & DIRTY))
+        {
+            return false;
+        }
+        m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & ~DIRTY;
+        return true;
+    }
+
+    const T &Front() const
+    {
+        return m_buffers[m_front];
+    }
+};
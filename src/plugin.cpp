@@ -1,4 +1,5 @@
 #include "plugin.hpp"
+#include "SeqTrace.hpp"
 
 
 Plugin *pluginInstance;
@@ -6,6 +7,9 @@ Plugin *pluginInstance;
 void init(rack::Plugin *p) 
 {
     pluginInstance = p;
+    SEQ_TRACE_SET_FILE(asset::user(SEQ_TRACE_FILE).c_str());
 
     p->addModel(modelSeq);
+    p->addModel(modelSeq8x8);
+    p->addModel(modelSeq16x16);
 }
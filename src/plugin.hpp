@@ -4,4 +4,6 @@ using namespace rack;
 
 extern Plugin *pluginInstance;
 extern Model *modelSeq;
+extern Model *modelSeq8x8;
+extern Model *modelSeq16x16;
 
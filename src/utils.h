@@ -1,5 +0,0 @@
-#include "rack.hpp"
-using namespace rack;
-
-void log_increase_step_number();
-void write_log(long freq, const char *format, ...);
\ No newline at end of file
@@ -0,0 +1,265 @@
+// Renders sequences offline with the same core as the module, for batch
+// export and for diffing renders between versions.  Builds without the Rack
+// SDK:
+//   make render RENDER_ARGS="--bank my.ksbank --steps 64 build/render/song.mid"
+// The output is CSV, or a MIDI file if its name ends in .mid.  With a bank
+// every slot is rendered to its own file (song-001.mid, ...) unless --slot
+// picks one; the grid size comes from the bank.  Without one the grid is
+// the module's default, every gate on and every pitch 0V.
+//
+// `SeqRender --sweep bench/SeqSweep.golden` checks the engine's step logic
+// against a golden file instead, see SeqSweep.hpp and `make render-sweep`.
+
+#include "SeqBank.hpp"
+#include "SeqRender.hpp"
+#include "SeqSweep.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+typedef std::chrono::steady_clock RenderClock;
+
+struct RenderOptions
+{
+    std::string bankPath;
+    std::string state; // the "state" string of a saved patch
+    std::string userPatterns[SEQ_MAX_USER_PATTERNS];
+    std::string outPath;
+    std::string sweepPath;
+    bool record = false; // the sweep's golden file
+    int threads = 0;
+    int size = 4;
+    int slot = -1; // every slot
+    int steps = 64;
+    float rate = SEQ_RENDER_DEFAULT_RATE;
+    float bpm = 120.f;
+    float pattern = 0.f; // PATTERN and STEPS knob values, unless from a bank
+    float length = 10.f;
+    int ratio = 1;
+    float swing = 0.5f;
+    int gateMode = SeqGateMode::CLOCK;
+    int scale = SeqScale::OFF;
+    int root = 0;
+    int phrase = SEQ_DEFAULT_PHRASE;
+    bool fill = false;
+    uint32_t seed = SEQ_RANDOM_DEFAULT_SEED;
+};
+
+static void Usage()
+{
+    printf("usage: SeqRender [options] out.csv|out.mid\n"
+           "  --bank FILE      render the slots of a pattern bank\n"
+           "  --slot N         only slot N (from 0)\n"
+           "  --size 4|8|16    grid size without a bank (default 4)\n"
+           "  --state TEXT     gates, skips, step gates and conditions, the patch's \"state\"\n"
+           "  --user N EXPR    user pattern N (1-%d)\n"
+           "  --steps N        clock ticks to render (default 64)\n"
+           "  --bpm X          clock knob tempo (default 120)\n"
+           "  --rate HZ        sample rate (default %.0f)\n"
+           "  --pattern V      PATTERN knob, 0-10 (default 0)\n"
+           "  --length V       STEPS knob, 1-10 (default 10)\n"
+           "  --ratio N        clock multiply, or divide if negative (default 1)\n"
+           "  --swing X        0.5-0.75 (default 0.5)\n"
+           "  --gate-mode N    0 trigger, 1 retrigger, 2 continuous, 3 clock (default 3)\n"
+           "  --scale N --root N   quantizer, as in the menu order (default off)\n"
+           "  --phrase N --fill --seed N   step conditions\n"
+           "  --sweep FILE     check every pattern, step count and skip mask against a golden\n"
+           "                   file (no output file then)\n"
+           "  --record         write the --sweep file instead, from the original step logic\n"
+           "  --threads N      for --sweep (default every core)\n",
+           SEQ_MAX_USER_PATTERNS, SEQ_RENDER_DEFAULT_RATE);
+}
+
+static bool ParseOptions(int argc, char **argv, RenderOptions &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--fill")
+        {
+            options.fill = true;
+        }
+        else if (arg == "--record")
+        {
+            options.record = true;
+        }
+        else if (arg == "--user" && i + 2 < argc)
+        {
+            int slot = atoi(argv[i + 1]) - 1;
+            if (slot < 0 || slot >= SEQ_MAX_USER_PATTERNS)
+            {
+                return false;
+            }
+            options.userPatterns[slot] = argv[i + 2];
+            i += 2;
+        }
+        else if (arg.compare(0, 2, "--") == 0 && hasValue)
+        {
+            const char *value = argv[++i];
+            if (arg == "--bank") options.bankPath = value;
+            else if (arg == "--state") options.state = value;
+            else if (arg == "--slot") options.slot = atoi(value);
+            else if (arg == "--size") options.size = atoi(value);
+            else if (arg == "--steps") options.steps = atoi(value);
+            else if (arg == "--bpm") options.bpm = (float)atof(value);
+            else if (arg == "--rate") options.rate = (float)atof(value);
+            else if (arg == "--pattern") options.pattern = (float)atof(value);
+            else if (arg == "--length") options.length = (float)atof(value);
+            else if (arg == "--ratio") options.ratio = atoi(value);
+            else if (arg == "--swing") options.swing = (float)atof(value);
+            else if (arg == "--gate-mode") options.gateMode = atoi(value);
+            else if (arg == "--scale") options.scale = atoi(value);
+            else if (arg == "--root") options.root = atoi(value);
+            else if (arg == "--phrase") options.phrase = atoi(value);
+            else if (arg == "--seed") options.seed = (uint32_t)strtoul(value, NULL, 10);
+            else if (arg == "--sweep") options.sweepPath = value;
+            else if (arg == "--threads") options.threads = atoi(value);
+            else return false;
+        }
+        else if (options.outPath.empty() && arg.compare(0, 2, "--") != 0)
+        {
+            options.outPath = arg;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return (!options.outPath.empty() || !options.sweepPath.empty()) && options.bpm > 0.f && options.rate >= 1.f &&
+           options.gateMode >= 0 && options.gateMode < SeqGateMode::NUM_MODES &&
+           options.scale >= 0 && options.scale < SeqScale::NUM_SCALES;
+}
+
+// The grid size a bank was written for, or 0 if it isn't a bank
+static int BankSize(const std::string &path)
+{
+    SeqBankHeader header;
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        return 0;
+    }
+    bool ok = fread(&header, sizeof(header), 1, file) == 1;
+    fclose(file);
+    return (ok && header.magic == SEQ_BANK_MAGIC && header.width == header.height) ? header.width : 0;
+}
+
+// `out` with the slot number before its extension
+static std::string SlotPath(const std::string &out, int slot)
+{
+    size_t dot = out.find_last_of('.');
+    size_t slash = out.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        dot = out.size();
+    }
+    char number[16];
+    snprintf(number, sizeof(number), "-%03d", slot);
+    return out.substr(0, dot) + number + out.substr(dot);
+}
+
+template <int W, int H>
+static int Render(const RenderOptions &options)
+{
+    typedef SeqBankSlot<W, H> Slot;
+
+    SeqRenderer<W, H> renderer;
+    if (!options.state.empty() && !renderer.m_state.Decode(options.state.c_str()))
+    {
+        printf("--state isn't a %dx%d state\n", W, H);
+        return 1;
+    }
+    for (int i = 0; i < SEQ_MAX_USER_PATTERNS; i++)
+    {
+        renderer.m_userPatterns[i] = options.userPatterns[i];
+    }
+    renderer.m_inputs.clock = std::log2(options.bpm / 60.f);
+    renderer.m_inputs.pattern = options.pattern;
+    renderer.m_inputs.steps = options.length;
+    renderer.m_gateMode = (SeqGateMode::Mode)options.gateMode;
+    renderer.m_scale = (SeqScale::Scale)options.scale;
+    renderer.m_root = options.root;
+    renderer.m_clockRatio = options.ratio;
+    renderer.m_swing = options.swing;
+    renderer.m_phrase = options.phrase;
+    renderer.m_fill = options.fill;
+    renderer.m_seed = options.seed;
+
+    SeqBank<W, H> bank;
+    int firstSlot = 0;
+    int numSlots = 1;
+    if (!options.bankPath.empty())
+    {
+        if (!bank.Load(options.bankPath) || options.slot >= bank.NumSlots())
+        {
+            printf("could not load slot %d of %s\n", options.slot, options.bankPath.c_str());
+            return 1;
+        }
+        firstSlot = std::max(options.slot, 0);
+        numSlots = (options.slot < 0) ? bank.NumSlots() : 1;
+    }
+
+    bool midi = options.outPath.size() > 4 && options.outPath.compare(options.outPath.size() - 4, 4, ".mid") == 0;
+    SeqTimeline timeline;
+    double renderSeconds = 0.0;
+    double sequenceSeconds = 0.0;
+    for (int slot = firstSlot; slot < firstSlot + numSlots; slot++)
+    {
+        std::string path = options.outPath;
+        if (bank.NumSlots() > 0)
+        {
+            const Slot &bankSlot = bank.GetSlot(slot);
+            std::copy(bankSlot.pitches, bankSlot.pitches + W * H, renderer.m_pitches);
+            renderer.m_state.pitchOn = Slot::ToMask(bankSlot.pitchOn);
+            renderer.m_state.skip = Slot::ToMask(bankSlot.skip);
+            renderer.m_inputs.pattern = bankSlot.pattern;
+            renderer.m_inputs.steps = bankSlot.steps;
+            path = (options.slot < 0) ? SlotPath(options.outPath, slot) : path;
+        }
+
+        RenderClock::time_point start = RenderClock::now();
+        renderer.Render(options.steps, options.rate, timeline);
+        renderSeconds += std::chrono::duration<double>(RenderClock::now() - start).count();
+        sequenceSeconds += timeline.m_length / options.rate;
+
+        if (!(midi ? timeline.WriteMidi(path) : timeline.WriteCsv(path)))
+        {
+            printf("could not write %s\n", path.c_str());
+            return 1;
+        }
+    }
+    printf("%dx%d: %d render%s of %d steps, %.1f s of sequence in %.2f ms (%.0fx real time)\n", W, H, numSlots, (numSlots == 1) ? "" : "s",
+           options.steps, sequenceSeconds, renderSeconds * 1000.0, sequenceSeconds / std::max(renderSeconds, 1e-9));
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    RenderOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        Usage();
+        return 2;
+    }
+    if (!options.sweepPath.empty())
+    {
+        return RunSweep(options.sweepPath, options.threads, options.record);
+    }
+    int size = options.size;
+    if (!options.bankPath.empty())
+    {
+        size = BankSize(options.bankPath);
+    }
+    switch (size)
+    {
+        case 4: return Render<4, 4>(options);
+        case 8: return Render<8, 8>(options);
+        case 16: return Render<16, 16>(options);
+        default:
+            printf("%s\n", options.bankPath.empty() ? "--size must be 4, 8 or 16" : "not a pattern bank");
+            return 1;
+    }
+}
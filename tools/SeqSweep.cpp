@@ -0,0 +1,559 @@
+#include "SeqSweep.hpp"
+
+#include "SeqEngine.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#define SWEEP_SAMPLE_RATE 8.f   // and a 4 Hz clock: a tick every two samples
+#define SWEEP_CLOCK_OCTAVES 2.f
+#define SWEEP_SAMPLED_MASKS 64  // per line on the grids too big for every mask
+#define SWEEP_SAMPLED_STEPS 16  // step counts past 16 on those grids
+#define SWEEP_EXPLAINED 5       // differing lines traced to their first sample
+
+typedef std::chrono::steady_clock SweepClock;
+
+struct SweepLine
+{
+    int size; // W = H
+    int pattern;
+    int steps;
+    bool external;
+    uint64_t digest;
+};
+
+// One sample of the outputs: what PITCH, X, Y and X-or-Y play and why
+struct SweepRecord
+{
+    int step;
+    bool advanced;
+    bool reset;
+    bool gateIn;
+    bool gateX;
+    bool gateY;
+    bool gateXorY;
+    float pitch;
+    float gateLevel;
+    float edgeOffset;
+
+    bool operator==(const SweepRecord &other) const
+    {
+        return step == other.step && advanced == other.advanced && reset == other.reset && gateIn == other.gateIn &&
+               gateX == other.gateX && gateY == other.gateY && gateXorY == other.gateXorY && pitch == other.pitch &&
+               gateLevel == other.gateLevel && edgeOffset == other.edgeOffset;
+    }
+};
+
+// A different knob value on every step, so PITCH says which step played
+static float KnobPitch(int step)
+{
+    return (float)(step % 120) / 12.f;
+}
+
+// FNV-1a a word at a time, with the high bits folded back down so a
+// difference in any bit reaches every bit of the digest
+static void Hash(uint64_t &hash, uint64_t word)
+{
+    hash = (hash ^ word) * 0x100000001b3ull;
+    hash ^= hash >> 29;
+}
+
+static uint32_t FloatBits(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static void Hash(uint64_t &hash, const SweepRecord &record)
+{
+    Hash(hash, (uint32_t)record.step | record.advanced << 16 | record.reset << 17 | record.gateIn << 18 |
+               record.gateX << 19 | record.gateY << 20 | record.gateXorY << 21);
+    Hash(hash, FloatBits(record.pitch) | (uint64_t)FloatBits(record.gateLevel) << 32);
+    Hash(hash, FloatBits(record.edgeOffset));
+}
+
+static std::string RecordText(const SweepRecord &record)
+{
+    char text[128];
+    snprintf(text, sizeof(text), "step %d%s%s%s%s%s%s pitch %g level %g offset %g", record.step, record.advanced ? " advanced" : "",
+             record.reset ? " reset" : "", record.gateIn ? " clock-high" : "", record.gateX ? " X" : "", record.gateY ? " Y" : "",
+             record.gateXorY ? " XorY" : "", record.pitch, record.gateLevel, record.edgeOffset);
+    return text;
+}
+
+// The clock and reset inputs of a render: a reset on sample 0, then through
+// a loop and into the next, with an external clock a square wave that
+// jumps between 0V and 10V every sample
+static int RenderSamples(const SweepLine &line)
+{
+    return 2 * (line.steps + 2);
+}
+
+static float ExtClockInput(int n)
+{
+    return (n & 1) ? 0.f : 10.f;
+}
+
+static float ResetInput(int n)
+{
+    return (n == 0) ? 1.f : 0.f;
+}
+
+// Samples (0-1) since `threshold` was crossed, on a straight line from the
+// last sample to this one
+static float Crossing(float last, float cur, float threshold)
+{
+    float delta = cur - last;
+    return (delta != 0.f) ? std::max(0.f, std::min((cur - threshold) / delta, 1.f)) : 0.f;
+}
+
+// The module's process() as it was before the engine was split out of it:
+// the original AdvanceStep() walk with its numSteps++ skip compensation,
+// clamp() pattern selection and one try per grid step, and the original
+// ProcessXYTriggers() change detection.  Only the 4x4 grid existed then; the
+// bigger grids walk the same way through their built-in patterns.  Where
+// the engine has since added to the outputs, the clock edge's place inside
+// the sample (edgeOffset) and the gate averaged over the sample ending here
+// (gateLevel), they are worked out from the clock and reset inputs directly.
+// The golden file is recorded from this, never from the engine.
+template <int W, int H>
+struct SweepReference
+{
+    typedef typename SeqGrid<W, H>::Mask Mask;
+
+    std::vector<std::vector<int> > m_patterns;
+    Mask m_isSkip;
+    bool m_external = false;
+
+    double m_phase = 0.0; // in ticks, as after the sample the engine is primed with
+    bool m_clockHigh = false;
+    bool m_resetHigh = false;
+    float m_lastExtClock = 0.f;
+    float m_lastReset = 0.f;
+    int m_currentPatternIndex = -1;
+    int m_currentStepIndex = 0;
+    int m_lastStepIndex = 0;
+
+    SweepReference()
+    {
+        if (W == 4 && H == 4)
+        {
+            m_patterns =
+            {
+                {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},                                                // forward
+                {15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0},                                                // backward
+                {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1}, // ping pong
+                {0, 1, 2, 3, 7, 6, 5, 4, 8, 9, 10, 11, 15, 14, 13, 12},                                                // snake
+                {3, 2, 1, 0, 4, 5, 6, 7, 11, 10, 9, 8, 12, 13, 14, 15},                                                // opposite snake
+                {15, 14, 13, 12, 8, 9, 10, 11, 7, 6, 5, 4, 0, 1, 2, 3},                                                // backward snake
+                {3, 2, 1, 0, 4, 5, 6, 7, 11, 10, 9, 8, 12, 13, 14, 15, 14, 13, 12, 8, 9, 10, 11, 7, 6, 5, 4, 0, 1, 2}, // ping pong snake
+                {0, 1, 2, 3, 7, 11, 15, 14, 13, 12, 8, 4, 5, 6, 10, 9}                                                 // circle
+            };
+            return;
+        }
+        SeqPatternSet<W, H> builtins;
+        for (int pattern = 1; pattern <= builtins.m_numPatterns; pattern++)
+        {
+            std::vector<int> steps;
+            for (int i = 0; i < builtins.Length(pattern); i++)
+            {
+                steps.push_back(builtins.Step(pattern, i));
+            }
+            m_patterns.push_back(steps);
+        }
+    }
+
+    // The knob values the engine's inputs stand for
+    float PatternCv(int pattern) const
+    {
+        return 10.f * pattern / (float)m_patterns.size();
+    }
+
+    float StepsCv(int pattern, int steps) const
+    {
+        return 10.f * steps / (float)m_patterns[pattern - 1].size();
+    }
+
+    void AdvanceStep(float patternCv, float stepsCv)
+    {
+        float patternScale = std::max(0.f, std::min(patternCv, 10.f)) / 10.f;
+        int numPatterns = m_patterns.size();
+        int currentPattern = std::max(1, std::min((int)roundf(patternScale * numPatterns), numPatterns));
+
+        m_lastStepIndex = m_currentStepIndex;
+        float stepsScale = std::max(0.f, std::min(stepsCv, 10.f)) / 10.f;
+        int maxStepsInPattern = m_patterns[currentPattern - 1].size();
+        int numSteps = std::max(1, std::min((int)roundf(stepsScale * maxStepsInPattern), maxStepsInPattern));
+
+        for (int skipAttempts = 0; skipAttempts < W * H; skipAttempts++)
+        {
+            m_currentPatternIndex += 1;
+            if (m_currentPatternIndex >= numSteps)
+            {
+                m_currentPatternIndex = 0;
+            }
+            m_currentPatternIndex %= maxStepsInPattern;
+            m_currentStepIndex = m_patterns[currentPattern - 1][m_currentPatternIndex];
+            if (!m_isSkip.Test(m_currentStepIndex))
+            {
+                break;
+            }
+            else
+            {
+                numSteps++; // ignore wrt # of steps
+            }
+        }
+    }
+
+    SweepRecord Process(int n, float patternCv, float stepsCv)
+    {
+        SweepRecord record = SweepRecord();
+        bool nextStep = false;
+        bool gateIn = false;
+        float extClock = ExtClockInput(n);
+        float reset = ResetInput(n);
+        if (m_external)
+        {
+            // Schmitt trigger, high at 1V and low again at 0V
+            bool wasHigh = m_clockHigh;
+            m_clockHigh = m_clockHigh ? extClock > 0.f : extClock >= 1.f;
+            if (m_clockHigh && !wasHigh)
+            {
+                m_phase = 0.0;
+                nextStep = true;
+                record.edgeOffset = Crossing(m_lastExtClock, extClock, 1.f);
+            }
+            gateIn = m_clockHigh;
+            record.gateLevel = (gateIn == wasHigh) ? (gateIn ? 1.f : 0.f) : gateIn ? record.edgeOffset : 1.f - Crossing(m_lastExtClock, extClock, 0.f);
+        }
+        else
+        {
+            // High for the first half of each tick, averaged over the sample
+            double inc = std::pow(2.0, (double)SWEEP_CLOCK_OCTAVES) / SWEEP_SAMPLE_RATE;
+            double last = m_phase;
+            m_phase += inc;
+            double high = std::max(0.0, 0.5 - last);
+            if (m_phase >= 1.0)
+            {
+                m_phase -= 1.0;
+                nextStep = true;
+                record.edgeOffset = (float)(m_phase / inc);
+                high += std::min(m_phase, 0.5);
+            }
+            else
+            {
+                high = std::max(0.0, std::min(m_phase, 0.5) - last);
+            }
+            gateIn = (m_phase < 0.5);
+            record.gateLevel = (float)(high / inc);
+        }
+
+        bool resetHigh = m_resetHigh ? reset > 0.f : reset >= 1.f;
+        if (resetHigh && !m_resetHigh)
+        {
+            record.edgeOffset = Crossing(m_lastReset, reset, 1.f);
+            m_currentStepIndex = W * H;
+            nextStep = true;
+            record.reset = true;
+            if (!m_external)
+            {
+                // the internal clock starts a tick where the reset came
+                double inc = std::pow(2.0, (double)SWEEP_CLOCK_OCTAVES) / SWEEP_SAMPLE_RATE;
+                m_phase = record.edgeOffset * inc;
+                gateIn = true;
+                record.gateLevel = record.edgeOffset;
+            }
+        }
+        m_resetHigh = resetHigh;
+        m_lastExtClock = extClock;
+        m_lastReset = reset;
+
+        if (nextStep)
+        {
+            AdvanceStep(patternCv, stepsCv);
+        }
+
+        // Rows
+        int lastX = m_lastStepIndex % W;
+        int curX = m_currentStepIndex % W;
+        int lastY = m_lastStepIndex / W;
+        int curY = m_currentStepIndex / W;
+        bool on = true; // every gate on
+        bool gateXChanged = on && lastX != curX && gateIn;
+        bool gateYChanged = on && lastY != curY && gateIn;
+
+        record.step = m_currentStepIndex;
+        record.advanced = nextStep;
+        record.gateIn = gateIn;
+        record.gateX = gateXChanged;
+        record.gateY = gateYChanged;
+        record.gateXorY = gateXChanged || gateYChanged;
+        record.pitch = KnobPitch(m_currentStepIndex);
+        record.edgeOffset = nextStep ? record.edgeOffset : 0.f;
+        return record;
+    }
+};
+
+// The same render through the engine.  It is reused: SetClock() clears the
+// clock's state, and the reset the rest of what the last render left.
+template <int W, int H>
+static void RenderEngine(SeqEngine<W, H> &engine, const SweepLine &line, const typename SeqGrid<W, H>::Mask &skip, std::vector<SweepRecord> &records)
+{
+    float sampleTime = 1.f / SWEEP_SAMPLE_RATE;
+    engine.SetClock(1, 0.5f);
+    engine.SetSkipMask(skip);
+    engine.m_phaseAcc = 0;
+
+    SeqInputs in;
+    in.clock = SWEEP_CLOCK_OCTAVES;
+    in.extClockConnected = line.external;
+    in.pattern = 10.f * line.pattern / engine.NumPatterns();
+    in.steps = 10.f * line.steps / engine.Patterns().Length(line.pattern);
+    engine.Process(in, sampleTime);
+    engine.m_currentPatternIndex = -1;
+
+    records.resize(RenderSamples(line));
+    for (int n = 0; n < RenderSamples(line); n++)
+    {
+        in.reset = ResetInput(n);
+        in.extClock = ExtClockInput(n);
+        SeqFrame frame = engine.Process(in, sampleTime);
+        SweepRecord &record = records[n];
+        record.step = frame.step;
+        record.advanced = frame.advanced;
+        record.reset = frame.reset;
+        record.gateIn = frame.gateIn;
+        record.gateX = frame.gateX;
+        record.gateY = frame.gateY;
+        record.gateXorY = frame.gateXorY;
+        record.pitch = KnobPitch(frame.step);
+        record.gateLevel = frame.gateLevel;
+        record.edgeOffset = frame.edgeOffset;
+    }
+}
+
+template <int W, int H>
+static void RenderReference(const SweepLine &line, const typename SeqGrid<W, H>::Mask &skip, std::vector<SweepRecord> &records)
+{
+    SweepReference<W, H> reference;
+    reference.m_isSkip = skip;
+    reference.m_external = line.external;
+    reference.m_phase = line.external ? 0.0 : std::pow(2.0, (double)SWEEP_CLOCK_OCTAVES) / SWEEP_SAMPLE_RATE;
+    float patternCv = reference.PatternCv(line.pattern);
+    float stepsCv = reference.StepsCv(line.pattern, line.steps);
+
+    records.resize(RenderSamples(line));
+    for (int n = 0; n < RenderSamples(line); n++)
+    {
+        records[n] = reference.Process(n, patternCv, stepsCv);
+    }
+}
+
+// Every skip mask of a line: all of them, or the same sample of a spread
+// of densities every time
+template <int W, int H>
+static int NumMasks()
+{
+    return (W * H <= 16) ? 1 << (W * H) : SWEEP_SAMPLED_MASKS;
+}
+
+template <int W, int H>
+static typename SeqGrid<W, H>::Mask SkipMask(const SweepLine &line, int index, SeqRandom &random)
+{
+    typename SeqGrid<W, H>::Mask skip;
+    if (W * H <= 16)
+    {
+        skip.m_words[0] = (uint64_t)index;
+        return skip;
+    }
+    if (index == 0)
+    {
+        random.Seed((uint32_t)(line.pattern * 1000 + line.steps));
+    }
+    return SeqGrid<W, H>::Mask::Random((float)(index % 8) / 8.f, random);
+}
+
+template <int W, int H>
+static uint64_t Digest(SeqEngine<W, H> &engine, const SweepLine &line, bool reference)
+{
+    uint64_t digest = 0xcbf29ce484222325ull;
+    std::vector<SweepRecord> records;
+    SeqRandom random;
+    for (int i = 0; i < NumMasks<W, H>(); i++)
+    {
+        typename SeqGrid<W, H>::Mask skip = SkipMask<W, H>(line, i, random);
+        if (reference)
+        {
+            RenderReference<W, H>(line, skip, records);
+        }
+        else
+        {
+            RenderEngine(engine, line, skip, records);
+        }
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (const SweepRecord &record : records)
+        {
+            Hash(hash, record);
+        }
+        Hash(digest, hash);
+    }
+    return digest;
+}
+
+// The first sample of a differing line where the engine and the reference
+// part ways, for a failure to name
+template <int W, int H>
+static std::string Explain(const SweepLine &line)
+{
+    std::unique_ptr<SeqEngine<W, H> > engine(new SeqEngine<W, H>());
+    std::vector<SweepRecord> engineRecords;
+    std::vector<SweepRecord> referenceRecords;
+    SeqRandom random;
+    for (int i = 0; i < NumMasks<W, H>(); i++)
+    {
+        typename SeqGrid<W, H>::Mask skip = SkipMask<W, H>(line, i, random);
+        RenderEngine(*engine, line, skip, engineRecords);
+        RenderReference<W, H>(line, skip, referenceRecords);
+        for (size_t n = 0; n < engineRecords.size(); n++)
+        {
+            if (!(engineRecords[n] == referenceRecords[n]))
+            {
+                char where[96];
+                snprintf(where, sizeof(where), "skip mask %d (words[0] %016llx), sample %d", i, (unsigned long long)skip.m_words[0], (int)n);
+                return std::string(where) + "\n    engine:    " + RecordText(engineRecords[n]) + "\n    reference: " + RecordText(referenceRecords[n]);
+            }
+        }
+    }
+    return "the engine matches the reference, so the golden file is out of date with it";
+}
+
+// Every built-in pattern's step counts: all of them, or on the bigger grids
+// all up to 16 and an even spread past that
+template <int W, int H>
+static void AddLines(std::vector<SweepLine> &lines)
+{
+    std::unique_ptr<SeqEngine<W, H> > engine(new SeqEngine<W, H>());
+    for (int pattern = 1; pattern <= engine->NumPatterns(); pattern++)
+    {
+        int length = engine->Patterns().Length(pattern);
+        for (int steps = 1; steps <= length; steps++)
+        {
+            bool sampled = (W * H > 16 && steps > 16 && steps % (length / SWEEP_SAMPLED_STEPS) != 0 && steps != length);
+            if (!sampled)
+            {
+                lines.push_back({W, pattern, steps, false, 0});
+                lines.push_back({W, pattern, steps, true, 0});
+            }
+        }
+    }
+}
+
+// Each thread takes the next line until there are none left
+static void SweepThread(std::vector<SweepLine> &lines, std::atomic<int> &next, bool reference)
+{
+    std::unique_ptr<SeqEngine<4, 4> > engine4(new SeqEngine<4, 4>());
+    std::unique_ptr<SeqEngine<8, 8> > engine8(new SeqEngine<8, 8>());
+    std::unique_ptr<SeqEngine<16, 16> > engine16(new SeqEngine<16, 16>());
+    for (int i = next++; i < (int)lines.size(); i = next++)
+    {
+        SweepLine &line = lines[i];
+        line.digest = (line.size == 4) ? Digest(*engine4, line, reference) :
+                      (line.size == 8) ? Digest(*engine8, line, reference) : Digest(*engine16, line, reference);
+    }
+}
+
+static std::string LineText(const SweepLine &line)
+{
+    char text[96];
+    snprintf(text, sizeof(text), "%dx%d pattern %d steps %d %s %016llx", line.size, line.size, line.pattern, line.steps,
+             line.external ? "external" : "internal", (unsigned long long)line.digest);
+    return text;
+}
+
+int RunSweep(const std::string &goldenPath, int threads, bool record)
+{
+    // A missing golden file fails before the sweep: recording one is a
+    // deliberate step, not something a first run does
+    FILE *file = record ? NULL : fopen(goldenPath.c_str(), "rb");
+    if (!record && !file)
+    {
+        printf("sweep: NO GOLDEN FILE %s (make render-sweep-record writes one)\n", goldenPath.c_str());
+        return 1;
+    }
+
+    std::vector<SweepLine> lines;
+    AddLines<4, 4>(lines);
+    AddLines<8, 8>(lines);
+    AddLines<16, 16>(lines);
+
+    threads = (threads > 0) ? threads : std::max(1, (int)std::thread::hardware_concurrency());
+    SweepClock::time_point start = SweepClock::now();
+    std::atomic<int> next(0);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++)
+    {
+        workers.push_back(std::thread(SweepThread, std::ref(lines), std::ref(next), record));
+    }
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(SweepClock::now() - start).count();
+
+    std::string text;
+    for (const SweepLine &line : lines)
+    {
+        text += LineText(line) + "\n";
+    }
+
+    if (record)
+    {
+        file = fopen(goldenPath.c_str(), "wb");
+        bool ok = file && fwrite(text.data(), text.size(), 1, file) == 1;
+        ok = file && (fclose(file) == 0) && ok;
+        printf("sweep: %d lines of the reference in %.1f s on %d threads, %s %s\n", (int)lines.size(), seconds, threads,
+               ok ? "recorded as" : "COULD NOT WRITE", goldenPath.c_str());
+        return ok ? 0 : 1;
+    }
+
+    // Line by line, so a difference says which pattern, step count and clock,
+    // and the first few are traced down to the sample
+    std::vector<char> golden(text.size() + 1);
+    size_t size = fread(golden.data(), 1, golden.size(), file);
+    fclose(file);
+    std::string goldenText(golden.data(), size);
+    int differences = 0;
+    size_t at = 0;
+    for (const SweepLine &line : lines)
+    {
+        std::string expected = LineText(line);
+        size_t end = goldenText.find('\n', at);
+        std::string got = goldenText.substr(at, (end == std::string::npos) ? std::string::npos : end - at);
+        at = (end == std::string::npos) ? goldenText.size() : end + 1;
+        if (got != expected)
+        {
+            if (differences++ < SWEEP_EXPLAINED)
+            {
+                std::string why = (line.size == 4) ? Explain<4, 4>(line) : (line.size == 8) ? Explain<8, 8>(line) : Explain<16, 16>(line);
+                printf("DIFFERS: %s (golden: %s)\n  first difference at %s\n", expected.c_str(), got.empty() ? "missing" : got.c_str(), why.c_str());
+            }
+        }
+    }
+    differences += (at < goldenText.size());
+    if (differences)
+    {
+        printf("sweep: %d lines in %.1f s on %d threads, %d DIFFER FROM THE GOLDEN FILE\n", (int)lines.size(), seconds, threads, differences);
+    }
+    else
+    {
+        printf("sweep: %d lines in %.1f s on %d threads, same as the golden file\n", (int)lines.size(), seconds, threads);
+    }
+    return differences ? 1 : 0;
+}
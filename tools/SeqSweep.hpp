@@ -0,0 +1,19 @@
+#pragma once
+
+// Golden-output sweep of the engine's step logic: every built-in pattern at
+// every step count with every skip mask (all 65536 on the 4x4 grid, a fixed
+// seeded sample on the bigger ones), on the internal clock and an external
+// one.  Each sample's outputs (step and pitch, clock gate and its level,
+// edge offset, which of X, Y and X-or-Y fired) are hashed, and one digest
+// line per pattern, step count and clock is compared against a golden file.
+// The file is recorded from a model of the original module's step walk
+// rather than from the engine, and a line that differs is traced to the
+// first sample where the engine and that model part ways.  Lines are spread
+// over threads; the digests don't depend on how many.
+
+#include <string>
+
+// Compares with `goldenPath`, or with `record` writes it instead.
+// threads <= 0 uses every core.  Returns the process exit code: 0 when
+// every line matches, 1 when one differs or there is no golden file.
+int RunSweep(const std::string &goldenPath, int threads, bool record);